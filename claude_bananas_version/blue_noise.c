@@ -0,0 +1,107 @@
+// Void-and-cluster blue-noise rank mask (Ulichney 1993) — see blue_noise.h
+
+#include "blue_noise.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define BN_MASK (BLUE_NOISE_SIZE - 1)
+#define BN_SIGMA 1.5f                 // Gaussian filter width, in texels
+#define BN_INITIAL_ONES (BLUE_NOISE_TEXELS / 10)
+
+typedef struct BlueNoiseState {
+    unsigned char bits[BLUE_NOISE_TEXELS];
+    float energy[BLUE_NOISE_TEXELS];  // filtered density of the 1 texels
+} BlueNoiseState;
+
+// Add (sign = 1) or remove (sign = -1) texel p's Gaussian, wrapping at the edges
+static void Splat(BlueNoiseState *s, const float *kernel, int p, float sign) {
+    int px = p & BN_MASK, py = p / BLUE_NOISE_SIZE;
+    for (int y = 0; y < BLUE_NOISE_SIZE; y++) {
+        const float *krow = &kernel[((y - py) & BN_MASK) * BLUE_NOISE_SIZE];
+        float *erow = &s->energy[y * BLUE_NOISE_SIZE];
+        for (int x = 0; x < BLUE_NOISE_SIZE; x++) erow[x] += sign * krow[(x - px) & BN_MASK];
+    }
+}
+
+static void SetBit(BlueNoiseState *s, const float *kernel, int p, int value) {
+    s->bits[p] = (unsigned char)value;
+    Splat(s, kernel, p, value ? 1.0f : -1.0f);
+}
+
+// 1 texel with the highest energy (tightest cluster)
+static int TightestCluster(const BlueNoiseState *s) {
+    int best = -1;
+    for (int i = 0; i < BLUE_NOISE_TEXELS; i++)
+        if (s->bits[i] && (best < 0 || s->energy[i] > s->energy[best])) best = i;
+    return best;
+}
+
+// 0 texel with the lowest energy (largest void)
+static int LargestVoid(const BlueNoiseState *s) {
+    int best = -1;
+    for (int i = 0; i < BLUE_NOISE_TEXELS; i++)
+        if (!s->bits[i] && (best < 0 || s->energy[i] < s->energy[best])) best = i;
+    return best;
+}
+
+int BlueNoiseBuild(float *values) {
+    float *kernel = (float *)malloc(BLUE_NOISE_TEXELS * sizeof(float));
+    BlueNoiseState *proto = (BlueNoiseState *)calloc(1, sizeof(BlueNoiseState));
+    BlueNoiseState *work = (BlueNoiseState *)malloc(sizeof(BlueNoiseState));
+    int *rank = (int *)malloc(BLUE_NOISE_TEXELS * sizeof(int));
+    if (!kernel || !proto || !work || !rank) {
+        free(kernel); free(proto); free(work); free(rank);
+        return -1;
+    }
+
+    // Toroidal Gaussian indexed by (dy, dx) offset
+    for (int dy = 0; dy < BLUE_NOISE_SIZE; dy++) {
+        int ty = dy < BLUE_NOISE_SIZE - dy ? dy : BLUE_NOISE_SIZE - dy;
+        for (int dx = 0; dx < BLUE_NOISE_SIZE; dx++) {
+            int tx = dx < BLUE_NOISE_SIZE - dx ? dx : BLUE_NOISE_SIZE - dx;
+            kernel[dy * BLUE_NOISE_SIZE + dx] =
+                expf(-(float)(tx * tx + ty * ty) / (2.0f * BN_SIGMA * BN_SIGMA));
+        }
+    }
+
+    // Initial binary pattern: fixed-seed white noise, then swap the tightest
+    // cluster into the largest void until that stops moving anything
+    uint32_t rng = 0x9e3779b9u;
+    for (int placed = 0; placed < BN_INITIAL_ONES;) {
+        rng = rng * 747796405u + 2891336453u;
+        int p = (int)((rng >> 8) % BLUE_NOISE_TEXELS);
+        if (!proto->bits[p]) { SetBit(proto, kernel, p, 1); placed++; }
+    }
+    for (int iter = 0; iter < BLUE_NOISE_TEXELS; iter++) {
+        int cluster = TightestCluster(proto);
+        SetBit(proto, kernel, cluster, 0);
+        int hole = LargestVoid(proto);
+        SetBit(proto, kernel, hole, 1);
+        if (hole == cluster) break;
+    }
+
+    // Phase 1: rank the initial ones by removing clusters, last removed first
+    memcpy(work, proto, sizeof(BlueNoiseState));
+    for (int r = BN_INITIAL_ONES - 1; r >= 0; r--) {
+        int cluster = TightestCluster(work);
+        SetBit(work, kernel, cluster, 0);
+        rank[cluster] = r;
+    }
+
+    // Phases 2 + 3: fill the largest void until the tile is full. With a linear
+    // energy the minority-zero cluster of phase 3 is the same texel.
+    for (int r = BN_INITIAL_ONES; r < BLUE_NOISE_TEXELS; r++) {
+        int hole = LargestVoid(proto);
+        SetBit(proto, kernel, hole, 1);
+        rank[hole] = r;
+    }
+
+    for (int i = 0; i < BLUE_NOISE_TEXELS; i++)
+        values[i] = ((float)rank[i] + 0.5f) / (float)BLUE_NOISE_TEXELS;
+
+    free(kernel); free(proto); free(work); free(rank);
+    return 0;
+}
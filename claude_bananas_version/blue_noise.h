@@ -0,0 +1,20 @@
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+// Tileable blue-noise rank mask (void-and-cluster), the per-pixel offset of
+// the Sobol sampler in raytrace.glsl / cpu_tracer.c. Uploaded as the
+// blueNoise texture by main_web.c and read directly by cpu_tracer.c.
+//
+// Texel (x, y) holds (rank + 0.5) / BLUE_NOISE_TEXELS, where rank is the
+// order void-and-cluster placed that texel in: every prefix of the ranking
+// is an evenly spread point set, so the values are uniform in (0, 1) and
+// neighbouring texels differ as much as possible.
+
+#define BLUE_NOISE_SIZE 64   // tile edge, repeated across the screen
+#define BLUE_NOISE_TEXELS (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE)
+
+// Fill values (BLUE_NOISE_TEXELS floats, row-major). Deterministic: the same
+// tile on every run and backend. Returns non-zero on allocation failure.
+int BlueNoiseBuild(float *values);
+
+#endif // BLUE_NOISE_H
@@ -0,0 +1,457 @@
+// Binned SAH BVH builder — see bvh.h
+
+#include "bvh.h"
+
+#include <string.h>
+#include <math.h>
+
+#define SAH_BINS 12
+#define BOUNDS_PAD 1e-4f   // keeps axis-aligned quads from producing zero-width slabs
+#define BVH_REBUILD_RATIO 1.3f
+
+typedef struct Aabb { float bmin[3], bmax[3]; } Aabb;
+
+static void AabbEmpty(Aabb *b) {
+    for (int k = 0; k < 3; k++) { b->bmin[k] = 1e30f; b->bmax[k] = -1e30f; }
+}
+
+static void AabbGrowPoint(Aabb *b, const float *p) {
+    for (int k = 0; k < 3; k++) {
+        b->bmin[k] = fminf(b->bmin[k], p[k]);
+        b->bmax[k] = fmaxf(b->bmax[k], p[k]);
+    }
+}
+
+static void AabbGrow(Aabb *b, const Aabb *o) {
+    for (int k = 0; k < 3; k++) {
+        b->bmin[k] = fminf(b->bmin[k], o->bmin[k]);
+        b->bmax[k] = fmaxf(b->bmax[k], o->bmax[k]);
+    }
+}
+
+static float AabbArea(const Aabb *b) {
+    float dx = b->bmax[0] - b->bmin[0], dy = b->bmax[1] - b->bmin[1], dz = b->bmax[2] - b->bmin[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f) return 0.0f;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+void BvhPrimBounds(const float *geomRow, float bmin[3], float bmax[3]) {
+    Aabb b;
+    AabbEmpty(&b);
+    int ptype = GEOM_PRIM_TYPE(geomRow[3]);
+    const float *g0 = &geomRow[0], *g1 = &geomRow[4], *g2 = &geomRow[8];
+
+    if (ptype == PRIM_SPHERE) {
+        float r = fabsf(g0[3]);
+        for (int k = 0; k < 3; k++) { b.bmin[k] = g0[k] - r; b.bmax[k] = g0[k] + r; }
+    } else if (ptype == PRIM_QUAD) {
+        // Q, Q+u, Q+v, Q+u+v
+        float p[3];
+        AabbGrowPoint(&b, g0);
+        for (int k = 0; k < 3; k++) p[k] = g0[k] + g1[k];
+        AabbGrowPoint(&b, p);
+        for (int k = 0; k < 3; k++) p[k] = g0[k] + g2[k];
+        AabbGrowPoint(&b, p);
+        for (int k = 0; k < 3; k++) p[k] = g0[k] + g1[k] + g2[k];
+        AabbGrowPoint(&b, p);
+    } else {
+        AabbGrowPoint(&b, g0);
+        AabbGrowPoint(&b, g1);
+        AabbGrowPoint(&b, g2);
+    }
+    for (int k = 0; k < 3; k++) {
+        bmin[k] = b.bmin[k] - BOUNDS_PAD;
+        bmax[k] = b.bmax[k] + BOUNDS_PAD;
+    }
+}
+
+// Build scratch — prims are tiny (MAX_PRIMS), so everything lives on the stack
+typedef struct BuildCtx {
+    Bvh *bvh;
+    Aabb primBox[MAX_PRIMS];
+    float centroid[MAX_PRIMS][3];
+} BuildCtx;
+
+static int CeilLog2(int n) {
+    int d = 0;
+    while ((1 << d) < n) d++;
+    return d;
+}
+
+// Pick a split for idx[0..count) — binned SAH, or an object median when the
+// centroids coincide (e.g. the nested glass spheres) or depth runs low.
+// Returns the number of prims placed in the left child.
+static int PartitionPrims(BuildCtx *ctx, int *idx, int count, int depth) {
+    Aabb cb;
+    AabbEmpty(&cb);
+    for (int i = 0; i < count; i++) AabbGrowPoint(&cb, ctx->centroid[idx[i]]);
+
+    int axis = 0;
+    float ext[3];
+    for (int k = 0; k < 3; k++) ext[k] = cb.bmax[k] - cb.bmin[k];
+    if (ext[1] > ext[axis]) axis = 1;
+    if (ext[2] > ext[axis]) axis = 2;
+
+    int forceMedian = ext[axis] <= 1e-6f || depth + CeilLog2(count) >= BVH_STACK_SIZE - 1;
+
+    if (!forceMedian) {
+        float bestCost = 1e30f;
+        int bestAxis = -1, bestBin = -1;
+        for (int a = 0; a < 3; a++) {
+            if (ext[a] <= 1e-6f) continue;
+            Aabb binBox[SAH_BINS];
+            int binCount[SAH_BINS] = {0};
+            for (int b = 0; b < SAH_BINS; b++) AabbEmpty(&binBox[b]);
+            float scale = (float)SAH_BINS / ext[a];
+            for (int i = 0; i < count; i++) {
+                int b = (int)((ctx->centroid[idx[i]][a] - cb.bmin[a]) * scale);
+                if (b >= SAH_BINS) b = SAH_BINS - 1;
+                binCount[b]++;
+                AabbGrow(&binBox[b], &ctx->primBox[idx[i]]);
+            }
+            // Sweep: area * count on each side of every bin boundary
+            float leftArea[SAH_BINS - 1];
+            int leftCount[SAH_BINS - 1];
+            Aabb acc;
+            AabbEmpty(&acc);
+            int n = 0;
+            for (int b = 0; b < SAH_BINS - 1; b++) {
+                AabbGrow(&acc, &binBox[b]);
+                n += binCount[b];
+                leftArea[b] = AabbArea(&acc);
+                leftCount[b] = n;
+            }
+            AabbEmpty(&acc);
+            n = 0;
+            for (int b = SAH_BINS - 1; b > 0; b--) {
+                AabbGrow(&acc, &binBox[b]);
+                n += binCount[b];
+                int nl = leftCount[b - 1];
+                if (nl == 0 || n == 0) continue;
+                float cost = leftArea[b - 1] * (float)nl + AabbArea(&acc) * (float)n;
+                if (cost < bestCost) { bestCost = cost; bestAxis = a; bestBin = b - 1; }
+            }
+        }
+
+        if (bestAxis >= 0) {
+            float scale = (float)SAH_BINS / ext[bestAxis];
+            int mid = 0;
+            for (int i = 0; i < count; i++) {
+                int b = (int)((ctx->centroid[idx[i]][bestAxis] - cb.bmin[bestAxis]) * scale);
+                if (b >= SAH_BINS) b = SAH_BINS - 1;
+                if (b <= bestBin) {
+                    int t = idx[i]; idx[i] = idx[mid]; idx[mid] = t;
+                    mid++;
+                }
+            }
+            if (mid > 0 && mid < count) return mid;
+        }
+    }
+
+    // Object median along the widest centroid axis (insertion sort — count is small)
+    for (int i = 1; i < count; i++) {
+        int v = idx[i];
+        float key = ctx->centroid[v][axis];
+        int j = i - 1;
+        while (j >= 0 && ctx->centroid[idx[j]][axis] > key) { idx[j + 1] = idx[j]; j--; }
+        idx[j + 1] = v;
+    }
+    return count / 2;
+}
+
+static int BuildRecursive(BuildCtx *ctx, int *idx, int count, int depth, int parent) {
+    Bvh *bvh = ctx->bvh;
+    int nodeIdx = bvh->nodeCount++;
+    BvhNode *node = &bvh->nodes[nodeIdx];
+    node->parent = parent;
+
+    Aabb box;
+    AabbEmpty(&box);
+    for (int i = 0; i < count; i++) AabbGrow(&box, &ctx->primBox[idx[i]]);
+    memcpy(node->bmin, box.bmin, sizeof(node->bmin));
+    memcpy(node->bmax, box.bmax, sizeof(node->bmax));
+
+    if (count == 1) {
+        node->left = idx[0];
+        node->right = -1;
+        bvh->primLeaf[idx[0]] = nodeIdx;
+        return nodeIdx;
+    }
+
+    int mid = PartitionPrims(ctx, idx, count, depth);
+    node->left = BuildRecursive(ctx, idx, mid, depth + 1, nodeIdx);
+    node->right = BuildRecursive(ctx, idx + mid, count - mid, depth + 1, nodeIdx);
+    return nodeIdx;
+}
+
+void BvhBuild(Bvh *bvh, const float *geomData, int primCount) {
+    bvh->nodeCount = 0;
+    bvh->buildCost = 0.0f;
+    for (int i = 0; i < MAX_PRIMS; i++) bvh->primLeaf[i] = -1;
+    memset(bvh->dirty, 1, sizeof(bvh->dirty));
+    if (primCount <= 0) return;
+    if (primCount > MAX_PRIMS) primCount = MAX_PRIMS;
+
+    BuildCtx ctx;
+    ctx.bvh = bvh;
+    int idx[MAX_PRIMS];
+    for (int i = 0; i < primCount; i++) {
+        BvhPrimBounds(&geomData[i * GEOM_ROW_FLOATS], ctx.primBox[i].bmin, ctx.primBox[i].bmax);
+        for (int k = 0; k < 3; k++)
+            ctx.centroid[i][k] = 0.5f * (ctx.primBox[i].bmin[k] + ctx.primBox[i].bmax[k]);
+        idx[i] = i;
+    }
+    BuildRecursive(&ctx, idx, primCount, 0, -1);
+    bvh->buildCost = BvhSahCost(bvh, NULL);
+}
+
+// ============================================================
+// Incremental updates
+// ============================================================
+
+static int IsLeaf(const BvhNode *n) { return n->right < 0; }
+
+static void NodeAabb(const BvhNode *n, Aabb *b) {
+    memcpy(b->bmin, n->bmin, sizeof(b->bmin));
+    memcpy(b->bmax, n->bmax, sizeof(b->bmax));
+}
+
+static void UnionAabb(const Aabb *a, const Aabb *b, Aabb *out) {
+    *out = *a;
+    AabbGrow(out, b);
+}
+
+// Re-point whatever references node `from` (parent's child slot, children's
+// parent, or primLeaf for a leaf) at `to`
+static void RelinkNode(Bvh *bvh, int from, int to) {
+    BvhNode *n = &bvh->nodes[to];
+    if (n->parent >= 0) {
+        BvhNode *p = &bvh->nodes[n->parent];
+        if (p->left == from) p->left = to; else p->right = to;
+        bvh->dirty[n->parent] = 1;
+    }
+    if (IsLeaf(n)) {
+        bvh->primLeaf[n->left] = to;
+    } else {
+        bvh->nodes[n->left].parent = to;
+        bvh->nodes[n->right].parent = to;
+    }
+}
+
+// Release a node by moving the last node into its slot (keeps rows dense)
+static void FreeNode(Bvh *bvh, int idx) {
+    int last = --bvh->nodeCount;
+    bvh->dirty[last] = 0;
+    if (idx == last) return;
+    bvh->nodes[idx] = bvh->nodes[last];
+    bvh->dirty[idx] = 1;
+    RelinkNode(bvh, last, idx);
+}
+
+// Recompute bounds from the children, walking up until nothing changes
+static void RefitAncestors(Bvh *bvh, int node) {
+    while (node >= 0) {
+        BvhNode *n = &bvh->nodes[node];
+        Aabb l, r, u;
+        NodeAabb(&bvh->nodes[n->left], &l);
+        NodeAabb(&bvh->nodes[n->right], &r);
+        UnionAabb(&l, &r, &u);
+        if (memcmp(u.bmin, n->bmin, sizeof(u.bmin)) == 0 &&
+            memcmp(u.bmax, n->bmax, sizeof(u.bmax)) == 0) break;
+        memcpy(n->bmin, u.bmin, sizeof(n->bmin));
+        memcpy(n->bmax, u.bmax, sizeof(n->bmax));
+        bvh->dirty[node] = 1;
+        node = n->parent;
+    }
+}
+
+void BvhRefit(Bvh *bvh, const float *geomData, int prim) {
+    if (prim < 0 || prim >= MAX_PRIMS) return;
+    int leaf = bvh->primLeaf[prim];
+    if (leaf < 0) return;
+    BvhNode *n = &bvh->nodes[leaf];
+    BvhPrimBounds(&geomData[prim * GEOM_ROW_FLOATS], n->bmin, n->bmax);
+    bvh->dirty[leaf] = 1;
+    RefitAncestors(bvh, n->parent);
+}
+
+void BvhInsert(Bvh *bvh, const float *geomData, int prim) {
+    if (prim < 0 || prim >= MAX_PRIMS || bvh->nodeCount + 2 > BVH_MAX_NODES) return;
+
+    Aabb leafBox;
+    BvhPrimBounds(&geomData[prim * GEOM_ROW_FLOATS], leafBox.bmin, leafBox.bmax);
+
+    if (bvh->nodeCount == 0) {
+        BvhNode *root = &bvh->nodes[0];
+        memcpy(root->bmin, leafBox.bmin, sizeof(root->bmin));
+        memcpy(root->bmax, leafBox.bmax, sizeof(root->bmax));
+        root->left = prim;
+        root->right = -1;
+        root->parent = -1;
+        bvh->primLeaf[prim] = 0;
+        bvh->dirty[0] = 1;
+        bvh->nodeCount = 1;
+        return;
+    }
+
+    // Greedy descent: stop where pairing with the new leaf is cheaper than
+    // pushing it further down (inherited cost = growth of the ancestors)
+    int sibling = 0;
+    while (!IsLeaf(&bvh->nodes[sibling])) {
+        const BvhNode *n = &bvh->nodes[sibling];
+        Aabb box, grown;
+        NodeAabb(n, &box);
+        UnionAabb(&box, &leafBox, &grown);
+        float combined = AabbArea(&grown);
+        float costHere = 2.0f * combined;
+        float inherit = 2.0f * (combined - AabbArea(&box));
+
+        float childCost[2];
+        int child[2] = { n->left, n->right };
+        for (int c = 0; c < 2; c++) {
+            Aabb cb, cg;
+            NodeAabb(&bvh->nodes[child[c]], &cb);
+            UnionAabb(&cb, &leafBox, &cg);
+            childCost[c] = AabbArea(&cg) + inherit;
+            if (!IsLeaf(&bvh->nodes[child[c]])) childCost[c] -= AabbArea(&cb);
+        }
+        if (costHere <= childCost[0] && costHere <= childCost[1]) break;
+        sibling = childCost[0] <= childCost[1] ? child[0] : child[1];
+    }
+
+    int leaf = bvh->nodeCount++;
+    int parent = bvh->nodeCount++;
+    if (sibling == 0) {
+        // Root stays at row 0: move the old root out and put the new parent there
+        bvh->nodes[parent] = bvh->nodes[0];
+        RelinkNode(bvh, 0, parent);
+        sibling = parent;
+        parent = 0;
+        bvh->nodes[0].parent = -1;
+    } else {
+        int grand = bvh->nodes[sibling].parent;
+        BvhNode *g = &bvh->nodes[grand];
+        if (g->left == sibling) g->left = parent; else g->right = parent;
+        bvh->nodes[parent].parent = grand;
+        bvh->dirty[grand] = 1;
+    }
+
+    BvhNode *ln = &bvh->nodes[leaf];
+    memcpy(ln->bmin, leafBox.bmin, sizeof(ln->bmin));
+    memcpy(ln->bmax, leafBox.bmax, sizeof(ln->bmax));
+    ln->left = prim;
+    ln->right = -1;
+    ln->parent = parent;
+    bvh->primLeaf[prim] = leaf;
+
+    BvhNode *pn = &bvh->nodes[parent];
+    pn->left = sibling;
+    pn->right = leaf;
+    bvh->nodes[sibling].parent = parent;
+    Aabb sb, u;
+    NodeAabb(&bvh->nodes[sibling], &sb);
+    UnionAabb(&sb, &leafBox, &u);
+    memcpy(pn->bmin, u.bmin, sizeof(pn->bmin));
+    memcpy(pn->bmax, u.bmax, sizeof(pn->bmax));
+
+    bvh->dirty[leaf] = 1;
+    bvh->dirty[parent] = 1;
+    bvh->dirty[sibling] = 1;
+    RefitAncestors(bvh, pn->parent);
+}
+
+void BvhRemove(Bvh *bvh, int prim, int lastPrim) {
+    if (prim < 0 || prim >= MAX_PRIMS) return;
+    int leaf = bvh->primLeaf[prim];
+    if (leaf >= 0) {
+        bvh->primLeaf[prim] = -1;
+        int parent = bvh->nodes[leaf].parent;
+        if (parent < 0) {
+            // Last node in the tree
+            FreeNode(bvh, leaf);
+        } else {
+            BvhNode *p = &bvh->nodes[parent];
+            int sibling = (p->left == leaf) ? p->right : p->left;
+            int grand = p->parent;
+            int freeA, freeB;
+            if (grand < 0) {
+                // Parent is the root: the sibling subtree becomes the root at row 0
+                bvh->nodes[0] = bvh->nodes[sibling];
+                bvh->nodes[0].parent = -1;
+                RelinkNode(bvh, sibling, 0);
+                bvh->dirty[0] = 1;
+                freeA = sibling;
+                freeB = leaf;
+            } else {
+                BvhNode *g = &bvh->nodes[grand];
+                if (g->left == parent) g->left = sibling; else g->right = sibling;
+                bvh->nodes[sibling].parent = grand;
+                bvh->dirty[grand] = 1;
+                RefitAncestors(bvh, grand);
+                freeA = parent;
+                freeB = leaf;
+            }
+            // Free the higher row first so the second index is still valid
+            if (freeA < freeB) { int t = freeA; freeA = freeB; freeB = t; }
+            FreeNode(bvh, freeA);
+            FreeNode(bvh, freeB);
+        }
+    }
+
+    // The host moved lastPrim into the freed slot — rename its leaf
+    if (lastPrim != prim && lastPrim >= 0 && lastPrim < MAX_PRIMS) {
+        int moved = bvh->primLeaf[lastPrim];
+        bvh->primLeaf[lastPrim] = -1;
+        if (moved >= 0) {
+            bvh->nodes[moved].left = prim;
+            bvh->primLeaf[prim] = moved;
+            bvh->dirty[moved] = 1;
+        }
+    }
+}
+
+float BvhSahCost(const Bvh *bvh, int *maxDepth) {
+    if (maxDepth) *maxDepth = 0;
+    if (bvh->nodeCount == 0) return 0.0f;
+
+    Aabb rootBox;
+    NodeAabb(&bvh->nodes[0], &rootBox);
+    float rootArea = AabbArea(&rootBox);
+    if (rootArea <= 0.0f) return 0.0f;
+
+    float cost = 0.0f;
+    for (int i = 0; i < bvh->nodeCount; i++) {
+        Aabb b;
+        NodeAabb(&bvh->nodes[i], &b);
+        cost += AabbArea(&b);
+    }
+    if (maxDepth) {
+        for (int i = 0; i < bvh->nodeCount; i++) {
+            if (!IsLeaf(&bvh->nodes[i])) continue;
+            int d = 0;
+            for (int n = bvh->nodes[i].parent; n >= 0; n = bvh->nodes[n].parent) d++;
+            if (d > *maxDepth) *maxDepth = d;
+        }
+    }
+    return cost / rootArea;
+}
+
+int BvhNeedsRebuild(const Bvh *bvh) {
+    int depth;
+    float cost = BvhSahCost(bvh, &depth);
+    if (depth >= BVH_STACK_SIZE - 1) return 1;
+    return bvh->buildCost > 0.0f && cost > bvh->buildCost * BVH_REBUILD_RATIO;
+}
+
+void BvhPackNode(const Bvh *bvh, int node, float *row) {
+    const BvhNode *n = &bvh->nodes[node];
+    row[0] = n->bmin[0]; row[1] = n->bmin[1]; row[2] = n->bmin[2];
+    row[3] = (float)n->left;
+    row[4] = n->bmax[0]; row[5] = n->bmax[1]; row[6] = n->bmax[2];
+    row[7] = (float)n->right;
+}
+
+void BvhPack(const Bvh *bvh, float *out) {
+    for (int i = 0; i < bvh->nodeCount; i++)
+        BvhPackNode(bvh, i, &out[i * BVH_ROW_FLOATS]);
+}
@@ -0,0 +1,50 @@
+#ifndef BVH_H
+#define BVH_H
+
+// Surface-area-heuristic BVH over the packed scene primitives.
+// Built on the host from the packed geometry rows, packed into the node
+// texture layout described in scene_layout.h and traversed by
+// findClosestHit/anyHitWithin in raytrace.glsl (and by cpu_tracer.c).
+
+#include "scene_layout.h"
+
+typedef struct BvhNode {
+    float bmin[3], bmax[3];
+    int left, right;   // children; leaf: left = prim index, right = -1
+    int parent;        // -1 for the root (always node 0)
+} BvhNode;
+
+typedef struct Bvh {
+    BvhNode nodes[BVH_MAX_NODES];
+    int nodeCount;                      // nodes are kept dense in [0, nodeCount)
+    int primLeaf[MAX_PRIMS];            // leaf node of each prim, -1 if not in the tree
+    unsigned char dirty[BVH_MAX_NODES]; // node rows changed since the last upload
+    float buildCost;                    // BvhSahCost() right after the last full build
+} Bvh;
+
+// AABB of one primitive from its packed geometry row (GEOM_ROW_FLOATS)
+void BvhPrimBounds(const float *geomRow, float bmin[3], float bmax[3]);
+
+// Full binned-SAH build over rows 0..primCount-1 of the packed geometry buffer
+void BvhBuild(Bvh *bvh, const float *geomData, int primCount);
+
+// Incremental updates for interactive edits. Each marks the node rows it
+// touches in bvh->dirty so only those need re-uploading.
+// Refit: prim's bounds changed (move/resize) — refits its leaf and ancestors.
+void BvhRefit(Bvh *bvh, const float *geomData, int prim);
+// Insert: prim was appended — descends by SAH cost to pick a sibling.
+void BvhInsert(Bvh *bvh, const float *geomData, int prim);
+// Remove: prim was deleted by moving lastPrim into its slot (as the host does).
+void BvhRemove(Bvh *bvh, int prim, int lastPrim);
+
+// SAH cost of the tree (sum of node areas / root area); optional max leaf depth
+float BvhSahCost(const Bvh *bvh, int *maxDepth);
+// True when updates degraded the tree past BVH_REBUILD_RATIO of its build cost
+// or pushed it deeper than the shader stack can traverse
+int BvhNeedsRebuild(const Bvh *bvh);
+
+// Write one node / all nodes into the node texture layout (BVH_ROW_FLOATS per node)
+void BvhPackNode(const Bvh *bvh, int node, float *row);
+void BvhPack(const Bvh *bvh, float *out);
+
+#endif // BVH_H
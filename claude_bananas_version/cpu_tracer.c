@@ -0,0 +1,1193 @@
+// CPU path tracer — mirrors shaders/raytrace.glsl function for function so
+// the same scene buffer renders the same image without a GPU.
+
+#include "cpu_tracer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define MAX_DEPTH 8
+#define AO_SAMPLES 4
+#define SOFT_SHADOW_SAMPLES 4
+#define PI 3.14159265359f
+#define EPSILON 0.001f
+#define DEFAULT_TILE_SIZE 16
+#define ADAPTIVE_ROUND_SPP 16   // samples per pixel per round, like one GPU frame at the default rate
+
+// ============================================================
+// Small vector math
+// ============================================================
+typedef struct Vec3f { float x, y, z; } Vec3f;
+
+static inline Vec3f V3(float x, float y, float z) { return (Vec3f){x, y, z}; }
+static inline Vec3f V3Add(Vec3f a, Vec3f b) { return V3(a.x+b.x, a.y+b.y, a.z+b.z); }
+static inline Vec3f V3Sub(Vec3f a, Vec3f b) { return V3(a.x-b.x, a.y-b.y, a.z-b.z); }
+static inline Vec3f V3Mul(Vec3f a, Vec3f b) { return V3(a.x*b.x, a.y*b.y, a.z*b.z); }
+static inline Vec3f V3Scale(Vec3f a, float s) { return V3(a.x*s, a.y*s, a.z*s); }
+static inline float V3Dot(Vec3f a, Vec3f b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+static inline float V3Len(Vec3f a) { return sqrtf(V3Dot(a, a)); }
+static inline Vec3f V3Norm(Vec3f a) { return V3Scale(a, 1.0f / V3Len(a)); }
+static inline Vec3f V3Cross(Vec3f a, Vec3f b) {
+    return V3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+static inline Vec3f V3Mix(Vec3f a, Vec3f b, float t) { return V3Add(a, V3Scale(V3Sub(b, a), t)); }
+static inline Vec3f V3Reflect(Vec3f i, Vec3f n) { return V3Sub(i, V3Scale(n, 2.0f * V3Dot(n, i))); }
+static inline Vec3f V3Refract(Vec3f i, Vec3f n, float eta) {
+    float d = V3Dot(n, i);
+    float k = 1.0f - eta * eta * (1.0f - d * d);
+    if (k < 0.0f) return V3(0, 0, 0);
+    return V3Sub(V3Scale(i, eta), V3Scale(n, eta * d + sqrtf(k)));
+}
+static inline float Clampf(float x, float lo, float hi) { return x < lo ? lo : (x > hi ? hi : x); }
+// Branch-free min/max for hot loops — fminf/fmaxf keep NaN semantics and end up as libm calls
+static inline float Minf(float a, float b) { return a < b ? a : b; }
+static inline float Maxf(float a, float b) { return a > b ? a : b; }
+
+typedef struct Ray3 { Vec3f origin, direction; } Ray3;
+
+typedef struct HitRecord {
+    float t;
+    Vec3f hitPoint;
+    Vec3f normal;
+} HitRecord;
+
+// Per-thread trace context (RNG + sampler state live here instead of shader globals)
+typedef struct TraceCtx {
+    const CpuTracerScene *scene;
+    const CpuTracerSettings *set;
+    uint32_t rngState;
+    uint32_t samplerIndex;       // sample number within the pixel
+    int px, py;                  // pixel, for the blue-noise offset
+} TraceCtx;
+
+// ============================================================
+// Scene data access (same geometry / material layouts as the textures)
+// ============================================================
+static inline const float *GeomTexel(const TraceCtx *c, int prim, int col) {
+    return &c->scene->geomData[prim * GEOM_ROW_FLOATS + col * 4];
+}
+
+static inline const float *SceneTexel(const TraceCtx *c, int row, int col) {
+    return &c->scene->sceneData[row * SCENE_ROW_FLOATS + col * 4];
+}
+
+static inline Vec3f TexelXYZ(const float *t) { return V3(t[0], t[1], t[2]); }
+
+// ============================================================
+// RNG — PCG hash
+// ============================================================
+static inline uint32_t PcgHash(uint32_t v) {
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+static inline float RandomFloat(TraceCtx *c) {
+    c->rngState = PcgHash(c->rngState);
+    return (float)c->rngState / 4294967295.0f;
+}
+
+// ============================================================
+// Sampler — one stream per sample dimension (see raytrace.glsl)
+// ============================================================
+#define SAMPLE_LIGHT_PICK    0
+#define SAMPLE_EMITTER_PICK  1
+#define SAMPLE_EMITTER_POINT 2
+#define SAMPLE_ENV_TEXEL     3
+#define SAMPLE_ENV_JITTER    4
+#define SAMPLE_SCATTER       5
+#define SAMPLE_RR            6
+#define SAMPLE_DIMS_PER_BOUNCE 7
+
+typedef struct Vec2f { float x, y; } Vec2f;
+
+static inline int BounceDim(int depth, int dim) {
+    return 1 + depth * SAMPLE_DIMS_PER_BOUNCE + dim;
+}
+
+static inline uint32_t ReverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+static inline uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+static inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) {
+    return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+static inline uint32_t SobolDim1(uint32_t i) {
+    uint32_t v = 0x80000000u, x = 0;
+    for (; i; i >>= 1) {
+        if (i & 1u) x ^= v;
+        v ^= v >> 1;
+    }
+    return x;
+}
+
+static inline float BlueNoiseShift(const TraceCtx *c, int slot) {
+    const float *tile = c->scene->blueNoise;
+    if (!tile) return 0.0f;
+    // Same R2 offsets as the shader, truncated the same way
+    float fx = 0.7548776662f * (float)slot, fy = 0.5698402910f * (float)slot;
+    int ox = (int)((fx - floorf(fx)) * (float)BLUE_NOISE_SIZE);
+    int oy = (int)((fy - floorf(fy)) * (float)BLUE_NOISE_SIZE);
+    int x = (c->px + ox) & (BLUE_NOISE_SIZE - 1);
+    int y = (c->py + oy) & (BLUE_NOISE_SIZE - 1);
+    return tile[y * BLUE_NOISE_SIZE + x];
+}
+
+static inline float UintToUnit(uint32_t x) {
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline float Frac(float x) { return x - floorf(x); }
+
+static float Sample1D(TraceCtx *c, int dim) {
+    if (c->set->samplerMode == SAMPLER_PCG) return RandomFloat(c);
+    uint32_t seed = PcgHash((uint32_t)dim * 0x9e3779b9u + 1u);
+    uint32_t i = NestedUniformScramble(c->samplerIndex, seed);
+    float u = UintToUnit(NestedUniformScramble(ReverseBits(i), PcgHash(seed)));
+    return Frac(u + BlueNoiseShift(c, 2 * dim));
+}
+
+static Vec2f Sample2D(TraceCtx *c, int dim) {
+    if (c->set->samplerMode == SAMPLER_PCG) {
+        float u1 = RandomFloat(c);
+        return (Vec2f){ u1, RandomFloat(c) };
+    }
+    uint32_t seed = PcgHash((uint32_t)dim * 0x9e3779b9u + 1u);
+    uint32_t i = NestedUniformScramble(c->samplerIndex, seed);
+    float u1 = UintToUnit(NestedUniformScramble(ReverseBits(i), PcgHash(seed)));
+    float u2 = UintToUnit(NestedUniformScramble(SobolDim1(i), PcgHash(seed + 1u)));
+    return (Vec2f){ Frac(u1 + BlueNoiseShift(c, 2 * dim)), Frac(u2 + BlueNoiseShift(c, 2 * dim + 1)) };
+}
+
+static Vec3f CosineWeightedHemisphere(Vec3f normal, Vec2f u) {
+    float u1 = u.x;
+    float u2 = u.y;
+    float r = sqrtf(u2);
+    float theta = 2.0f * PI * u1;
+    float x = r * cosf(theta);
+    float y = r * sinf(theta);
+    float z = sqrtf(1.0f - u2);
+    Vec3f up = fabsf(normal.y) < 0.999f ? V3(0, 1, 0) : V3(1, 0, 0);
+    Vec3f tangent = V3Norm(V3Cross(up, normal));
+    Vec3f bitangent = V3Cross(normal, tangent);
+    return V3Norm(V3Add(V3Add(V3Scale(tangent, x), V3Scale(bitangent, y)), V3Scale(normal, z)));
+}
+
+// ============================================================
+// Intersection routines
+// ============================================================
+static int IntersectSphere(Ray3 r, Vec3f center, float radius, float tMax, float *tHit, Vec3f *hitNormal) {
+    Vec3f oc = V3Sub(r.origin, center);
+    float b = V3Dot(r.direction, oc);
+    float c = V3Dot(oc, oc) - radius * radius;
+    float disc = b * b - c;
+    if (disc < 0.0f) return 0;
+    float sqrtDisc = sqrtf(disc);
+    float t = -b - sqrtDisc;
+    if (t < EPSILON || t > tMax) {
+        t = -b + sqrtDisc;
+        if (t < EPSILON || t > tMax) return 0;
+    }
+    *tHit = t;
+    *hitNormal = V3Scale(V3Add(oc, V3Scale(r.direction, t)), 1.0f / radius);
+    return 1;
+}
+
+static int IntersectQuad(Ray3 r, Vec3f Q, Vec3f u, Vec3f v, float tMax, float *tHit, Vec3f *hitNormal) {
+    Vec3f n = V3Cross(u, v);
+    float nLen = V3Len(n);
+    if (nLen < 1e-8f) return 0;
+    Vec3f normal = V3Scale(n, 1.0f / nLen);
+    float denom = V3Dot(normal, r.direction);
+    if (fabsf(denom) < 1e-8f) return 0;
+
+    float t = V3Dot(V3Sub(Q, r.origin), normal) / denom;
+    if (t < EPSILON || t > tMax) return 0;
+
+    Vec3f p = V3Sub(V3Add(r.origin, V3Scale(r.direction, t)), Q);
+    Vec3f w = V3Scale(n, 1.0f / V3Dot(n, n));
+    float alpha = V3Dot(V3Cross(p, v), w);
+    float beta = V3Dot(V3Cross(u, p), w);
+    if (alpha < 0.0f || alpha > 1.0f || beta < 0.0f || beta > 1.0f) return 0;
+
+    *tHit = t;
+    *hitNormal = (denom < 0.0f) ? normal : V3Scale(normal, -1.0f);
+    return 1;
+}
+
+static int IntersectTriangle(Ray3 r, Vec3f A, Vec3f B, Vec3f C, float tMax, float *tHit, Vec3f *hitNormal) {
+    Vec3f E1 = V3Sub(B, A);
+    Vec3f E2 = V3Sub(C, A);
+    Vec3f P = V3Cross(r.direction, E2);
+    float det = V3Dot(E1, P);
+    if (fabsf(det) < 1e-8f) return 0;
+
+    float invDet = 1.0f / det;
+    Vec3f T = V3Sub(r.origin, A);
+    float u = V3Dot(T, P) * invDet;
+    if (u < 0.0f || u > 1.0f) return 0;
+
+    Vec3f QV = V3Cross(T, E1);
+    float vv = V3Dot(r.direction, QV) * invDet;
+    if (vv < 0.0f || u + vv > 1.0f) return 0;
+
+    float t = V3Dot(E2, QV) * invDet;
+    if (t < EPSILON || t > tMax) return 0;
+
+    *tHit = t;
+    Vec3f normal = V3Norm(V3Cross(E1, E2));
+    *hitNormal = (det > 0.0f) ? normal : V3Scale(normal, -1.0f);
+    return 1;
+}
+
+// Rows are sorted by type (quads, triangles, spheres), so the type is a range test
+static inline int PrimTypeOf(const TraceCtx *c, int i) {
+    if (i < c->scene->quadCount) return PRIM_QUAD;
+    return i < c->scene->quadCount + c->scene->triangleCount ? PRIM_TRIANGLE : PRIM_SPHERE;
+}
+
+static int IntersectPrim(const TraceCtx *c, int i, Ray3 r, float tMax, float *tHit, Vec3f *hitN) {
+    int ptype = PrimTypeOf(c, i);
+    const float *g0 = GeomTexel(c, i, 0);
+    if (ptype == PRIM_SPHERE)
+        return IntersectSphere(r, TexelXYZ(g0), g0[3], tMax, tHit, hitN);
+    Vec3f g1 = TexelXYZ(GeomTexel(c, i, 1));
+    Vec3f g2 = TexelXYZ(GeomTexel(c, i, 2));
+    if (ptype == PRIM_QUAD)
+        return IntersectQuad(r, TexelXYZ(g0), g1, g2, tMax, tHit, hitN);
+    return IntersectTriangle(r, TexelXYZ(g0), g1, g2, tMax, tHit, hitN);
+}
+
+// Quick bounding sphere rejection (no sqrt — uses discriminant sign only)
+static int RayMissesBounds(Ray3 r, Vec3f center, float radius) {
+    Vec3f oc = V3Sub(r.origin, center);
+    float b = V3Dot(r.direction, oc);
+    float c = V3Dot(oc, oc) - radius * radius;
+    if (b * b - c < 0.0f) return 1;
+    if (b > 0.0f && c > 0.0f) return 1;
+    return 0;
+}
+
+// ============================================================
+// BVH traversal (same node layout and order as the shader)
+// ============================================================
+static inline const float *BvhNodeRow(const TraceCtx *c, int node) {
+    return &c->scene->bvhNodes[node * BVH_ROW_FLOATS];
+}
+
+static inline Vec3f SafeInverse(Vec3f d) {
+    return V3(1.0f / (fabsf(d.x) < 1e-8f ? 1e-8f : d.x),
+              1.0f / (fabsf(d.y) < 1e-8f ? 1e-8f : d.y),
+              1.0f / (fabsf(d.z) < 1e-8f ? 1e-8f : d.z));
+}
+
+// Entry distance into the node's box within (0, tMax), or 1e38 on miss
+static float IntersectNodeBounds(const TraceCtx *c, Ray3 r, Vec3f invDir, int node, float tMax) {
+    const float *n = BvhNodeRow(c, node);
+    float tx0 = (n[0] - r.origin.x) * invDir.x, tx1 = (n[4] - r.origin.x) * invDir.x;
+    float ty0 = (n[1] - r.origin.y) * invDir.y, ty1 = (n[5] - r.origin.y) * invDir.y;
+    float tz0 = (n[2] - r.origin.z) * invDir.z, tz1 = (n[6] - r.origin.z) * invDir.z;
+    float tNear = Maxf(Maxf(Minf(tx0, tx1), Minf(ty0, ty1)), Maxf(Minf(tz0, tz1), 0.0f));
+    float tFar = Minf(Minf(Maxf(tx0, tx1), Maxf(ty0, ty1)), Minf(Maxf(tz0, tz1), tMax));
+    return tNear <= tFar ? tNear : 1e38f;
+}
+
+static inline void KeepHit(Ray3 r, float tHit, Vec3f hitN, int i, HitRecord *hit,
+                           float *tBest, int *hitIndex) {
+    *tBest = tHit;
+    hit->t = tHit;
+    hit->hitPoint = V3Add(r.origin, V3Scale(r.direction, tHit));
+    hit->normal = hitN;
+    *hitIndex = i;
+}
+
+static int FindClosestHit(const TraceCtx *c, Ray3 r, HitRecord *hit) {
+    int hitIndex = -1;
+    float tBest = 1e38f;
+    float tHit;
+    Vec3f hitN;
+
+    if (!c->scene->bvhNodes) {
+        // One loop per type range, no type dispatch inside
+        int count = c->scene->primCount < MAX_PRIMS ? c->scene->primCount : MAX_PRIMS;
+        int quadEnd = c->scene->quadCount, triEnd = quadEnd + c->scene->triangleCount;
+        for (int i = 0; i < quadEnd; i++) {
+            const float *g = GeomTexel(c, i, 0);
+            if (IntersectQuad(r, TexelXYZ(g), TexelXYZ(g + 4), TexelXYZ(g + 8), tBest, &tHit, &hitN) && tHit < tBest)
+                KeepHit(r, tHit, hitN, i, hit, &tBest, &hitIndex);
+        }
+        for (int i = quadEnd; i < triEnd; i++) {
+            const float *g = GeomTexel(c, i, 0);
+            if (IntersectTriangle(r, TexelXYZ(g), TexelXYZ(g + 4), TexelXYZ(g + 8), tBest, &tHit, &hitN) && tHit < tBest)
+                KeepHit(r, tHit, hitN, i, hit, &tBest, &hitIndex);
+        }
+        for (int i = triEnd; i < count; i++) {
+            const float *g = GeomTexel(c, i, 0);
+            if (IntersectSphere(r, TexelXYZ(g), g[3], tBest, &tHit, &hitN) && tHit < tBest)
+                KeepHit(r, tHit, hitN, i, hit, &tBest, &hitIndex);
+        }
+        return hitIndex;
+    }
+
+    if (c->scene->bvhNodeCount <= 0) return -1;
+    Vec3f invDir = SafeInverse(r.direction);
+    if (IntersectNodeBounds(c, r, invDir, 0, tBest) >= 1e38f) return -1;
+
+    int stackNode[BVH_STACK_SIZE];
+    float stackT[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = 0;
+
+    for (;;) {
+        const float *n = BvhNodeRow(c, node);
+        if (n[7] < 0.0f) {
+            int i = (int)(n[3] + 0.5f);
+            if (IntersectPrim(c, i, r, tBest, &tHit, &hitN) && tHit < tBest)
+                KeepHit(r, tHit, hitN, i, hit, &tBest, &hitIndex);
+        } else {
+            int left = (int)(n[3] + 0.5f);
+            int right = (int)(n[7] + 0.5f);
+            float tL = IntersectNodeBounds(c, r, invDir, left, tBest);
+            float tR = IntersectNodeBounds(c, r, invDir, right, tBest);
+            if (tL < 1e38f && tR < 1e38f) {
+                int leftFirst = tL <= tR;
+                if (sp < BVH_STACK_SIZE) {
+                    stackNode[sp] = leftFirst ? right : left;
+                    stackT[sp] = leftFirst ? tR : tL;
+                    sp++;
+                }
+                node = leftFirst ? left : right;
+                continue;
+            } else if (tL < 1e38f) {
+                node = left;
+                continue;
+            } else if (tR < 1e38f) {
+                node = right;
+                continue;
+            }
+        }
+
+        int found = 0;
+        while (sp > 0) {
+            sp--;
+            if (stackT[sp] < tBest) { node = stackNode[sp]; found = 1; break; }
+        }
+        if (!found) break;
+    }
+    return hitIndex;
+}
+
+static int AnyHitWithin(const TraceCtx *c, Ray3 r, float maxDist) {
+    float tHit;
+    Vec3f hitN;
+
+    if (!c->scene->bvhNodes) {
+        // Flat prims first, culled by their bounding spheres, then the spheres
+        int count = c->scene->primCount < MAX_PRIMS ? c->scene->primCount : MAX_PRIMS;
+        int quadEnd = c->scene->quadCount, triEnd = quadEnd + c->scene->triangleCount;
+        for (int i = 0; i < quadEnd; i++) {
+            const float *bs = SceneTexel(c, i, 3), *g = GeomTexel(c, i, 0);
+            if (RayMissesBounds(r, TexelXYZ(bs), bs[3])) continue;
+            if (IntersectQuad(r, TexelXYZ(g), TexelXYZ(g + 4), TexelXYZ(g + 8), maxDist, &tHit, &hitN)) return 1;
+        }
+        for (int i = quadEnd; i < triEnd; i++) {
+            const float *bs = SceneTexel(c, i, 3), *g = GeomTexel(c, i, 0);
+            if (RayMissesBounds(r, TexelXYZ(bs), bs[3])) continue;
+            if (IntersectTriangle(r, TexelXYZ(g), TexelXYZ(g + 4), TexelXYZ(g + 8), maxDist, &tHit, &hitN)) return 1;
+        }
+        for (int i = triEnd; i < count; i++) {
+            const float *g = GeomTexel(c, i, 0);
+            if (IntersectSphere(r, TexelXYZ(g), g[3], maxDist, &tHit, &hitN)) return 1;
+        }
+        return 0;
+    }
+
+    if (c->scene->bvhNodeCount <= 0) return 0;
+    Vec3f invDir = SafeInverse(r.direction);
+    int stackNode[BVH_STACK_SIZE];
+    int sp = 0;
+    stackNode[sp++] = 0;
+    while (sp > 0) {
+        int node = stackNode[--sp];
+        if (IntersectNodeBounds(c, r, invDir, node, maxDist) >= 1e38f) continue;
+        const float *n = BvhNodeRow(c, node);
+        if (n[7] < 0.0f) {
+            if (IntersectPrim(c, (int)(n[3] + 0.5f), r, maxDist, &tHit, &hitN)) return 1;
+        } else if (sp + 2 <= BVH_STACK_SIZE) {
+            stackNode[sp++] = (int)(n[7] + 0.5f);
+            stackNode[sp++] = (int)(n[3] + 0.5f);
+        }
+    }
+    return 0;
+}
+
+// ============================================================
+// Ambient occlusion + soft shadows
+// ============================================================
+static float ComputeAO(TraceCtx *c, Vec3f hitPoint, Vec3f normal) {
+    if (c->set->aoStrength <= 0.0f) return 1.0f;
+    float occlusion = 0.0f;
+    float effectiveRadius = fmaxf(c->set->aoRadius, 0.01f);
+    for (int i = 0; i < AO_SAMPLES; i++) {
+        float u1 = RandomFloat(c);
+        Vec3f dir = CosineWeightedHemisphere(normal, (Vec2f){ u1, RandomFloat(c) });
+        Ray3 aoRay = { V3Add(hitPoint, V3Scale(normal, EPSILON)), dir };
+        if (AnyHitWithin(c, aoRay, effectiveRadius)) occlusion += 1.0f;
+    }
+    return 1.0f - (occlusion / (float)AO_SAMPLES) * c->set->aoStrength;
+}
+
+static float ComputeShadowFactor(TraceCtx *c, Vec3f hitPoint, Vec3f normal, Vec3f toLight,
+                                 float maxDist, Vec3f lightPos, float lightRadius, int lightType,
+                                 int samples) {
+    Vec3f origin = V3Add(hitPoint, V3Scale(normal, EPSILON));
+    if (lightRadius > 0.001f) {
+        float visible = 0.0f;
+        for (int s = 0; s < samples; s++) {
+            float jx = RandomFloat(c), jy = RandomFloat(c), jz = RandomFloat(c);
+            Vec3f jitter = V3Scale(V3(jx * 2.0f - 1.0f, jy * 2.0f - 1.0f, jz * 2.0f - 1.0f), lightRadius);
+            Vec3f jitteredDir;
+            float jitteredDist;
+            if (lightType == LIGHT_POINT) {
+                Vec3f jVec = V3Sub(V3Add(lightPos, jitter), hitPoint);
+                jitteredDist = V3Len(jVec);
+                jitteredDir = V3Scale(jVec, 1.0f / jitteredDist);
+            } else {
+                jitteredDir = V3Norm(V3Add(toLight, V3Scale(jitter, 0.1f)));
+                jitteredDist = 1e38f;
+            }
+            if (!AnyHitWithin(c, (Ray3){ origin, jitteredDir }, jitteredDist)) visible += 1.0f;
+        }
+        return visible / (float)samples;
+    }
+    return AnyHitWithin(c, (Ray3){ origin, toLight }, maxDist) ? 0.0f : 1.0f;
+}
+
+// ============================================================
+// GGX / Cook-Torrance PBR
+// ============================================================
+static inline float D_GGX(float NdotH, float alpha) {
+    float a2 = alpha * alpha;
+    float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+    return a2 / (PI * d * d + 1e-7f);
+}
+
+static inline float V_SmithGGX(float NdotV, float NdotL, float alpha) {
+    float a2 = alpha * alpha;
+    float ggxV = NdotL * sqrtf(NdotV * NdotV * (1.0f - a2) + a2);
+    float ggxL = NdotV * sqrtf(NdotL * NdotL * (1.0f - a2) + a2);
+    return 0.5f / (ggxV + ggxL + 1e-7f);
+}
+
+static inline Vec3f F_Schlick(float cosTheta, Vec3f F0) {
+    float x = Clampf(1.0f - cosTheta, 0.0f, 1.0f);
+    float x2 = x * x;
+    float x5 = x2 * x2 * x;
+    return V3Add(F0, V3Scale(V3Sub(V3(1, 1, 1), F0), x5));
+}
+
+static Vec3f SampleGGX(Vec3f N, float alpha, Vec2f u) {
+    float u1 = u.x;
+    float u2 = u.y;
+    float a2 = alpha * alpha;
+    float cosTheta = sqrtf((1.0f - u1) / (1.0f + (a2 - 1.0f) * u1));
+    float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+    float phi = 2.0f * PI * u2;
+    Vec3f up = fabsf(N.y) < 0.999f ? V3(0, 1, 0) : V3(1, 0, 0);
+    Vec3f tangent = V3Norm(V3Cross(up, N));
+    Vec3f bitangent = V3Cross(N, tangent);
+    return V3Norm(V3Add(V3Add(V3Scale(tangent, sinTheta * cosf(phi)),
+                              V3Scale(bitangent, sinTheta * sinf(phi))), V3Scale(N, cosTheta)));
+}
+
+static Vec3f EvalBRDF(Vec3f N, Vec3f V, Vec3f L, Vec3f hitColor, int hitMat, float hitRough) {
+    float NdotL = fmaxf(V3Dot(N, L), 0.0f);
+    if (NdotL <= 0.0f) return V3(0, 0, 0);
+    Vec3f H = V3Norm(V3Add(L, V));
+    float NdotV = fmaxf(V3Dot(N, V), 0.001f);
+    float NdotH = fmaxf(V3Dot(N, H), 0.0f);
+    float VdotH = fmaxf(V3Dot(V, H), 0.0f);
+    float alpha = fmaxf(hitRough * hitRough, 0.002f);
+    float DV = D_GGX(NdotH, alpha) * V_SmithGGX(NdotV, NdotL, alpha);
+
+    if (hitMat == MAT_METAL)
+        return V3Scale(F_Schlick(VdotH, hitColor), DV * NdotL);
+    Vec3f F = F_Schlick(VdotH, V3(0.04f, 0.04f, 0.04f));
+    Vec3f spec = V3Scale(F, DV);
+    Vec3f diff = V3Scale(V3Mul(V3Sub(V3(1, 1, 1), F), hitColor), 1.0f / PI);
+    return V3Scale(V3Add(diff, spec), NdotL);
+}
+
+// ============================================================
+// Explicit lights
+// ============================================================
+typedef struct LightSample {
+    int type;
+    Vec3f pos, color;
+    float radius;
+    Vec3f toLight;
+    float attIntensity, maxShadowDist;
+} LightSample;
+
+static LightSample LightIncidence(TraceCtx *c, int li, Vec3f P) {
+    const CpuTracerSettings *st = c->set;
+    const float *l0 = SceneTexel(c, LIGHT_ROW_BASE + li, 0);
+    const float *l1 = SceneTexel(c, LIGHT_ROW_BASE + li, 1);
+    const float *l2 = SceneTexel(c, LIGHT_ROW_BASE + li, 2);
+    LightSample ls;
+    ls.type = (int)(l0[0] + 0.5f);
+    ls.pos = TexelXYZ(l1);
+    ls.color = TexelXYZ(l2);
+    ls.radius = l2[3];
+    float lInt = l1[3];
+    if (ls.type == LIGHT_POINT) {
+        Vec3f dirToLight = V3Sub(ls.pos, P);
+        float dLight = V3Len(dirToLight);
+        ls.toLight = V3Scale(dirToLight, 1.0f / dLight);
+        ls.attIntensity = lInt / (1.0f + st->kLinear * dLight + st->kQuadratic * dLight * dLight);
+        ls.maxShadowDist = dLight;
+    } else {
+        ls.toLight = V3Norm(V3(-l0[1], -l0[2], -l0[3]));
+        ls.attIntensity = lInt;
+        ls.maxShadowDist = 1e38f;
+    }
+    return ls;
+}
+
+// Unshadowed estimate used to pick a light (see estimateLight in the shader)
+static float EstimateLight(TraceCtx *c, int li, Vec3f P, Vec3f N) {
+    LightSample ls = LightIncidence(c, li, P);
+    float NdotL = fmaxf(V3Dot(N, ls.toLight), 0.0f);
+    return V3Dot(ls.color, V3(0.2126f, 0.7152f, 0.0722f)) * ls.attIntensity * NdotL;
+}
+
+static Vec3f ShadeLight(TraceCtx *c, int li, Vec3f P, Vec3f N, Vec3f V, Vec3f hitColor,
+                        int hitMat, float hitRough, int shadowSamples) {
+    LightSample ls = LightIncidence(c, li, P);
+    if (V3Dot(N, ls.toLight) <= 0.0f) return V3(0, 0, 0);
+    float shadow = ComputeShadowFactor(c, P, N, ls.toLight, ls.maxShadowDist,
+                                       ls.pos, ls.radius, ls.type, shadowSamples);
+    if (shadow <= 0.0f) return V3(0, 0, 0);
+    Vec3f brdfVal = EvalBRDF(N, V, ls.toLight, hitColor, hitMat, hitRough);
+    return V3Scale(V3Mul(brdfVal, ls.color), ls.attIntensity * shadow);
+}
+
+// ============================================================
+// Emissive primitive sampling (NEE)
+// ============================================================
+static int SampleQuadLight(TraceCtx *c, int idx, Vec3f hitPoint, Vec2f uPoint,
+                           Vec3f *lightDir, float *lightDist, float *pdf) {
+    Vec3f Q = TexelXYZ(GeomTexel(c, idx, 0));
+    Vec3f u = TexelXYZ(GeomTexel(c, idx, 1));
+    Vec3f v = TexelXYZ(GeomTexel(c, idx, 2));
+    float s = uPoint.x;
+    float t = uPoint.y;
+    Vec3f pointOnLight = V3Add(Q, V3Add(V3Scale(u, s), V3Scale(v, t)));
+
+    Vec3f toLight = V3Sub(pointOnLight, hitPoint);
+    float dist2 = V3Dot(toLight, toLight);
+    *lightDist = sqrtf(dist2);
+    *lightDir = V3Scale(toLight, 1.0f / *lightDist);
+
+    Vec3f n = V3Cross(u, v);
+    float area = V3Len(n);
+    if (area < 1e-8f) return 0;
+    n = V3Scale(n, 1.0f / area);
+    float cosAtLight = fabsf(V3Dot(n, *lightDir));
+    if (cosAtLight < 1e-8f) return 0;
+    *pdf = dist2 / (area * cosAtLight);
+    return 1;
+}
+
+// Uniform point on triangle ABC (sqrt-warped barycentrics)
+static int SampleTriangleLight(TraceCtx *c, int idx, Vec3f hitPoint, Vec2f u,
+                               Vec3f *lightDir, float *lightDist, float *pdf) {
+    Vec3f A = TexelXYZ(GeomTexel(c, idx, 0));
+    Vec3f B = TexelXYZ(GeomTexel(c, idx, 1));
+    Vec3f C = TexelXYZ(GeomTexel(c, idx, 2));
+    float su = sqrtf(u.x);
+    float r2 = u.y;
+    float b0 = 1.0f - su, b1 = r2 * su;
+    Vec3f pointOnLight = V3Add(V3Add(V3Scale(A, b0), V3Scale(B, b1)), V3Scale(C, 1.0f - b0 - b1));
+
+    Vec3f toLight = V3Sub(pointOnLight, hitPoint);
+    float dist2 = V3Dot(toLight, toLight);
+    *lightDist = sqrtf(dist2);
+    *lightDir = V3Scale(toLight, 1.0f / *lightDist);
+
+    Vec3f n = V3Cross(V3Sub(B, A), V3Sub(C, A));
+    float len = V3Len(n);
+    if (len < 1e-8f) return 0;
+    float area = 0.5f * len;
+    float cosAtLight = fabsf(V3Dot(V3Scale(n, 1.0f / len), *lightDir));
+    if (cosAtLight < 1e-8f) return 0;
+    *pdf = dist2 / (area * cosAtLight);
+    return 1;
+}
+
+static int SampleSphereLight(TraceCtx *c, int idx, Vec3f hitPoint, Vec2f u,
+                             Vec3f *lightDir, float *lightDist, float *pdf) {
+    const float *g0 = GeomTexel(c, idx, 0);
+    Vec3f center = TexelXYZ(g0);
+    float radius = g0[3];
+
+    Vec3f toCenter = V3Sub(center, hitPoint);
+    float dist = V3Len(toCenter);
+    if (dist < radius + EPSILON) return 0;
+
+    float sinThetaMax2 = radius * radius / (dist * dist);
+    float cosThetaMax = sqrtf(fmaxf(0.0f, 1.0f - sinThetaMax2));
+    float u1 = u.x;
+    float u2 = u.y;
+    float cosTheta = 1.0f + u1 * (cosThetaMax - 1.0f);
+    float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * PI * u2;
+
+    Vec3f w = V3Scale(toCenter, 1.0f / dist);
+    Vec3f upV = fabsf(w.y) < 0.999f ? V3(0, 1, 0) : V3(1, 0, 0);
+    Vec3f uV = V3Norm(V3Cross(upV, w));
+    Vec3f vV = V3Cross(w, uV);
+    *lightDir = V3Norm(V3Add(V3Add(V3Scale(uV, sinTheta * cosf(phi)),
+                                   V3Scale(vV, sinTheta * sinf(phi))), V3Scale(w, cosTheta)));
+    *pdf = 1.0f / (2.0f * PI * (1.0f - cosThetaMax) + 1e-10f);
+
+    float tHit;
+    Vec3f hitN;
+    if (!IntersectSphere((Ray3){ hitPoint, *lightDir }, center, radius, 1e38f, &tHit, &hitN)) return 0;
+    *lightDist = tHit;
+    return 1;
+}
+
+// O(1) alias-table pick of an emissive prim; *selectPdf = its selection probability
+static int SampleEmitter(TraceCtx *c, float u1, float *selectPdf) {
+    int n = c->scene->emitterCount;
+    float u = u1 * (float)n;
+    int slot = (int)u;
+    if (slot >= n) slot = n - 1;
+    const float *e = SceneTexel(c, EMITTER_ROW_BASE + slot / SCENE_TEX_WIDTH, slot % SCENE_TEX_WIDTH);
+    if (u - (float)slot >= e[1]) {
+        int alias = (int)(e[2] + 0.5f);
+        e = SceneTexel(c, EMITTER_ROW_BASE + alias / SCENE_TEX_WIDTH, alias % SCENE_TEX_WIDTH);
+    }
+    *selectPdf = e[3];
+    return (int)(e[0] + 0.5f);
+}
+
+static inline float PowerHeuristic(float pdfA, float pdfB) {
+    float a2 = pdfA * pdfA;
+    return a2 / (a2 + pdfB * pdfB + 1e-10f);
+}
+
+// ============================================================
+// Dielectric scattering (Snell + Schlick)
+// ============================================================
+static Ray3 ScatterDielectric(Ray3 currentRay, const HitRecord *hit, float ior, float u) {
+    Vec3f unitDir = V3Norm(currentRay.direction);
+    Vec3f normal;
+    float etaRatio;
+    if (V3Dot(unitDir, hit->normal) > 0.0f) {
+        normal = V3Scale(hit->normal, -1.0f);
+        etaRatio = ior;
+    } else {
+        normal = hit->normal;
+        etaRatio = 1.0f / ior;
+    }
+
+    float cosTheta = fminf(-V3Dot(unitDir, normal), 1.0f);
+    float sinTheta2 = etaRatio * etaRatio * (1.0f - cosTheta * cosTheta);
+    int cannotRefract = sinTheta2 > 1.0f;
+    float r0 = (1.0f - etaRatio) / (1.0f + etaRatio);
+    r0 = r0 * r0;
+    float reflectance = r0 + (1.0f - r0) * powf(1.0f - cosTheta, 5.0f);
+
+    if (cannotRefract || reflectance > u)
+        return (Ray3){ V3Add(hit->hitPoint, V3Scale(normal, EPSILON)), V3Reflect(unitDir, normal) };
+    return (Ray3){ V3Sub(hit->hitPoint, V3Scale(normal, EPSILON)), V3Refract(unitDir, normal, etaRatio) };
+}
+
+// ============================================================
+// Environment
+// ============================================================
+// Equirectangular UV from direction (dirToEquirect in the shader)
+static void DirToEquirect(const TraceCtx *c, Vec3f dir, float *u, float *v) {
+    float phi = atan2f(dir.z, dir.x) + c->set->envRotation;
+    float theta = asinf(Clampf(dir.y, -1.0f, 1.0f));
+    *u = phi / (2.0f * PI) + 0.5f;
+    *v = theta / PI + 0.5f;
+}
+
+static inline const float *EnvTexel(const TraceCtx *c, int x, int y) {
+    return &c->scene->envRgb[((size_t)y * c->scene->envWidth + x) * 3];
+}
+
+// Bilinear fetch matching the envMap texture: repeat in u, clamp in v
+static Vec3f EnvMapLookup(const TraceCtx *c, Vec3f dir) {
+    const CpuTracerScene *sc = c->scene;
+    if (!sc->envRgb) return V3(0, 0, 0);
+    float u, v;
+    DirToEquirect(c, dir, &u, &v);
+    float fx = (u - floorf(u)) * sc->envWidth - 0.5f;
+    float fy = Clampf(v * sc->envHeight - 0.5f, 0.0f, (float)(sc->envHeight - 1));
+    int x0 = (int)floorf(fx), y0 = (int)fy;
+    float tx = fx - (float)x0, ty = fy - (float)y0;
+    int x1 = (x0 + 1) % sc->envWidth;
+    if (x0 < 0) x0 += sc->envWidth;
+    int y1 = y0 + 1 < sc->envHeight ? y0 + 1 : y0;
+    Vec3f a = V3Mix(TexelXYZ(EnvTexel(c, x0, y0)), TexelXYZ(EnvTexel(c, x1, y0)), tx);
+    Vec3f b = V3Mix(TexelXYZ(EnvTexel(c, x0, y1)), TexelXYZ(EnvTexel(c, x1, y1)), tx);
+    return V3Mix(a, b, ty);
+}
+
+static Vec3f SampleEnvironment(const TraceCtx *c, Vec3f dir) {
+    Vec3f color;
+    if (c->set->envMode == ENV_HDR_MAP || c->set->envMode == ENV_PROCEDURAL) {
+        color = EnvMapLookup(c, dir);   // loaded .hdr or the baked sky
+    } else {
+        float a = 0.5f * (dir.y + 1.0f);
+        color = V3Mix(V3(0.3f, 0.5f, 0.8f), V3(1, 1, 1), a);
+    }
+    return V3Scale(color, c->set->envIntensity);
+}
+
+// ============================================================
+// HDR environment importance sampling (see env_map.h for the CDF layout)
+// ============================================================
+static inline int EnvSamplingEnabled(const TraceCtx *c) {
+    return (c->set->envMode == ENV_HDR_MAP || c->set->envMode == ENV_PROCEDURAL) &&
+           c->scene->envRgb && c->scene->envCdf;
+}
+
+static inline const float *EnvCdfRow(const TraceCtx *c, int row) {
+    return &c->scene->envCdf[(size_t)row * c->scene->envWidth];
+}
+
+static int EnvCdfSearch(const float *cdf, int n, float u) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] > u) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+static inline float EnvCdfMass(const float *cdf, int i) {
+    return cdf[i] - (i > 0 ? cdf[i - 1] : 0.0f);
+}
+
+static float EnvTexelPdf(const TraceCtx *c, int x, int y, float cosLat) {
+    const CpuTracerScene *sc = c->scene;
+    if (cosLat <= 1e-6f) return 0.0f;
+    float pmf = EnvCdfMass(EnvCdfRow(c, sc->envHeight), y) * EnvCdfMass(EnvCdfRow(c, y), x);
+    return pmf * (float)sc->envWidth * (float)sc->envHeight / (2.0f * PI * PI * cosLat);
+}
+
+static float EnvLightPdf(const TraceCtx *c, Vec3f dir) {
+    const CpuTracerScene *sc = c->scene;
+    float u, v;
+    DirToEquirect(c, dir, &u, &v);
+    int x = (int)((u - floorf(u)) * (float)sc->envWidth);
+    if (x > sc->envWidth - 1) x = sc->envWidth - 1;
+    int y = (int)(v * (float)sc->envHeight);
+    y = y < 0 ? 0 : (y > sc->envHeight - 1 ? sc->envHeight - 1 : y);
+    return EnvTexelPdf(c, x, y, sqrtf(fmaxf(1.0f - dir.y * dir.y, 0.0f)));
+}
+
+static int SampleEnvLight(TraceCtx *c, Vec2f uTexel, Vec2f uJitter, Vec3f *dir, float *pdf) {
+    const CpuTracerScene *sc = c->scene;
+    int y = EnvCdfSearch(EnvCdfRow(c, sc->envHeight), sc->envHeight, uTexel.y);
+    int x = EnvCdfSearch(EnvCdfRow(c, y), sc->envWidth, uTexel.x);
+    float u = ((float)x + uJitter.x) / (float)sc->envWidth;
+    float v = ((float)y + uJitter.y) / (float)sc->envHeight;
+    float lat = (v - 0.5f) * PI;
+    float phi = (u - 0.5f) * 2.0f * PI - c->set->envRotation;
+    float cosLat = cosf(lat);
+    *dir = V3(cosLat * cosf(phi), sinf(lat), cosLat * sinf(phi));
+    *pdf = EnvTexelPdf(c, x, y, cosLat);
+    return *pdf > 0.0f;
+}
+
+static float BrdfPdf(Vec3f N, Vec3f V, Vec3f L, int hitMat, float hitRough) {
+    float NdotL = V3Dot(N, L);
+    if (NdotL <= 0.0f) return 0.0f;
+    if (hitMat != MAT_METAL) return NdotL / PI;
+    Vec3f H = V3Norm(V3Add(L, V));
+    float alpha = fmaxf(hitRough * hitRough, 0.002f);
+    float NdotH = fmaxf(V3Dot(N, H), 0.0f);
+    float VdotH = fmaxf(V3Dot(V, H), 0.0f);
+    return D_GGX(NdotH, alpha) * NdotH / (4.0f * VdotH + 1e-7f);
+}
+
+// ============================================================
+// Main path loop with NEE + MIS (port of colorRayIterative)
+// ============================================================
+static Vec3f ColorRayIterative(TraceCtx *c, Ray3 currentRay) {
+    const CpuTracerScene *sc = c->scene;
+    const CpuTracerSettings *st = c->set;
+    Vec3f outColor = V3(0, 0, 0);
+    Vec3f throughput = V3(1, 1, 1);
+    int lastBounceSpecular = 0;
+    float lastBrdfPdf = 0.0f;
+
+    for (int depth = 0; depth < MAX_DEPTH; depth++) {
+        HitRecord hit = {0};
+        int hitIndex = FindClosestHit(c, currentRay, &hit);
+        if (hitIndex == -1) {
+            Vec3f envDir = V3Norm(currentRay.direction);
+            Vec3f envL = SampleEnvironment(c, envDir);
+            if (EnvSamplingEnabled(c) && depth > 0 && !lastBounceSpecular)
+                envL = V3Scale(envL, PowerHeuristic(lastBrdfPdf, EnvLightPdf(c, envDir)));
+            outColor = V3Add(outColor, V3Mul(throughput, envL));
+            break;
+        }
+
+        // Material row: the only scene fetch for the winning hit
+        const float *d1 = SceneTexel(c, hitIndex, 0);
+        const float *d2 = SceneTexel(c, hitIndex, 1);
+        const float *d3 = SceneTexel(c, hitIndex, 2);
+        Vec3f hitColor = TexelXYZ(d1);
+        int hitMat = (int)(d1[3] + 0.5f);
+        float hitEmStr = d2[3];
+        float hitIOR = d3[0], hitRough = d3[1];
+
+        if (hitEmStr > 0.0f && (depth == 0 || lastBounceSpecular || sc->emitterCount == 0))
+            outColor = V3Add(outColor, V3Mul(throughput, V3Scale(TexelXYZ(d2), hitEmStr)));
+        if (hitMat == MAT_EMISSIVE) break;
+
+        // AO: the GPU enables it once accumulation settles (frameCount > 8);
+        // offline renders are always "settled".
+        float ao = (depth < 3) ? ComputeAO(c, hit.hitPoint, hit.normal) : 1.0f;
+
+        Vec3f N = hit.normal;
+        Vec3f V = V3Norm(V3Scale(currentRay.direction, -1.0f));
+
+        // === Direct lighting from explicit lights ===
+        int lCount = sc->lightCount < MAX_LIGHTS ? sc->lightCount : MAX_LIGHTS;
+        if (st->lightSampling == LIGHT_SAMPLING_ALL) {
+            for (int li = 0; li < lCount; li++) {
+                Vec3f Ld = ShadeLight(c, li, hit.hitPoint, N, V, hitColor, hitMat, hitRough,
+                                      SOFT_SHADOW_SAMPLES);
+                outColor = V3Add(outColor, V3Scale(V3Mul(throughput, Ld), ao));
+            }
+        } else if (lCount > 0) {
+            float lWeight[MAX_LIGHTS];
+            float lTotal = 0.0f;
+            for (int li = 0; li < lCount; li++) {
+                lWeight[li] = EstimateLight(c, li, hit.hitPoint, N);
+                lTotal += lWeight[li];
+            }
+            if (lTotal > 0.0f) {
+                float u = Sample1D(c, BounceDim(depth, SAMPLE_LIGHT_PICK)) * lTotal;
+                int pick = lCount - 1;
+                for (int li = 0; li < lCount; li++) {
+                    u -= lWeight[li];
+                    if (u < 0.0f) { pick = li; break; }
+                }
+                if (lWeight[pick] > 0.0f) {
+                    float selectPdf = lWeight[pick] / lTotal;
+                    Vec3f Ld = ShadeLight(c, pick, hit.hitPoint, N, V, hitColor, hitMat, hitRough, 1);
+                    outColor = V3Add(outColor, V3Scale(V3Mul(throughput, Ld), ao / selectPdf));
+                }
+            }
+        }
+
+        // === NEE: sample emissive primitives directly ===
+        if (sc->emitterCount > 0 && hitMat != MAT_DIELECTRIC) {
+            float selectPdf;
+            int emIdx = SampleEmitter(c, Sample1D(c, BounceDim(depth, SAMPLE_EMITTER_PICK)), &selectPdf);
+            int emType = PrimTypeOf(c, emIdx);
+
+            Vec3f lightDir;
+            float lightDist, lightPdf;
+            int sampled = 0;
+            Vec2f uLight = Sample2D(c, BounceDim(depth, SAMPLE_EMITTER_POINT));
+            if (emType == PRIM_QUAD)
+                sampled = SampleQuadLight(c, emIdx, hit.hitPoint, uLight, &lightDir, &lightDist, &lightPdf);
+            else if (emType == PRIM_SPHERE)
+                sampled = SampleSphereLight(c, emIdx, hit.hitPoint, uLight, &lightDir, &lightDist, &lightPdf);
+            else
+                sampled = SampleTriangleLight(c, emIdx, hit.hitPoint, uLight, &lightDir, &lightDist, &lightPdf);
+
+            if (sampled) {
+                lightPdf *= selectPdf;   // solid-angle pdf x selection probability
+                float NdotL = V3Dot(N, lightDir);
+                Ray3 shadowRay = { V3Add(hit.hitPoint, V3Scale(N, EPSILON)), lightDir };
+                if (NdotL > 0.0f && !AnyHitWithin(c, shadowRay, lightDist - 2.0f * EPSILON)) {
+                    const float *emData = SceneTexel(c, emIdx, 1);
+                    Vec3f Le = V3Scale(TexelXYZ(emData), emData[3]);
+                    Vec3f brdfVal = EvalBRDF(N, V, lightDir, hitColor, hitMat, hitRough);
+                    float brdfPdf = (hitMat == MAT_METAL) ? 0.0f : fmaxf(NdotL, 0.0f) / PI;
+                    float misWeight = PowerHeuristic(lightPdf, brdfPdf);
+                    if (lightPdf > 1e-10f) {
+                        float w = misWeight / lightPdf * ao;
+                        outColor = V3Add(outColor, V3Scale(V3Mul(V3Mul(throughput, Le), brdfVal), w));
+                    }
+                }
+            }
+        }
+
+        // === NEE: importance-sample the HDR environment ===
+        int specularHit = hitMat == MAT_DIELECTRIC || (hitMat == MAT_METAL && hitRough < 0.1f);
+        if (EnvSamplingEnabled(c) && !specularHit) {
+            Vec3f envDir;
+            float envPdf;
+            Vec2f uTexel = Sample2D(c, BounceDim(depth, SAMPLE_ENV_TEXEL));
+            Vec2f uJitter = Sample2D(c, BounceDim(depth, SAMPLE_ENV_JITTER));
+            if (SampleEnvLight(c, uTexel, uJitter, &envDir, &envPdf) && V3Dot(N, envDir) > 0.0f) {
+                Ray3 shadowRay = { V3Add(hit.hitPoint, V3Scale(N, EPSILON)), envDir };
+                if (!AnyHitWithin(c, shadowRay, 1e38f)) {
+                    Vec3f brdfVal = EvalBRDF(N, V, envDir, hitColor, hitMat, hitRough);
+                    float misWeight = PowerHeuristic(envPdf, BrdfPdf(N, V, envDir, hitMat, hitRough));
+                    Vec3f Le = SampleEnvironment(c, envDir);
+                    outColor = V3Add(outColor, V3Scale(V3Mul(V3Mul(throughput, Le), brdfVal),
+                                                       misWeight / envPdf));
+                }
+            }
+        }
+
+        // === Scatter ray for next bounce ===
+        lastBounceSpecular = 0;
+        Vec2f uScatter = Sample2D(c, BounceDim(depth, SAMPLE_SCATTER));
+        if (hitMat == MAT_DIELECTRIC) {
+            currentRay = ScatterDielectric(currentRay, &hit, hitIOR, uScatter.x);
+            throughput = V3Mul(throughput, hitColor);
+            lastBounceSpecular = 1;
+        } else if (hitMat == MAT_METAL) {
+            float alpha = fmaxf(hitRough * hitRough, 0.002f);
+            Vec3f Vm = V3Norm(V3Scale(currentRay.direction, -1.0f));
+            Vec3f H = SampleGGX(N, alpha, uScatter);
+            Vec3f L = V3Reflect(V3Scale(Vm, -1.0f), H);
+
+            float NdotL = V3Dot(N, L);
+            if (NdotL <= 0.0f) break;
+            float NdotV = fmaxf(V3Dot(N, Vm), 0.001f);
+            float NdotH = fmaxf(V3Dot(N, H), 0.0f);
+            float VdotH = fmaxf(V3Dot(Vm, H), 0.0f);
+
+            Vec3f F = F_Schlick(VdotH, hitColor);
+            float G = V_SmithGGX(NdotV, NdotL, alpha) * 4.0f * NdotV * NdotL;
+            float weight = G * VdotH / (NdotH * NdotV + 1e-7f);
+
+            currentRay = (Ray3){ V3Add(hit.hitPoint, V3Scale(N, EPSILON)), L };
+            lastBrdfPdf = D_GGX(NdotH, alpha) * NdotH / (4.0f * VdotH + 1e-7f);
+            throughput = V3Mul(throughput, V3Scale(F, weight));
+            lastBounceSpecular = (hitRough < 0.1f);
+        } else {
+            Vec3f scatterDir = CosineWeightedHemisphere(N, uScatter);
+            currentRay = (Ray3){ V3Add(hit.hitPoint, V3Scale(N, EPSILON)), scatterDir };
+            lastBrdfPdf = fmaxf(V3Dot(N, scatterDir), 0.0f) / PI;
+            throughput = V3Mul(throughput, hitColor);
+        }
+
+        // Russian roulette after depth 2
+        if (depth > 2) {
+            float p = Clampf(fmaxf(throughput.x, fmaxf(throughput.y, throughput.z)), 0.05f, 0.95f);
+            if (Sample1D(c, BounceDim(depth, SAMPLE_RR)) > p) break;
+            throughput = V3Scale(throughput, 1.0f / p);
+        }
+    }
+    return outColor;
+}
+
+// ============================================================
+// Tile scheduler
+// ============================================================
+typedef struct RenderJob {
+    const CpuTracerScene *scene;
+    const CpuTracerSettings *set;
+    float *rgbOut;
+    int tileSize, tilesX, tileCount;
+    atomic_int nextTile;
+} RenderJob;
+
+// Running sums for one pixel; adaptive tiles add to them round by round
+typedef struct PixelAccum {
+    Vec3f sum;
+    double lumSum, lumSqSum;
+    int count;
+} PixelAccum;
+
+static void TracePixelSamples(TraceCtx *c, int px, int py, int first, int count, PixelAccum *acc) {
+    const CpuTracerSettings *st = c->set;
+    const float *m = st->invViewProj;
+    Vec3f camPos = V3(st->cameraPosition[0], st->cameraPosition[1], st->cameraPosition[2]);
+    float pixelSizeX = 2.0f / (float)st->width;
+    float pixelSizeY = 2.0f / (float)st->height;
+    c->px = px;
+    c->py = py;
+
+    for (int s = first; s < first + count; s++) {
+        // Same seeding as the shader, with the sample index standing in for frameCount
+        c->rngState = (uint32_t)px * 1973u + (uint32_t)py * 9277u + (uint32_t)s * 26699u;
+        RandomFloat(c);
+        c->samplerIndex = (uint32_t)s;
+
+        Vec2f uJitter = Sample2D(c, 0);
+        float jx = (uJitter.x - 0.5f) * pixelSizeX;
+        float jy = (uJitter.y - 0.5f) * pixelSizeY;
+        float nx = ((float)px + 0.5f) * pixelSizeX - 1.0f + jx;
+        float ny = ((float)py + 0.5f) * pixelSizeY - 1.0f + jy;
+
+        // invViewProj * vec4(ndc, -1, 1), column-major
+        float wx = m[0]*nx + m[4]*ny - m[8]  + m[12];
+        float wy = m[1]*nx + m[5]*ny - m[9]  + m[13];
+        float wz = m[2]*nx + m[6]*ny - m[10] + m[14];
+        float ww = m[3]*nx + m[7]*ny - m[11] + m[15];
+        Vec3f worldPos = V3(wx / ww, wy / ww, wz / ww);
+
+        Ray3 ray = { camPos, V3Norm(V3Sub(worldPos, camPos)) };
+        Vec3f color = ColorRayIterative(c, ray);
+        double lum = V3Dot(color, V3(0.2126f, 0.7152f, 0.0722f));
+        acc->sum = V3Add(acc->sum, color);
+        acc->lumSum += lum;
+        acc->lumSqSum += lum * lum;
+    }
+    acc->count += count;
+}
+
+// Relative standard error of the pixel means over a tile — sample_budget.glsl
+static float TileError(const PixelAccum *acc, int pixels) {
+    double relVarSum = 0.0;
+    for (int i = 0; i < pixels; i++) {
+        double n = (double)acc[i].count;
+        double mean = acc[i].lumSum / n;
+        double variance = acc[i].lumSqSum / n - mean * mean;
+        if (variance < 0.0) variance = 0.0;
+        variance *= n / (n > 1.0 ? n - 1.0 : 1.0);
+        double denom = mean + ADAPTIVE_LUM_FLOOR;
+        relVarSum += variance / n / (denom * denom);
+    }
+    return (float)sqrt(relVarSum / (double)pixels);
+}
+
+// Fixed rate: every pixel takes samplesPerPixel. Adaptive: rounds of
+// ADAPTIVE_ROUND_SPP, then after ADAPTIVE_WARMUP_FRAMES rounds the tile stops
+// once its error is below the threshold (samplesPerPixel caps the total) and
+// otherwise gets up to twice the round size — the GPU budget pass's rule.
+static void RenderTile(TraceCtx *c, int x0, int y0, int x1, int y1, float *rgbOut) {
+    const CpuTracerSettings *st = c->set;
+    PixelAccum acc[ADAPTIVE_TILE_SIZE * ADAPTIVE_TILE_SIZE];
+    int tw = x1 - x0, pixels = tw * (y1 - y0);
+    int adaptive = st->adaptiveThreshold > 0.0f && tw <= ADAPTIVE_TILE_SIZE && y1 - y0 <= ADAPTIVE_TILE_SIZE;
+
+    if (!adaptive) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                PixelAccum a = {0};
+                TracePixelSamples(c, x, y, 0, st->samplesPerPixel, &a);
+                float inv = 1.0f / (float)a.count;
+                float *out = &rgbOut[(y * st->width + x) * 3];
+                out[0] = a.sum.x * inv;
+                out[1] = a.sum.y * inv;
+                out[2] = a.sum.z * inv;
+            }
+        }
+        return;
+    }
+
+    memset(acc, 0, sizeof(acc));
+    int taken = 0;
+    for (int round = 0; taken < st->samplesPerPixel; round++) {
+        int spp = ADAPTIVE_ROUND_SPP;
+        if (round >= ADAPTIVE_WARMUP_FRAMES) {
+            float tileError = TileError(acc, pixels);
+            if (tileError <= st->adaptiveThreshold) break;
+            float boost = Clampf(sqrtf(tileError / st->adaptiveThreshold), 1.0f, 2.0f);
+            spp = (int)ceilf((float)ADAPTIVE_ROUND_SPP * boost);
+        }
+        if (spp > st->samplesPerPixel - taken) spp = st->samplesPerPixel - taken;
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+                TracePixelSamples(c, x, y, taken, spp, &acc[(y - y0) * tw + (x - x0)]);
+        taken += spp;
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            const PixelAccum *a = &acc[(y - y0) * tw + (x - x0)];
+            float inv = 1.0f / (float)a->count;
+            float *out = &rgbOut[(y * st->width + x) * 3];
+            out[0] = a->sum.x * inv;
+            out[1] = a->sum.y * inv;
+            out[2] = a->sum.z * inv;
+        }
+    }
+}
+
+static void *RenderWorker(void *arg) {
+    RenderJob *job = (RenderJob *)arg;
+    const CpuTracerSettings *st = job->set;
+    TraceCtx ctx = { job->scene, st, 0, 0, 0, 0 };
+
+    for (;;) {
+        int tile = atomic_fetch_add(&job->nextTile, 1);
+        if (tile >= job->tileCount) break;
+        int x0 = (tile % job->tilesX) * job->tileSize;
+        int y0 = (tile / job->tilesX) * job->tileSize;
+        int x1 = x0 + job->tileSize < st->width ? x0 + job->tileSize : st->width;
+        int y1 = y0 + job->tileSize < st->height ? y0 + job->tileSize : st->height;
+        RenderTile(&ctx, x0, y0, x1, y1, job->rgbOut);
+    }
+    return NULL;
+}
+
+int CpuTracerRender(const CpuTracerScene *scene, const CpuTracerSettings *settings, float *rgbOut) {
+    if (!scene || !settings || !rgbOut || !scene->sceneData) return -1;
+    if (settings->width <= 0 || settings->height <= 0 || settings->samplesPerPixel <= 0) return -1;
+
+    int threads = settings->threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+
+    RenderJob job = {0};
+    job.scene = scene;
+    job.set = settings;
+    job.rgbOut = rgbOut;
+    job.tileSize = settings->tileSize > 0 ? settings->tileSize : DEFAULT_TILE_SIZE;
+    if (settings->adaptiveThreshold > 0.0f) job.tileSize = ADAPTIVE_TILE_SIZE;  // budget tiles
+    job.tilesX = (settings->width + job.tileSize - 1) / job.tileSize;
+    job.tileCount = job.tilesX * ((settings->height + job.tileSize - 1) / job.tileSize);
+    atomic_init(&job.nextTile, 0);
+    if (threads > job.tileCount) threads = job.tileCount;
+
+    pthread_t *workers = (pthread_t *)malloc(sizeof(pthread_t) * (size_t)threads);
+    if (!workers) return -1;
+    int started = 0;
+    for (; started < threads; started++)
+        if (pthread_create(&workers[started], NULL, RenderWorker, &job) != 0) break;
+    if (started == 0) RenderWorker(&job); // no threads available: render inline
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    return 0;
+}
+
+int CpuTracerWritePFM(const char *path, const float *rgb, int width, int height) {
+    FILE *f = fopen(path, "wb");
+    if (!f) { printf("ERROR: Could not open %s for writing\n", path); return -1; }
+    // Negative scale = little-endian; rows are stored bottom-to-top like our buffer
+    fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+    size_t n = (size_t)width * (size_t)height * 3;
+    int ok = fwrite(rgb, sizeof(float), n, f) == n;
+    fclose(f);
+    return ok ? 0 : -1;
+}
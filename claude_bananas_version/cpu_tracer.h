@@ -0,0 +1,53 @@
+#ifndef CPU_TRACER_H
+#define CPU_TRACER_H
+
+// Headless CPU backend: a native port of colorRayIterative() from
+// shaders/raytrace.glsl (GGX + NEE/MIS) that reads the exact scene buffers
+// produced by PackSceneData(). Renders on all cores with a tile scheduler,
+// no window or GL context required.
+
+#include "scene_layout.h"
+#include "blue_noise.h"
+
+// Scene inputs — same data the raytrace shader gets as texture + uniforms
+typedef struct CpuTracerScene {
+    const float *geomData;       // MAX_PRIMS rows x GEOM_ROW_FLOATS
+    const float *sceneData;      // SCENE_TEX_HEIGHT rows x SCENE_ROW_FLOATS
+    int primCount;
+    int quadCount;               // rows sorted by type: quads, triangles, then spheres
+    int triangleCount;
+    int lightCount;
+    const float *bvhNodes;       // BvhPack() layout; NULL = brute-force loops
+    int bvhNodeCount;
+    int emitterCount;            // alias-table slots in the EMITTER_ROW_BASE rows
+    const float *envRgb;         // EnvMap (env_map.h) texels: the .hdr or the baked sky;
+                                 // NULL = ENV_HDR_MAP / ENV_PROCEDURAL render black
+    const float *envCdf;         // EnvMap CDFs for environment NEE
+    int envWidth, envHeight;
+    const float *blueNoise;      // BlueNoiseBuild() tile; NULL = Sobol without the per-pixel offset
+} CpuTracerScene;
+
+typedef struct CpuTracerSettings {
+    int width, height;
+    int samplesPerPixel;
+    int threads;                 // <= 0: one per online core
+    int tileSize;                // <= 0: default (16); adaptive forces ADAPTIVE_TILE_SIZE
+    float cameraPosition[3];
+    float invViewProj[16];       // column-major, as uploaded to the shader
+    float kLinear, kQuadratic;
+    float aoRadius, aoStrength;
+    int envMode;                 // ENV_GRADIENT / ENV_HDR_MAP / ENV_PROCEDURAL
+    float envIntensity, envRotation;
+    int lightSampling;           // LIGHT_SAMPLING_ONE / LIGHT_SAMPLING_ALL
+    int samplerMode;             // SAMPLER_SOBOL / SAMPLER_PCG
+    float adaptiveThreshold;     // > 0: per-tile adaptive sampling, samplesPerPixel is the cap
+} CpuTracerSettings;
+
+// Render into rgbOut (width*height*3 floats, linear HDR, bottom row first —
+// same orientation as gl_FragCoord). Returns 0 on success.
+int CpuTracerRender(const CpuTracerScene *scene, const CpuTracerSettings *settings, float *rgbOut);
+
+// Write a linear RGB float image as Portable Float Map (.pfm). Returns 0 on success.
+int CpuTracerWritePFM(const char *path, const float *rgb, int width, int height);
+
+#endif // CPU_TRACER_H
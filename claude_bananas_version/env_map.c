@@ -0,0 +1,210 @@
+// Radiance .hdr loader, baked procedural sky + environment sampling CDFs — see env_map.h
+
+#include "env_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define HDR_LINE_MAX 256
+#define HDR_MAX_DIM 16384
+#define ENV_PI 3.14159265358979f
+
+// RGBE -> linear float (Ward's convention: mantissa + 0.5, exponent bias 128 + 8)
+static void RgbeToFloat(const unsigned char *rgbe, float *out) {
+    if (rgbe[3] == 0) { out[0] = out[1] = out[2] = 0.0f; return; }
+    float f = ldexpf(1.0f, (int)rgbe[3] - (128 + 8));
+    out[0] = ((float)rgbe[0] + 0.5f) * f;
+    out[1] = ((float)rgbe[1] + 0.5f) * f;
+    out[2] = ((float)rgbe[2] + 0.5f) * f;
+}
+
+// One scanline into line (width * 4 bytes, RGBERGBE...).
+// Handles flat scanlines and the adaptive per-channel RLE most files use.
+static int ReadScanline(FILE *f, unsigned char *line, int width) {
+    unsigned char head[4];
+    if (fread(head, 1, 4, f) != 4) return -1;
+    if (width < 8 || width > 0x7fff || head[0] != 2 || head[1] != 2 || (head[2] & 0x80)) {
+        // Flat: the four bytes we read are the first pixel
+        memcpy(line, head, 4);
+        return fread(line + 4, 4, (size_t)width - 1, f) == (size_t)width - 1 ? 0 : -1;
+    }
+    if (((head[2] << 8) | head[3]) != width) return -1;
+
+    // RLE: each channel coded separately, written back interleaved
+    for (int ch = 0; ch < 4; ch++) {
+        int x = 0;
+        while (x < width) {
+            int count = fgetc(f);
+            if (count == EOF) return -1;
+            if (count > 128) {
+                count -= 128;
+                int value = fgetc(f);
+                if (value == EOF || x + count > width) return -1;
+                for (int k = 0; k < count; k++) line[(x++) * 4 + ch] = (unsigned char)value;
+            } else {
+                if (count == 0 || x + count > width) return -1;
+                for (int k = 0; k < count; k++) {
+                    int value = fgetc(f);
+                    if (value == EOF) return -1;
+                    line[(x++) * 4 + ch] = (unsigned char)value;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int EnvMapLoadHDR(EnvMap *env, const char *path) {
+    memset(env, 0, sizeof(*env));
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    // Header: magic line, KEY=VALUE lines, blank line, resolution line
+    char text[HDR_LINE_MAX];
+    if (!fgets(text, sizeof(text), f) || strncmp(text, "#?", 2) != 0) { fclose(f); return -1; }
+    for (;;) {
+        if (!fgets(text, sizeof(text), f)) { fclose(f); return -1; }
+        if (text[0] == '\n' || (text[0] == '\r' && text[1] == '\n')) break;
+        if (strncmp(text, "FORMAT=", 7) == 0 && strncmp(text + 7, "32-bit_rle_rgbe", 15) != 0) {
+            fclose(f); return -1;   // XYZE and friends are not supported
+        }
+    }
+    char ySign;
+    int width, height;
+    if (!fgets(text, sizeof(text), f) ||
+        sscanf(text, "%cY %d +X %d", &ySign, &height, &width) != 3 ||
+        (ySign != '-' && ySign != '+') ||
+        width <= 0 || height <= 0 || width > HDR_MAX_DIM || height > width) {
+        fclose(f);
+        return -1;
+    }
+
+    unsigned char *line = (unsigned char *)malloc((size_t)width * 4);
+    float *rgb = (float *)malloc((size_t)width * height * 3 * sizeof(float));
+    if (!line || !rgb) { free(line); free(rgb); fclose(f); return -1; }
+
+    for (int y = 0; y < height; y++) {
+        if (ReadScanline(f, line, width) != 0) {
+            free(line); free(rgb); fclose(f);
+            return -1;
+        }
+        // -Y files store the top row first; texture row 0 is the bottom
+        int row = (ySign == '-') ? height - 1 - y : y;
+        float *dst = &rgb[(size_t)row * width * 3];
+        for (int x = 0; x < width; x++) RgbeToFloat(&line[x * 4], &dst[x * 3]);
+    }
+    free(line);
+    fclose(f);
+
+    env->width = width;
+    env->height = height;
+    env->rgb = rgb;
+    if (EnvMapBuildCdf(env) != 0) { EnvMapFree(env); return -1; }
+    return 0;
+}
+
+// Golden-hour sky: twilight gradient, warm sun disk + bloom + halo, dark ground
+static void ProceduralSky(const float dir[3], const float sunDir[3], float out[3]) {
+    static const float zenith[3]  = { 0.04f, 0.06f, 0.18f };  // deep navy
+    static const float mid[3]     = { 0.12f, 0.08f, 0.22f };  // dusky purple
+    static const float horizon[3] = { 0.5f, 0.25f, 0.12f };   // burnt orange horizon
+    static const float ground[3]  = { 0.08f, 0.06f, 0.04f };
+    float sunDot = fmaxf(dir[0] * sunDir[0] + dir[1] * sunDir[1] + dir[2] * sunDir[2], 0.0f);
+    float t = fmaxf(dir[1], 0.0f);
+    float a = powf(t, 0.3f), b = powf(t, 0.8f);
+    float sunDisk = powf(sunDot, 512.0f) * 8.0f;
+    float sunHalo = powf(sunDot, 4.0f) * 0.6f;
+    float sunBloom = powf(sunDot, 16.0f) * 1.5f;
+    static const float sunColor[3] = { 1.0f, 0.65f, 0.3f };
+    static const float haloColor[3] = { 1.0f, 0.8f, 0.5f };
+    float g = expf(dir[1] * 6.0f);
+    for (int k = 0; k < 3; k++) {
+        float sky = horizon[k] + (mid[k] - horizon[k]) * a;
+        sky += (zenith[k] - sky) * b;
+        sky += sunColor[k] * (sunDisk + sunBloom) + haloColor[k] * sunHalo;
+        if (dir[1] < 0.0f) sky = ground[k] + (horizon[k] - ground[k]) * g;
+        out[k] = sky;
+    }
+}
+
+int EnvMapBakeSky(EnvMap *env, int width, int height, const float sunDir[3]) {
+    memset(env, 0, sizeof(*env));
+    if (width <= 0 || height <= 0 || height > width) return -1;
+    float len = sqrtf(sunDir[0] * sunDir[0] + sunDir[1] * sunDir[1] + sunDir[2] * sunDir[2]);
+    if (len <= 0.0f) return -1;
+    float sun[3] = { sunDir[0] / len, sunDir[1] / len, sunDir[2] / len };
+
+    float *rgb = (float *)malloc((size_t)width * height * 3 * sizeof(float));
+    if (!rgb) return -1;
+    // Texel centers, inverse of dirToEquirect() at zero rotation
+    for (int y = 0; y < height; y++) {
+        float lat = ((y + 0.5f) / (float)height - 0.5f) * ENV_PI;
+        float cosLat = cosf(lat), sinLat = sinf(lat);
+        for (int x = 0; x < width; x++) {
+            float phi = ((x + 0.5f) / (float)width - 0.5f) * 2.0f * ENV_PI;
+            float dir[3] = { cosLat * cosf(phi), sinLat, cosLat * sinf(phi) };
+            ProceduralSky(dir, sun, &rgb[((size_t)y * width + x) * 3]);
+        }
+    }
+    env->width = width;
+    env->height = height;
+    env->rgb = rgb;
+    if (EnvMapBuildCdf(env) != 0) { EnvMapFree(env); return -1; }
+    return 0;
+}
+
+// Normalize an inclusive running sum in place; an all-zero range becomes uniform
+static void NormalizeCdf(float *cdf, int n, double total) {
+    if (total <= 0.0) {
+        for (int i = 0; i < n; i++) cdf[i] = (float)(i + 1) / (float)n;
+        return;
+    }
+    for (int i = 0; i < n; i++) cdf[i] = (float)(cdf[i] / total);
+    cdf[n - 1] = 1.0f;
+}
+
+int EnvMapBuildCdf(EnvMap *env) {
+    int w = env->width, h = env->height;
+    if (!env->rgb || w <= 0 || h <= 0 || h > w) return -1;
+    free(env->cdf);
+    env->cdf = (float *)malloc((size_t)w * (h + 1) * sizeof(float));
+    if (!env->cdf) return -1;
+
+    // Floor keeps the pdf non-zero under dark texels the bilinear lookup can
+    // still bleed radiance into
+    double lumSum = 0.0;
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        const float *c = &env->rgb[i * 3];
+        lumSum += 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+    }
+    float floorLum = (float)(lumSum / ((double)w * h)) * 1e-3f + 1e-8f;
+
+    float *marginal = &env->cdf[(size_t)h * w];
+    double rowsTotal = 0.0;
+    for (int y = 0; y < h; y++) {
+        float cosLat = cosf(((y + 0.5f) / (float)h - 0.5f) * ENV_PI);
+        const float *src = &env->rgb[(size_t)y * w * 3];
+        float *cdf = &env->cdf[(size_t)y * w];
+        double rowSum = 0.0;
+        for (int x = 0; x < w; x++) {
+            const float *c = &src[x * 3];
+            float lum = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+            rowSum += (double)(lum + floorLum) * cosLat;
+            cdf[x] = (float)rowSum;
+        }
+        NormalizeCdf(cdf, w, rowSum);
+        rowsTotal += rowSum;
+        marginal[y] = (float)rowsTotal;
+    }
+    NormalizeCdf(marginal, h, rowsTotal);
+    for (int x = h; x < w; x++) marginal[x] = 1.0f;
+    return 0;
+}
+
+void EnvMapFree(EnvMap *env) {
+    free(env->rgb);
+    free(env->cdf);
+    memset(env, 0, sizeof(*env));
+}
@@ -0,0 +1,42 @@
+#ifndef ENV_MAP_H
+#define ENV_MAP_H
+
+// Equirectangular HDR environment: Radiance .hdr (RGBE) loader, the baked
+// procedural sky, and the marginal/conditional CDFs used to importance-sample
+// either one for NEE. Uploaded as the envMap / envCdf textures by main_web.c
+// and read directly by cpu_tracer.c.
+//
+// Texel (x, y) covers uv [x/W, (x+1)/W] x [y/H, (y+1)/H] in the convention
+// of dirToEquirect() in raytrace.glsl: row 0 is the bottom (v = 0, looking
+// straight down), so rows are flipped from the file's top-down order.
+//
+// CDF layout: W x (H + 1) floats.
+//   Rows 0..H-1: conditional CDF over columns of that row (inclusive, last = 1)
+//   Row H, cols 0..H-1: marginal CDF over rows (inclusive, last = 1)
+// The marginal row is why loading requires width >= height.
+
+// Baked procedural sky resolution: ~0.35 deg texels, enough for the sun disk
+#define SKY_LUT_WIDTH  1024
+#define SKY_LUT_HEIGHT 512
+
+typedef struct EnvMap {
+    int width, height;
+    float *rgb;     // width * height * 3, linear radiance
+    float *cdf;     // width * (height + 1), see above; NULL until EnvMapBuildCdf
+} EnvMap;
+
+// Stream-decode a .hdr file (flat or RLE scanlines, -Y H +X W / +Y H +X W)
+// and build its CDFs. On failure returns non-zero and leaves env zeroed.
+int EnvMapLoadHDR(EnvMap *env, const char *path);
+
+// Bake the golden-hour procedural sky (sun toward sunDir) into a lat-long
+// table of the given size, CDFs included. envRotation/envIntensity are not
+// baked in — they apply at lookup time exactly as for a loaded map.
+int EnvMapBakeSky(EnvMap *env, int width, int height, const float sunDir[3]);
+
+// (Re)build env->cdf from env->rgb, weighting texels by luminance x cos(latitude)
+int EnvMapBuildCdf(EnvMap *env);
+
+void EnvMapFree(EnvMap *env);
+
+#endif // ENV_MAP_H
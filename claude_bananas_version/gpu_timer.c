@@ -0,0 +1,172 @@
+// Non-blocking GPU pass timing — see gpu_timer.h
+
+#include "gpu_timer.h"
+#include "rlgl.h"
+
+#include <string.h>
+
+#if defined(PLATFORM_WEB)
+#include <GLES3/gl3.h>
+#include <emscripten/html5.h>
+#define GLFN(name) gl##name
+#else
+// Entry points from raylib's bundled GLFW, as in shader_build.c
+typedef void (*GLFWglproc)(void);
+GLFWglproc glfwGetProcAddress(const char *procname);
+
+#if defined(_WIN32) && !defined(APIENTRY)
+#define APIENTRY __stdcall
+#elif !defined(APIENTRY)
+#define APIENTRY
+#endif
+
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef unsigned int GLbitfield;
+typedef int GLint;
+typedef int GLsizei;
+typedef unsigned long long GLuint64;
+typedef struct __GLsync *GLsync;
+
+#define GL_QUERY_RESULT                   0x8866
+#define GL_QUERY_RESULT_AVAILABLE         0x8867
+#define GL_MAJOR_VERSION                  0x821B
+#define GL_MINOR_VERSION                  0x821C
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_ALREADY_SIGNALED               0x911A
+#define GL_CONDITION_SATISFIED            0x911C
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+
+#define GL_ENTRY_POINTS(X) \
+    X(void, GenQueries, (GLsizei n, GLuint *ids)) \
+    X(void, DeleteQueries, (GLsizei n, const GLuint *ids)) \
+    X(void, BeginQuery, (GLenum target, GLuint id)) \
+    X(void, EndQuery, (GLenum target)) \
+    X(void, GetQueryObjectuiv, (GLuint id, GLenum pname, GLuint *params)) \
+    X(GLsync, FenceSync, (GLenum condition, GLbitfield flags)) \
+    X(GLenum, ClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout)) \
+    X(void, DeleteSync, (GLsync sync)) \
+    X(void, GetIntegerv, (GLenum pname, GLint *data)) \
+    X(void, Flush, (void))
+
+#define GL_DECLARE(ret, name, args) ret (APIENTRY *name) args;
+static struct { GL_ENTRY_POINTS(GL_DECLARE) } gl;
+#undef GL_DECLARE
+#define GLFN(name) gl.name
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF            // GL_TIME_ELAPSED_EXT
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+void GpuTimerInit(GpuTimer *t) {
+    memset(t, 0, sizeof(*t));
+#if defined(PLATFORM_WEB)
+    t->queries = emscripten_webgl_enable_extension(emscripten_webgl_get_current_context(),
+                                                   "EXT_disjoint_timer_query_webgl2");
+#else
+#define GL_LOAD(ret, name, args) gl.name = (ret (APIENTRY *) args)glfwGetProcAddress("gl" #name);
+    GL_ENTRY_POINTS(GL_LOAD)
+#undef GL_LOAD
+    GLint major = 0, minor = 0;   // GL_TIME_ELAPSED is core from 3.3
+    if (gl.GetIntegerv) {
+        gl.GetIntegerv(GL_MAJOR_VERSION, &major);
+        gl.GetIntegerv(GL_MINOR_VERSION, &minor);
+    }
+    t->queries = (major > 3 || (major == 3 && minor >= 3)) && gl.GenQueries && gl.BeginQuery &&
+                 gl.EndQuery && gl.GetQueryObjectuiv && gl.DeleteQueries;
+#endif
+    if (t->queries) {
+        for (int i = 0; i < GPU_TIMER_RING; i++) GLFN(GenQueries)(1, &t->slots[i].query);
+    }
+}
+
+bool GpuTimerBegin(GpuTimer *t) {
+    if (t->running || t->count == GPU_TIMER_RING) return false;
+#if !defined(PLATFORM_WEB)
+    if (!t->queries && !gl.FenceSync) return false;   // pre-3.2 context: nothing to time with
+#endif
+    rlDrawRenderBatchActive();
+    GpuTimerSlot *slot = &t->slots[(t->head + t->count) % GPU_TIMER_RING];
+    if (t->queries) GLFN(BeginQuery)(GL_TIME_ELAPSED, slot->query);
+    t->running = true;
+    return true;
+}
+
+void GpuTimerEnd(GpuTimer *t, double work) {
+    if (!t->running) return;
+    rlDrawRenderBatchActive();
+    GpuTimerSlot *slot = &t->slots[(t->head + t->count) % GPU_TIMER_RING];
+    if (t->queries) {
+        GLFN(EndQuery)(GL_TIME_ELAPSED);
+    } else {
+        slot->fence = (void *)GLFN(FenceSync)(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        GLFN(Flush)();   // so the fence reaches the GPU before the first poll
+        slot->frame = t->frame;
+        slot->reported = false;
+    }
+    slot->work = work;
+    t->running = false;
+    t->count++;
+}
+
+// Fence polls that may still see a pass signaled "under a frame": the one in
+// its own frame (desktop drivers) and the next frame's (WebGL2, which signals
+// between tasks at the earliest). Unsignaled at a later poll = over a frame.
+#define FENCE_FIRST_POLLS 2
+
+bool GpuTimerPoll(GpuTimer *t, double *ms, double *work, GpuTimeKind *kind) {
+    t->frame++;
+    if (t->count == 0) return false;
+    GpuTimerSlot *slot = &t->slots[t->head];
+    if (t->queries) {
+        GLuint available = 0;
+        GLFN(GetQueryObjectuiv)(slot->query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+        GLuint ns = 0;   // 32 bits: passes up to 4.2 s
+        GLFN(GetQueryObjectuiv)(slot->query, GL_QUERY_RESULT, &ns);
+        t->head = (t->head + 1) % GPU_TIMER_RING;
+        t->count--;
+#if defined(PLATFORM_WEB)
+        GLint disjoint = 0;   // reading it also clears it
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        if (disjoint) {
+            t->head = (t->head + t->count) % GPU_TIMER_RING;   // drop everything in flight
+            t->count = 0;
+            return false;
+        }
+#endif
+        *ms = ns * 1e-6;
+        *kind = GPU_TIME_MEASURED;
+    } else {
+        int age = t->frame - slot->frame;   // 1 = polled in the pass's own frame
+        GLenum status = GLFN(ClientWaitSync)((GLsync)slot->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            if (age <= FENCE_FIRST_POLLS || slot->reported) return false;
+            slot->reported = true;   // keep the fence until it signals, report now
+            *kind = GPU_TIME_OVER_FRAME;
+            *work = slot->work;
+            return true;
+        }
+        GLFN(DeleteSync)((GLsync)slot->fence);
+        slot->fence = NULL;
+        t->head = (t->head + 1) % GPU_TIMER_RING;
+        t->count--;
+        if (slot->reported || age > FENCE_FIRST_POLLS) return false;
+        *kind = GPU_TIME_UNDER_FRAME;
+    }
+    *work = slot->work;
+    return true;
+}
+
+void GpuTimerUnload(GpuTimer *t) {
+    for (int i = 0; i < GPU_TIMER_RING; i++) {
+        GpuTimerSlot *slot = &t->slots[i];
+        if (slot->query) GLFN(DeleteQueries)(1, &slot->query);
+        if (slot->fence) GLFN(DeleteSync)((GLsync)slot->fence);
+    }
+    memset(t, 0, sizeof(*t));
+}
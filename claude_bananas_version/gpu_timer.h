@@ -0,0 +1,60 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+// Non-blocking GPU pass timing for the frame-time controller. A pass is
+// bracketed with GL_TIME_ELAPSED queries (desktop GL 3.3, WebGL2 with
+// EXT_disjoint_timer_query_webgl2) and its result is read a few frames later,
+// once the driver reports it available, so nothing ever waits on the GPU.
+// Without timer queries a fence sync after the pass is polled instead. WebGL2
+// only signals it once control has gone back to the browser, so all it can
+// tell is whether the pass finished by the first poll that could see it or was
+// still running two frames later: a bound, not a time.
+
+#include <stdbool.h>
+
+#define GPU_TIMER_RING 4   // passes in flight at once
+
+typedef enum GpuTimeKind {
+    GPU_TIME_MEASURED = 0,    // ms is the pass's GPU time
+    GPU_TIME_UNDER_FRAME,     // fence: done by the first poll that could see it
+    GPU_TIME_OVER_FRAME,      // fence: still running two frames after the pass
+} GpuTimeKind;
+
+typedef struct GpuTimerSlot {
+    unsigned int query;    // timer query object (0 in fence mode)
+    void *fence;           // GLsync (fence mode)
+    int frame;             // GpuTimerPoll calls before GpuTimerEnd (fence mode)
+    bool reported;         // OVER_FRAME already returned; retire silently (fence mode)
+    double work;           // caller's units, handed back with the result
+} GpuTimerSlot;
+
+typedef struct GpuTimer {
+    bool queries;          // timer queries available; false = fence fallback
+    bool running;          // between Begin and End
+    int frame;             // GpuTimerPoll calls so far
+    GpuTimerSlot slots[GPU_TIMER_RING];
+    int head, count;       // oldest pending slot, slots pending
+} GpuTimer;
+
+// Once after InitWindow
+void GpuTimerInit(GpuTimer *t);
+
+// Start timing the GL work queued from now on (raylib's batch is flushed
+// first). False when GPU_TIMER_RING passes are still in flight: skip timing.
+bool GpuTimerBegin(GpuTimer *t);
+
+// End the pass started by a successful GpuTimerBegin; `work` comes back with
+// its time (e.g. the samples it traced)
+void GpuTimerEnd(GpuTimer *t, double work);
+
+// Once per frame, after any GpuTimerEnd of that frame: the oldest pass with
+// something to report, if any, and its work. With timer queries `ms` is its
+// GPU time (results spoiled by a disjoint event, WebGL: GPU reset or clock
+// change, are dropped); with fences `kind` bounds it by the frame interval and
+// `ms` is not set. A fence signaled on the second frame after the pass says
+// neither and is retired without a result.
+bool GpuTimerPoll(GpuTimer *t, double *ms, double *work, GpuTimeKind *kind);
+
+void GpuTimerUnload(GpuTimer *t);
+
+#endif // GPU_TIMER_H
@@ -69,7 +69,7 @@ static void Init(void) {
     float res[2] = {(float)W, (float)H};
     SetShaderValue(g.shader, g.locRes, res, SHADER_UNIFORM_VEC2);
 
-    g.displayShader = LoadVer("../display.glsl");
+    g.displayShader = LoadVer("shaders/display_combined.glsl");
     g.locDispToneMap  = GetShaderLocation(g.displayShader, "toneMapMode");
     g.locDispExposure = GetShaderLocation(g.displayShader, "exposure");
     g.toneMapMode = 3; g.exposure = 0.0f;
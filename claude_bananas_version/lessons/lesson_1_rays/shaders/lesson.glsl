@@ -44,6 +44,8 @@
 precision highp float;
 #endif
 
+#include "viz_primitives.glsl"   // shaders/lib, bundled by the Makefile
+
 #define EPSILON 0.001
 #define PI 3.14159265359
 
@@ -19,6 +19,8 @@
 precision highp float;
 #endif
 
+#include "viz_primitives.glsl"   // shaders/lib, bundled by the Makefile
+
 #define EPSILON 0.001
 
 in vec2 fragTexCoord;
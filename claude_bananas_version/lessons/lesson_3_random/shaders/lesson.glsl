@@ -21,6 +21,8 @@
 precision highp float;
 #endif
 
+#include "viz_primitives.glsl"   // shaders/lib, bundled by the Makefile
+
 in vec2 fragTexCoord;
 out vec4 finalColor;
 
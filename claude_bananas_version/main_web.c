@@ -6,25 +6,95 @@
 #include <emscripten/emscripten.h>
 #endif
 
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+#include "scene_layout.h"
+#include "bvh.h"
+#include "env_map.h"
+#include "blue_noise.h"
+#include "shader_build.h"
+#include "shader_embed.h"
+#include "gpu_timer.h"
+#if !defined(PLATFORM_WEB)
+#include <time.h>
+#include "cpu_tracer.h"
+#endif
+
 #define SCREEN_WIDTH 1280
 #define SCREEN_HEIGHT 720
-#define MAX_PRIMS 64
-#define MAX_LIGHTS 8
 
-// Must match shader defines — 8-wide horizontal layout
-#define SCENE_TEX_WIDTH 8
-#define LIGHT_ROW_BASE MAX_PRIMS   // lights start at row 64
-#define SCENE_TEX_HEIGHT (MAX_PRIMS + MAX_LIGHTS) // 72 rows
-
-// Primitive types
-#define PRIM_SPHERE   0
-#define PRIM_QUAD     1
-#define PRIM_TRIANGLE 2
+// raylib's batch owns texture units 0-4 (texture0 + four SetShaderValueTexture
+// slots, all taken by sceneData/bvhData/envMap/accumTexture); the env CDF, the
+// sampler's blue-noise tile, the adaptive-sampling inputs, the G-buffer and the
+// geometry texture are bound by hand on the next ones
+#define ENV_CDF_TEXTURE_UNIT 5
+#define BLUE_NOISE_TEXTURE_UNIT 6
+#define MOMENTS_TEXTURE_UNIT 7
+#define SAMPLE_BUDGET_TEXTURE_UNIT 8
+#define GBUFFER_TEXTURE_UNIT 9
+#define GEOMETRY_TEXTURE_UNIT 10
+
+#define BUDGET_TILES_X ((SCREEN_WIDTH + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE)
+#define BUDGET_TILES_Y ((SCREEN_HEIGHT + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE)
+
+// Convergence: the budget target is read back every CONVERGENCE_CHECK_INTERVAL
+// frames after warm-up; once converged the loop only polls input and redraws
+// the display pass, at CONVERGED_IDLE_FPS
+#define CONVERGENCE_CHECK_INTERVAL 16
+#define CONVERGENCE_DEFAULT_THRESHOLD 0.01f  // relative standard error over the image
+#define CONVERGED_IDLE_FPS 20                // loop rate while converged
+
+// Dynamic resolution: scale of the raytrace pass while the user interacts
+#define INTERACTION_DEFAULT_SCALE 0.5f
+#define WHEEL_INTERACTION_HOLD 0.25          // seconds a zoom step counts as interaction
+
+// Frame-time controller: every SPP_TIMING_INTERVAL frames the raytrace pass is
+// timed on the GPU (gpu_timer.h; the result arrives a few frames later) and
+// samplesPerFrame is steered to keep it inside the frame budget
+#define SPP_TIMING_INTERVAL 4
+#define FRAME_TIME_DEFAULT_TARGET 16.6f      // ms
+#define FRAME_TIME_TRACE_SHARE 0.85f         // rest: raster prepass, budget, upsample, display
+#define SPP_HYSTERESIS_HIGH 1.10f            // trace time above budget * this: drop spp
+#define SPP_HYSTERESIS_LOW 0.80f             // below budget * this: raise spp
+#define SPP_MAX_STEP_UP 1.25f                // raises are gradual, drops immediate
+#define SAMPLE_RATE_WINDOW 1.0               // seconds per samples/sec measurement
+#define FENCE_RAISE_STREAK 2                 // fence fallback: fast passes in a row before a raise
+
+// Progressive tiles: with tiledRender on, each accumulation step is traced as
+// TRACE_TILE_SIZE scissored tiles spread over as many frames as the frame
+// budget needs, so heavy SPP never blocks input
+#define TRACE_TILE_SIZE 128
+#define MAX_TRACE_TILES (((SCREEN_WIDTH + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE) * \
+                         ((SCREEN_HEIGHT + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE))
+
+// Raytrace shader variants: scene and settings features are baked into
+// raytrace.glsl as #defines, so code the scene cannot reach (quad tests in a
+// spheres-only scene, AO, explicit lights, emitter NEE, the env table) is
+// compiled out. Variants are compiled on first use and cached by feature mask.
+#define RT_FEATURE_SPHERES   (1u << 0)
+#define RT_FEATURE_QUADS     (1u << 1)
+#define RT_FEATURE_TRIANGLES (1u << 2)
+#define RT_FEATURE_AO        (1u << 3)
+#define RT_FEATURE_LIGHTS    (1u << 4)
+#define RT_FEATURE_EMITTERS  (1u << 5)
+#define RT_FEATURE_ENV_MAP   (1u << 6)   // HDR map or baked sky (lat-long table)
+#define RT_VARIANT_CACHE_SIZE 8
+// Desktop program binary cache (shader_build.c), relative to the working directory
+#define SHADER_CACHE_DIR "shader_cache"
+// Frozen scene: the generated GLSL (literal rows + unrolled hit tests) is about
+// 1 KB per primitive, so MAX_PRIMS fits with room for lights and emitters
+#define FROZEN_GLSL_BYTES (128 * 1024)
+
+typedef struct ShaderVariant {
+    unsigned int features;
+    Shader shader;
+    unsigned int lastUsed;   // rtVariantClock at the last switch, for eviction
+} ShaderVariant;
 
 // Materials: 0 = Lambertian, 1 = Metal, 2 = Emissive, 3 = Dielectric
 typedef struct Primitive {
@@ -53,31 +123,161 @@ typedef struct Light {
 #define SCENE_MATERIALS 2
 #define NUM_SCENES      3
 
+// Pending scene/settings edit. Setters write the field right away (so getters
+// stay current) and queue the GPU-side work; FlushEdits applies the queue once
+// per frame with a single upload and a single accumulation reset.
+typedef enum EditKind {
+    EDIT_PRIM_DATA,        // material/emission fields of prim `index`
+    EDIT_PRIM_GEOMETRY,    // prim `index` moved or resized
+    EDIT_PRIM_ADDED,       // prim `index` appended
+    EDIT_PRIM_REMOVED,     // prim `index` deleted, prim `aux` moved into its slot
+    EDIT_LIGHT,            // light `index`
+    EDIT_RENDER_SETTINGS,  // AO, tone mapping, exposure, SPP, environment
+    EDIT_SCENE_RELOAD,     // whole scene replaced
+} EditKind;
+
+typedef struct SceneEdit {
+    EditKind kind;
+    int index, aux;
+} SceneEdit;
+
+#define EDIT_QUEUE_SIZE 256   // overflow collapses into one EDIT_SCENE_RELOAD
+
+// Fixed-layout snapshot of everything the web UI displays. shell.html calls
+// GetUIState() once per refresh and reads it through HEAP32/HEAPF32 views;
+// `generation` changes whenever the contents do. Every field is 4 bytes and
+// the header carries word offsets/strides, so JS never hardcodes sizeof().
+// Telemetry (FPS, samples/sec, trace time) changes every frame and is not part
+// of it: JS reads it through its getters, outside the generation check.
+#define UI_STATE_VERSION 2
+
+typedef struct UIPrimState {
+    int primType, material;
+    int color[3];                   // 0-255
+    float emission[3], emissionStrength;
+    float ior, roughness, specular, shininess;
+    float center[3], radius;        // radius as used for picking
+} UIPrimState;
+
+typedef struct UILightState {
+    int type;
+    float direction[3], position[3], color[3];
+    float intensity, radius;
+} UILightState;
+
+typedef struct UIState {
+    int version, generation, sizeBytes;
+    int primOffset, primStride, lightOffset, lightStride;   // in 4-byte words
+    int primCount, lightCount, selected, currentScene;
+    int toneMapMode, samplesPerFrame, uncapFPS, envMode;
+    float aoStrength, aoRadius, exposure, envIntensity, envRotation;
+    int lightSampling;
+    float sunDirection[3];
+    int samplerMode;
+    int adaptiveSampling;
+    float adaptiveThreshold;
+    float convergenceThreshold;
+    int converged;
+    float convergenceError, timeToConverge;   // -1 = not measured / not converged
+    int accumMode;
+    int reprojection;
+    float interactionScale;
+    int autoSPP;
+    float frameTimeTarget;
+    int tiledRender;
+    int sceneFrozen;
+    UIPrimState prims[MAX_PRIMS];
+    UILightState lights[MAX_LIGHTS];
+} UIState;
+
+// One resolution's ping-pong accumulation: color (per accumMode), luminance
+// moments and first-hit G-buffer as the MRT attachments of each FBO
+typedef struct AccumTargets {
+    int width, height;
+    int mode;                 // accumMode the color targets were created for
+    RenderTexture2D color[2];
+    Texture2D moments[2];     // RGBA32F second target
+    Texture2D gbuffer[2];     // RGBA32F third target: first-hit position + normal
+    RenderTexture2D visibility;   // RGBA32F + depth: visibility.glsl pre-pass of the current step
+    int index;                // target holding the latest frame
+    int epoch;                // historyEpoch when last traced; older = history is stale
+    Matrix viewProj;          // view-projection it was last traced with
+} AccumTargets;
+
 typedef struct AppState {
     Camera3D camera;
-    Shader shader;
+    Shader shader;       // current raytrace variant, owned by rtVariants
+    ShaderVariant rtVariants[RT_VARIANT_CACHE_SIZE];
+    int rtVariantCount;
+    unsigned int rtFeatures;     // feature mask of g.shader
+    unsigned int rtVariantClock;
+    Shader frozenShader;         // FreezeScene program; g.shader while sceneFrozen
+    bool sceneFrozen;
+    int freezeScene;             // requested state (JS / --freeze), applied after FlushEdits
+    ShaderBuild rtBuild;         // raytrace program compiling in the background
+    unsigned int rtBuildFeatures;
+    bool rtBuildFrozen;          // rtBuild is the FreezeScene program
+    Shader previewShader;        // drawn while there is no raytrace program yet
     Shader displayShader;
-    RenderTexture2D targetTexture;
+    Shader budgetShader;
+    Shader upsampleShader;
+    Shader visibilityShader;
     // Raytrace shader locations
-    int locTime, locPrimCount, locLightCount, locEmissiveCount, locEmissiveIndices, locSPP;
+    int locTime, locPrimCount, locLightCount, locEmissiveCount, locSPP;
     int camPosLoc, invVpLoc;
     int locKLinear, locKQuadratic;
     int locAORadius, locAOStrength;
     int locFrameCount, locAccumTexture, locResolution, locSceneData;
+    int locBvhData, locBvhNodeCount, locLightSampling;
+    int locSamplerMode, locBlueNoise;
+    int locMomentsTexture, locSampleBudget, locAdaptiveSampling, locAccumMode;
+    int locGBufferTexture, locPrevViewProj, locReprojectFrame, locGBufferOnly, locUseVisibility;
+    int locGeomData, locQuadCount, locTriangleCount;
+    // Visibility shader locations
+    int locVisGeomData, locVisCamPos, locVisInvViewProj, locVisResolution;
+    // Preview shader locations
+    int locPreviewGeomData, locPreviewSceneData, locPreviewCamPos, locPreviewInvViewProj, locPreviewResolution;
+    // Upsample shader locations
+    int locUpsampleLowGBuffer, locUpsampleGuide, locUpsampleCamPos;
+    // Sample budget shader locations
+    int locBudgetSPP, locBudgetThreshold;
     // Display shader locations
     int locDisplayToneMap, locDisplayExposure;
     // Environment map
     int locEnvMap, locUseEnvMap, locEnvIntensity, locEnvRotation;
-    Texture2D envMapTex;
+    int locEnvCdf, locEnvSize;
+    // The loaded .hdr and the baked procedural sky take turns on the
+    // envMap/envCdf samplers, picked by useEnvMap each frame
+    Texture2D envMapTex;  // loaded .hdr, RGBA16F (filterable on WebGL2)
+    Texture2D envCdfTex;  // its sampling CDFs, R32F (env_map.h layout)
+    Texture2D skyMapTex;  // baked procedural sky, same formats
+    Texture2D skyCdfTex;
+    Vector3 sunDirection; // procedural sky sun (toward the sun)
+    bool skyDirty;        // sky table must be re-baked before next use
+    Texture2D blueNoiseTex; // blue_noise.h rank tile, R32F, sampled with texelFetch
     int useEnvMap;       // 0=gradient, 1=HDR texture, 2=procedural sky
     float envIntensity;
     float envRotation;
-    // Scene data texture
+    // Scene data: geometry (traversal) and material/light/emitter textures
+    Texture2D geomDataTex;
+    float geomDataBuf[MAX_PRIMS * GEOM_ROW_FLOATS];
     Texture2D sceneDataTex;
     float sceneDataBuf[SCENE_TEX_HEIGHT * SCENE_TEX_WIDTH * 4];
+    unsigned char sceneRowDirty[SCENE_TEX_HEIGHT]; // rows to repack + sub-upload (prim rows: both textures)
+    int emitterCount;    // alias-table slots in the emitter rows
+    // BVH over primitives + its node texture
+    Bvh bvh;
+    Texture2D bvhDataTex;
+    float bvhDataBuf[BVH_MAX_NODES * BVH_ROW_FLOATS];
     // Scene
     Primitive prims[MAX_PRIMS];
     int primCount;
+    // Packed rows are sorted by type; the editor, selectedSphere and the JS
+    // API keep using prims[] indices
+    int primRow[MAX_PRIMS];   // prims[] index -> packed row
+    int rowPrim[MAX_PRIMS];   // packed row -> prims[] index
+    int packedPrimCount;      // primCount at the last RemapPrims()
+    int quadCount, triangleCount;
     Light lights[MAX_LIGHTS];
     int lightCount;
     int selectedSphere; // selected prim index
@@ -89,16 +289,67 @@ typedef struct AppState {
     // Rendering
     float aoRadius, aoStrength, exposure;
     int toneMapMode, samplesPerFrame, uncapFPS;
-    // Accumulation
-    RenderTexture2D accumTexture[2];
-    int accumIndex, frameCount;
+    int lightSampling;   // LIGHT_SAMPLING_ONE, or LIGHT_SAMPLING_ALL as a reference
+    int samplerMode;     // SAMPLER_SOBOL, or SAMPLER_PCG as a fallback
+    int adaptiveSampling;     // per-tile spp from the noise estimate after warm-up
+    float adaptiveThreshold;  // relative error at which a tile stops tracing
+    float convergenceThreshold; // relative error at which the whole image stops; 0 = never
+    // Accumulation: full resolution, plus a reduced one traced while the user
+    // orbits, zooms or drags (interactionScale < 1) and upsampled for display
+    int accumMode;          // ACCUM_SUM_FLOAT, or ACCUM_BLEND_HALF (half the memory)
+    AccumTargets full, scaled;
+    AccumTargets *active;           // set of the current (or last) step
+    int historyEpoch;               // bumped by every edit reset
+    float interactionScale;         // 1 = always full resolution
+    double lastWheelTime;
+    RenderTexture2D guideTarget;    // RGBA32F full-resolution first hits while scaled
+    RenderTexture2D upscaleTarget;  // RGBA16F upsampled scaled image, displayed while scaled
+    RenderTexture2D budgetTarget;   // one texel per ADAPTIVE_TILE_SIZE tile: spp / 255
+    int frameCount;
     Vector3 prevCamPos;
+    int reprojection;         // camera motion reprojects history instead of resetting it
+    // Frame-time controller (UpdateSampleRate)
+    int autoSPP;              // samplesPerFrame follows the frame budget instead of the slider
+    float frameTimeTarget;    // ms per frame
+    float traceTimeMs;        // last timed raytrace pass; -1 = not measured
+    double sampleCost;        // smoothed ms per sample per pixel; 0 = not measured
+    int timingFrame;
+    int fenceFastStreak;      // fence fallback: consecutive passes done within a frame
+    GpuTimer traceTimer;
+    double sampleWindowStart, sampleWindowCount;
+    float samplesPerSecond;   // over the last SAMPLE_RATE_WINDOW, at samplesPerFrame per traced pixel
+    // Progressive tiles
+    int tiledRender;          // split each accumulation step over several frames
+    int tileOrder[MAX_TRACE_TILES];   // BuildTileOrder: centre first
+    int tileCount, tilesDone; // of the current step; done == count when none is in progress
+    Matrix stepViewProj;      // view-projection the current step traces with
+    bool visibilityValid;     // the step's pre-pass can stand in for primary hits
+    AccumTargets *shownSet;   // set of the last completed step
+    // Convergence of the current accumulation (CheckConvergence)
+    bool converged;
+    bool idlePacing;          // loop slowed to CONVERGED_IDLE_FPS (SetIdlePacing)
+    float convergenceError;   // sqrt of the image's mean relative variance; -1 = not measured
+    double convergeStartTime; // GetTime() at the last accumulation reset
+    float timeToConverge;     // seconds from reset to convergence; -1 while tracing
+    int framesToConverge;
+    // Edits queued since the last FlushEdits
+    SceneEdit edits[EDIT_QUEUE_SIZE];
+    int editCount;
+    // UI state view (refreshed lazily by GetUIState)
+    UIState ui;
+    bool uiDirty;
 } AppState;
 
 static AppState g;
 
 // Forward declarations
 static void UpdateCameraFromAngles(void);
+static void LoadAccumTargets(AccumTargets *t, int width, int height);
+static void UnloadAccumTargets(AccumTargets *t);
+static void BakeSky(void);
+static bool ActiveEnvMap(Texture2D *mapTex, Texture2D *cdfTex);
+static char *LoadShaderSource(const char *path, const char *defines, const char *appendix);
+static Shader LoadShaderWithVersion(const char *path, const char *defines, const char *appendix);
 
 // ============================================================
 // Primitive constructors
@@ -341,130 +592,374 @@ static void LoadCornellBoxScene(void) {
     g.cameraAngleV = 0.15f;
 }
 
+// Replace prims/lights/camera with a preset and pick its environment
+static void LoadScenePreset(int scene) {
+    g.currentScene = scene;
+    memset(g.prims, 0, sizeof(g.prims));
+    memset(g.lights, 0, sizeof(g.lights));
+    if (scene == SCENE_CORNELL) {
+        LoadCornellBoxScene();
+        g.useEnvMap = 0; // gradient for enclosed scene
+    } else {
+        LoadDefaultScene();
+        g.useEnvMap = 2; // procedural sky
+    }
+}
+
 // ============================================================
 // Scene data packing
 // ============================================================
 
-static void PackSceneData(void) {
-    memset(g.sceneDataBuf, 0, sizeof(g.sceneDataBuf));
+// Sort the packed rows into contiguous quad, triangle and sphere ranges, so
+// the shader knows a row's type from quadCount/triangleCount alone. Spheres
+// go last: adding one (all the editor adds) appends a row.
+static void RemapPrims(void) {
+    static const int order[3] = { PRIM_QUAD, PRIM_TRIANGLE, PRIM_SPHERE };
+    int row = 0;
+    for (int t = 0; t < 3; t++) {
+        int start = row;
+        for (int i = 0; i < g.primCount; i++) {
+            if (g.prims[i].primType != order[t]) continue;
+            g.primRow[i] = row;
+            g.rowPrim[row++] = i;
+        }
+        if (order[t] == PRIM_QUAD) g.quadCount = row - start;
+        else if (order[t] == PRIM_TRIANGLE) g.triangleCount = row - start;
+    }
+    g.packedPrimCount = g.primCount;
+}
 
-    // Row stride = SCENE_TEX_WIDTH * 4 floats = 32 floats per row
-    const int rowStride = SCENE_TEX_WIDTH * 4;
+// Geometry row r: GEOM_ROW_FLOATS = 12 floats, the type folded into geom0.w
+// (layout in scene_layout.h). Rows past primCount are packed as zeros.
+static void PackGeomRow(int r) {
+    float *row = &g.geomDataBuf[r * GEOM_ROW_FLOATS];
+    memset(row, 0, GEOM_ROW_FLOATS * sizeof(float));
+    if (r >= g.primCount) return;
+    const Primitive *p = &g.prims[g.rowPrim[r]];
+    memcpy(row, p->geom, GEOM_ROW_FLOATS * sizeof(float));
+    if (p->primType == PRIM_QUAD) row[3] = GEOM_TAG_QUAD;
+    else if (p->primType == PRIM_TRIANGLE) row[3] = GEOM_TAG_TRIANGLE;
+    row[7] = row[11] = 0.0f;
+}
 
-    for (int i = 0; i < g.primCount; i++) {
-        float *row = &g.sceneDataBuf[i * rowStride];
-        // Col 0: primType
-        row[0] = (float)g.prims[i].primType;
-        // Col 1: color.rgb, material
-        row[4] = (float)g.prims[i].color.r / 255.0f;
-        row[5] = (float)g.prims[i].color.g / 255.0f;
-        row[6] = (float)g.prims[i].color.b / 255.0f;
-        row[7] = (float)g.prims[i].material;
-        // Col 2: emission.rgb, emStr
-        row[8]  = g.prims[i].emission.x;
-        row[9]  = g.prims[i].emission.y;
-        row[10] = g.prims[i].emission.z;
-        row[11] = g.prims[i].emissionStrength;
-        // Col 3: ior, roughness, specular, shininess
-        row[12] = g.prims[i].ior;
-        row[13] = g.prims[i].roughness;
-        row[14] = g.prims[i].specular;
-        row[15] = g.prims[i].shininess;
-        // Col 4-6: geometry (copy 12 floats = 3 vec4s)
-        memcpy(&row[16], g.prims[i].geom, 12 * sizeof(float));
-
-        // Col 7: bounding sphere [center.xyz, radius]
-        float *bs = &row[28];
-        int pt = g.prims[i].primType;
-        float *gm = g.prims[i].geom;
-        if (pt == PRIM_SPHERE) {
-            bs[0] = gm[0]; bs[1] = gm[1]; bs[2] = gm[2]; bs[3] = gm[3];
-        } else if (pt == PRIM_QUAD) {
-            // center = Q + 0.5*(u+v), radius = 0.5 * max(|u+v|, |u-v|)
-            float ux = gm[4], uy = gm[5], uz = gm[6];
-            float vx = gm[8], vy = gm[9], vz = gm[10];
-            bs[0] = gm[0] + 0.5f*(ux+vx);
-            bs[1] = gm[1] + 0.5f*(uy+vy);
-            bs[2] = gm[2] + 0.5f*(uz+vz);
-            float d1x=ux+vx, d1y=uy+vy, d1z=uz+vz;
-            float d2x=ux-vx, d2y=uy-vy, d2z=uz-vz;
-            float len1 = sqrtf(d1x*d1x + d1y*d1y + d1z*d1z);
-            float len2 = sqrtf(d2x*d2x + d2y*d2y + d2z*d2z);
-            bs[3] = 0.5f * fmaxf(len1, len2);
-        } else if (pt == PRIM_TRIANGLE) {
-            float cx = (gm[0]+gm[4]+gm[8])/3.0f;
-            float cy = (gm[1]+gm[5]+gm[9])/3.0f;
-            float cz = (gm[2]+gm[6]+gm[10])/3.0f;
-            float r = 0.0f;
-            for (int k = 0; k < 3; k++) {
-                float dx = gm[k*4]-cx, dy = gm[k*4+1]-cy, dz = gm[k*4+2]-cz;
-                float d = sqrtf(dx*dx+dy*dy+dz*dz);
-                if (d > r) r = d;
-            }
-            bs[0] = cx; bs[1] = cy; bs[2] = cz; bs[3] = r;
+// Material row stride = SCENE_TEX_WIDTH * 4 floats = 16 floats per row.
+// Rows past primCount / lightCount are packed as zeros.
+static void PackPrimRow(int r) {
+    PackGeomRow(r);
+    float *row = &g.sceneDataBuf[r * SCENE_ROW_FLOATS];
+    memset(row, 0, SCENE_ROW_FLOATS * sizeof(float));
+    if (r >= g.primCount) return;
+    int i = g.rowPrim[r];
+    // Col 0: color.rgb, material
+    row[0] = (float)g.prims[i].color.r / 255.0f;
+    row[1] = (float)g.prims[i].color.g / 255.0f;
+    row[2] = (float)g.prims[i].color.b / 255.0f;
+    row[3] = (float)g.prims[i].material;
+    // Col 1: emission.rgb, emStr
+    row[4] = g.prims[i].emission.x;
+    row[5] = g.prims[i].emission.y;
+    row[6] = g.prims[i].emission.z;
+    row[7] = g.prims[i].emissionStrength;
+    // Col 2: ior, roughness, specular, shininess
+    row[8]  = g.prims[i].ior;
+    row[9]  = g.prims[i].roughness;
+    row[10] = g.prims[i].specular;
+    row[11] = g.prims[i].shininess;
+
+    // Col 3: bounding sphere [center.xyz, radius]
+    float *bs = &row[12];
+    int pt = g.prims[i].primType;
+    float *gm = g.prims[i].geom;
+    if (pt == PRIM_SPHERE) {
+        bs[0] = gm[0]; bs[1] = gm[1]; bs[2] = gm[2]; bs[3] = gm[3];
+    } else if (pt == PRIM_QUAD) {
+        // center = Q + 0.5*(u+v), radius = 0.5 * max(|u+v|, |u-v|)
+        float ux = gm[4], uy = gm[5], uz = gm[6];
+        float vx = gm[8], vy = gm[9], vz = gm[10];
+        bs[0] = gm[0] + 0.5f*(ux+vx);
+        bs[1] = gm[1] + 0.5f*(uy+vy);
+        bs[2] = gm[2] + 0.5f*(uz+vz);
+        float d1x=ux+vx, d1y=uy+vy, d1z=uz+vz;
+        float d2x=ux-vx, d2y=uy-vy, d2z=uz-vz;
+        float len1 = sqrtf(d1x*d1x + d1y*d1y + d1z*d1z);
+        float len2 = sqrtf(d2x*d2x + d2y*d2y + d2z*d2z);
+        bs[3] = 0.5f * fmaxf(len1, len2);
+    } else if (pt == PRIM_TRIANGLE) {
+        float cx = (gm[0]+gm[4]+gm[8])/3.0f;
+        float cy = (gm[1]+gm[5]+gm[9])/3.0f;
+        float cz = (gm[2]+gm[6]+gm[10])/3.0f;
+        float r = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            float dx = gm[k*4]-cx, dy = gm[k*4+1]-cy, dz = gm[k*4+2]-cz;
+            float d = sqrtf(dx*dx+dy*dy+dz*dz);
+            if (d > r) r = d;
         }
+        bs[0] = cx; bs[1] = cy; bs[2] = cz; bs[3] = r;
     }
+}
 
-    // Lights: row LIGHT_ROW_BASE + j, cols 0-2
-    for (int j = 0; j < g.lightCount; j++) {
-        float *row = &g.sceneDataBuf[(LIGHT_ROW_BASE + j) * rowStride];
-        // Col 0: type, dir.xyz
-        row[0] = (float)g.lights[j].type;
-        row[1] = g.lights[j].direction.x;
-        row[2] = g.lights[j].direction.y;
-        row[3] = g.lights[j].direction.z;
-        // Col 1: pos.xyz, intensity
-        row[4] = g.lights[j].position.x;
-        row[5] = g.lights[j].position.y;
-        row[6] = g.lights[j].position.z;
-        row[7] = g.lights[j].intensity;
-        // Col 2: color.rgb, radius
-        row[8]  = g.lights[j].color.x;
-        row[9]  = g.lights[j].color.y;
-        row[10] = g.lights[j].color.z;
-        row[11] = g.lights[j].radius;
+// Lights: row LIGHT_ROW_BASE + j, cols 0-2
+static void PackLightRow(int j) {
+    float *row = &g.sceneDataBuf[(LIGHT_ROW_BASE + j) * SCENE_ROW_FLOATS];
+    memset(row, 0, SCENE_ROW_FLOATS * sizeof(float));
+    if (j >= g.lightCount) return;
+    // Col 0: type, dir.xyz
+    row[0] = (float)g.lights[j].type;
+    row[1] = g.lights[j].direction.x;
+    row[2] = g.lights[j].direction.y;
+    row[3] = g.lights[j].direction.z;
+    // Col 1: pos.xyz, intensity
+    row[4] = g.lights[j].position.x;
+    row[5] = g.lights[j].position.y;
+    row[6] = g.lights[j].position.z;
+    row[7] = g.lights[j].intensity;
+    // Col 2: color.rgb, radius
+    row[8]  = g.lights[j].color.x;
+    row[9]  = g.lights[j].color.y;
+    row[10] = g.lights[j].color.z;
+    row[11] = g.lights[j].radius;
+}
+
+static bool IsEmitter(int i) {
+    return g.prims[i].material == MAT_EMISSIVE && g.prims[i].emissionStrength > 0.0f;
+}
+
+static float PrimArea(int i) {
+    const float *gm = g.prims[i].geom;
+    if (g.prims[i].primType == PRIM_SPHERE) return 4.0f * PI * gm[3] * gm[3];
+    Vector3 a = { gm[4], gm[5], gm[6] }, b = { gm[8], gm[9], gm[10] };
+    if (g.prims[i].primType == PRIM_TRIANGLE) {
+        // Edges B-A, C-A
+        Vector3 A = { gm[0], gm[1], gm[2] };
+        a = Vector3Subtract(a, A);
+        b = Vector3Subtract(b, A);
+        return 0.5f * Vector3Length(Vector3CrossProduct(a, b));
+    }
+    return Vector3Length(Vector3CrossProduct(a, b));
+}
+
+// Emitted power (luminance x strength x area) used to weight NEE selection
+static float EmitterPower(int i) {
+    Vector3 e = g.prims[i].emission;
+    float lum = 0.2126f * e.x + 0.7152f * e.y + 0.0722f * e.z;
+    return lum * g.prims[i].emissionStrength * PrimArea(i);
+}
+
+// Vose alias table over the emissive prims, written straight into the emitter
+// rows (layout in scene_layout.h) — O(1) power-proportional sampling in the shader
+static void BuildEmitterTable(void) {
+    float *table = &g.sceneDataBuf[EMITTER_ROW_BASE * SCENE_ROW_FLOATS];
+    memset(table, 0, MAX_EMITTERS * 4 * sizeof(float));
+    for (int r = 0; r < EMITTER_ROWS; r++) g.sceneRowDirty[EMITTER_ROW_BASE + r] = 1;
+
+    int prim[MAX_EMITTERS];
+    float power[MAX_EMITTERS];
+    float total = 0.0f;
+    int n = 0;
+    for (int r = 0; r < g.primCount && n < MAX_EMITTERS; r++) {
+        int i = g.rowPrim[r];
+        if (!IsEmitter(i)) continue;
+        prim[n] = r;
+        power[n] = fmaxf(EmitterPower(i), 0.0f);
+        total += power[n];
+        n++;
     }
+    g.emitterCount = n;
+    if (n == 0) return;
+    if (total <= 0.0f) {
+        // Degenerate (all black or zero-area): fall back to uniform
+        for (int k = 0; k < n; k++) power[k] = 1.0f;
+        total = (float)n;
+    }
+
+    float scaled[MAX_EMITTERS];
+    int small[MAX_EMITTERS], large[MAX_EMITTERS];
+    int ns = 0, nl = 0;
+    for (int k = 0; k < n; k++) {
+        scaled[k] = power[k] * (float)n / total;
+        if (scaled[k] < 1.0f) small[ns++] = k; else large[nl++] = k;
+    }
+    while (ns > 0 && nl > 0) {
+        int sm = small[--ns], lg = large[--nl];
+        table[sm * 4 + 1] = scaled[sm];
+        table[sm * 4 + 2] = (float)lg;
+        scaled[lg] = (scaled[lg] + scaled[sm]) - 1.0f;
+        if (scaled[lg] < 1.0f) small[ns++] = lg; else large[nl++] = lg;
+    }
+    // Leftovers are 1 up to rounding
+    while (nl > 0) { int k = large[--nl]; table[k * 4 + 1] = 1.0f; table[k * 4 + 2] = (float)k; }
+    while (ns > 0) { int k = small[--ns]; table[k * 4 + 1] = 1.0f; table[k * 4 + 2] = (float)k; }
+
+    for (int k = 0; k < n; k++) {
+        table[k * 4 + 0] = (float)prim[k];
+        table[k * 4 + 3] = power[k] / total;
+    }
+}
+
+static void PackSceneData(void) {
+    RemapPrims();
+    for (int i = 0; i < MAX_PRIMS; i++) PackPrimRow(i);
+    for (int j = 0; j < MAX_LIGHTS; j++) PackLightRow(j);
+    BuildEmitterTable();
+}
+
+// Full SAH build over the freshly packed rows (marks every node row dirty)
+static void BuildSceneBVH(void) {
+    BvhBuild(&g.bvh, g.geomDataBuf, g.primCount);
 }
 
 static void UploadSceneData(void) {
     PackSceneData();
+    memset(g.sceneRowDirty, 0, sizeof(g.sceneRowDirty));
     rlUpdateTexture(g.sceneDataTex.id, 0, 0, g.sceneDataTex.width,
                     g.sceneDataTex.height, RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
                     g.sceneDataBuf);
+    rlUpdateTexture(g.geomDataTex.id, 0, 0, GEOM_TEX_WIDTH, MAX_PRIMS,
+                    RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, g.geomDataBuf);
 }
 
-static void OnSceneChanged(void) {
-    g.frameCount = 0;
-    UploadSceneData();
+static void MarkPrimDirty(int i) {
+    if (i >= 0 && i < g.primCount) g.sceneRowDirty[g.primRow[i]] = 1;
+}
+
+// Repack and sub-upload only the dirty rows, one update per contiguous run —
+// cost scales with the edit, not with the scene
+static void UploadDirtySceneRows(void) {
+    int y = 0;
+    while (y < SCENE_TEX_HEIGHT) {
+        if (!g.sceneRowDirty[y]) { y++; continue; }
+        int start = y;
+        for (; y < SCENE_TEX_HEIGHT && g.sceneRowDirty[y]; y++) {
+            if (y < LIGHT_ROW_BASE) PackPrimRow(y);
+            else if (y < EMITTER_ROW_BASE) PackLightRow(y - LIGHT_ROW_BASE);
+            // emitter rows are written in place by BuildEmitterTable
+            g.sceneRowDirty[y] = 0;
+        }
+        rlUpdateTexture(g.sceneDataTex.id, 0, start, SCENE_TEX_WIDTH, y - start,
+                        RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+                        &g.sceneDataBuf[start * SCENE_ROW_FLOATS]);
+        int geomEnd = y < LIGHT_ROW_BASE ? y : LIGHT_ROW_BASE;
+        if (start < geomEnd)
+            rlUpdateTexture(g.geomDataTex.id, 0, start, GEOM_TEX_WIDTH, geomEnd - start,
+                            RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+                            &g.geomDataBuf[start * GEOM_ROW_FLOATS]);
+    }
+}
+
+// Repack and sub-upload only the dirty node rows, one update per contiguous run
+static void UploadBvhRows(void) {
+    int i = 0;
+    while (i < g.bvh.nodeCount) {
+        if (!g.bvh.dirty[i]) { i++; continue; }
+        int start = i;
+        for (; i < g.bvh.nodeCount && g.bvh.dirty[i]; i++) {
+            BvhPackNode(&g.bvh, i, &g.bvhDataBuf[i * BVH_ROW_FLOATS]);
+            g.bvh.dirty[i] = 0;
+        }
+        rlUpdateTexture(g.bvhDataTex.id, 0, start, BVH_TEX_WIDTH, i - start,
+                        RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+                        &g.bvhDataBuf[start * BVH_ROW_FLOATS]);
+    }
+    if (g.locBvhNodeCount != -1)
+        SetShaderValue(g.shader, g.locBvhNodeCount, &g.bvh.nodeCount, SHADER_UNIFORM_INT);
+}
+
+// After an incremental refit/insert/remove: rebuild if the tree degraded, then upload
+static void UpdateSceneBVH(void) {
+    if (BvhNeedsRebuild(&g.bvh)) BuildSceneBVH();
+    UploadBvhRows();
+}
+
+// Counts the shader needs after any scene edit (emitter table already built)
+static void UpdateSceneUniforms(void) {
     if (g.locPrimCount != -1)
         SetShaderValue(g.shader, g.locPrimCount, &g.primCount, SHADER_UNIFORM_INT);
+    if (g.locQuadCount != -1)
+        SetShaderValue(g.shader, g.locQuadCount, &g.quadCount, SHADER_UNIFORM_INT);
+    if (g.locTriangleCount != -1)
+        SetShaderValue(g.shader, g.locTriangleCount, &g.triangleCount, SHADER_UNIFORM_INT);
     if (g.locLightCount != -1)
         SetShaderValue(g.shader, g.locLightCount, &g.lightCount, SHADER_UNIFORM_INT);
-
-    // Scan for emissive primitives and upload their indices
-    int emissiveIndices[16] = {0};
-    int emissiveCount = 0;
-    for (int i = 0; i < g.primCount && emissiveCount < 16; i++) {
-        if (g.prims[i].material == 2 && g.prims[i].emissionStrength > 0.0f) {
-            emissiveIndices[emissiveCount++] = i;
-        }
-    }
     if (g.locEmissiveCount != -1)
-        SetShaderValue(g.shader, g.locEmissiveCount, &emissiveCount, SHADER_UNIFORM_INT);
-    if (g.locEmissiveIndices != -1)
-        SetShaderValueV(g.shader, g.locEmissiveIndices, emissiveIndices, SHADER_UNIFORM_INT, emissiveCount > 0 ? emissiveCount : 1);
+        SetShaderValue(g.shader, g.locEmissiveCount, &g.emitterCount, SHADER_UNIFORM_INT);
 }
 
-static void OnRenderSettingsChanged(void) {
-    g.frameCount = 0;
+// ============================================================
+// Raytrace shader variants
+// ============================================================
+
+// -1 with no program bound (the first variant still compiling), so every
+// uniform setter skips it until UseRaytraceShader
+static int RaytraceLocation(const char *name) {
+    return (g.shader.id != 0) ? GetShaderLocation(g.shader, name) : -1;
+}
+
+static void LoadRaytraceLocations(void) {
+    g.locTime = RaytraceLocation("time");
+    g.locPrimCount = RaytraceLocation("primCount");
+    g.locLightCount = RaytraceLocation("lightCount");
+    g.camPosLoc = RaytraceLocation("cameraPosition");
+    g.invVpLoc = RaytraceLocation("invViewProj");
+    g.locKLinear = RaytraceLocation("k_linear");
+    g.locKQuadratic = RaytraceLocation("k_quadratic");
+    g.locAORadius = RaytraceLocation("aoRadius");
+    g.locAOStrength = RaytraceLocation("aoStrength");
+    g.locFrameCount = RaytraceLocation("frameCount");
+    g.locAccumTexture = RaytraceLocation("accumTexture");
+    g.locResolution = RaytraceLocation("resolution");
+    g.locSceneData = RaytraceLocation("sceneData");
+    g.locGeomData = RaytraceLocation("geomData");
+    g.locQuadCount = RaytraceLocation("quadCount");
+    g.locTriangleCount = RaytraceLocation("triangleCount");
+    g.locBvhData = RaytraceLocation("bvhData");
+    g.locBvhNodeCount = RaytraceLocation("bvhNodeCount");
+    g.locEmissiveCount = RaytraceLocation("emissiveCount");
+    g.locSPP = RaytraceLocation("samplesPerFrame");
+    g.locEnvMap = RaytraceLocation("envMap");
+    g.locUseEnvMap = RaytraceLocation("useEnvMap");
+    g.locEnvIntensity = RaytraceLocation("envIntensity");
+    g.locEnvRotation = RaytraceLocation("envRotation");
+    g.locLightSampling = RaytraceLocation("lightSampling");
+    g.locEnvCdf = RaytraceLocation("envCdf");
+    g.locEnvSize = RaytraceLocation("envSize");
+    g.locSamplerMode = RaytraceLocation("samplerMode");
+    g.locBlueNoise = RaytraceLocation("blueNoise");
+    g.locMomentsTexture = RaytraceLocation("momentsTexture");
+    g.locSampleBudget = RaytraceLocation("sampleBudget");
+    g.locAdaptiveSampling = RaytraceLocation("adaptiveSampling");
+    g.locAccumMode = RaytraceLocation("accumMode");
+    g.locGBufferTexture = RaytraceLocation("gbufferTexture");
+    g.locPrevViewProj = RaytraceLocation("prevViewProj");
+    g.locReprojectFrame = RaytraceLocation("reprojectFrame");
+    g.locGBufferOnly = RaytraceLocation("gbufferOnly");
+    g.locUseVisibility = RaytraceLocation("useVisibility");
+}
+
+// Sampler units and constants; a fresh program starts with every uniform at 0
+static void SetStaticRaytraceUniforms(void) {
+    float kLinear = 0.09f, kQuadratic = 0.032f;
+    if (g.locKLinear != -1) SetShaderValue(g.shader, g.locKLinear, &kLinear, SHADER_UNIFORM_FLOAT);
+    if (g.locKQuadratic != -1) SetShaderValue(g.shader, g.locKQuadratic, &kQuadratic, SHADER_UNIFORM_FLOAT);
+    int envCdfUnit = ENV_CDF_TEXTURE_UNIT;
+    if (g.locEnvCdf != -1) SetShaderValue(g.shader, g.locEnvCdf, &envCdfUnit, SHADER_UNIFORM_INT);
+    int blueNoiseUnit = BLUE_NOISE_TEXTURE_UNIT;
+    if (g.locBlueNoise != -1) SetShaderValue(g.shader, g.locBlueNoise, &blueNoiseUnit, SHADER_UNIFORM_INT);
+    int momentsUnit = MOMENTS_TEXTURE_UNIT, budgetUnit = SAMPLE_BUDGET_TEXTURE_UNIT;
+    int gbufferUnit = GBUFFER_TEXTURE_UNIT;
+    if (g.locGBufferTexture != -1) SetShaderValue(g.shader, g.locGBufferTexture, &gbufferUnit, SHADER_UNIFORM_INT);
+    if (g.locMomentsTexture != -1) SetShaderValue(g.shader, g.locMomentsTexture, &momentsUnit, SHADER_UNIFORM_INT);
+    if (g.locSampleBudget != -1) SetShaderValue(g.shader, g.locSampleBudget, &budgetUnit, SHADER_UNIFORM_INT);
+    int geomUnit = GEOMETRY_TEXTURE_UNIT;
+    if (g.locGeomData != -1) SetShaderValue(g.shader, g.locGeomData, &geomUnit, SHADER_UNIFORM_INT);
+}
+
+// Render settings read by g.shader (OnRenderSettingsChanged also covers the
+// display pass and the targets)
+static void SetRenderSettingUniforms(void) {
     if (g.locAORadius != -1)
         SetShaderValue(g.shader, g.locAORadius, &g.aoRadius, SHADER_UNIFORM_FLOAT);
     if (g.locAOStrength != -1)
         SetShaderValue(g.shader, g.locAOStrength, &g.aoStrength, SHADER_UNIFORM_FLOAT);
-    if (g.locDisplayToneMap != -1)
-        SetShaderValue(g.displayShader, g.locDisplayToneMap, &g.toneMapMode, SHADER_UNIFORM_INT);
-    if (g.locDisplayExposure != -1)
-        SetShaderValue(g.displayShader, g.locDisplayExposure, &g.exposure, SHADER_UNIFORM_FLOAT);
     if (g.locSPP != -1)
         SetShaderValue(g.shader, g.locSPP, &g.samplesPerFrame, SHADER_UNIFORM_INT);
     if (g.locUseEnvMap != -1)
@@ -473,6 +968,577 @@ static void OnRenderSettingsChanged(void) {
         SetShaderValue(g.shader, g.locEnvIntensity, &g.envIntensity, SHADER_UNIFORM_FLOAT);
     if (g.locEnvRotation != -1)
         SetShaderValue(g.shader, g.locEnvRotation, &g.envRotation, SHADER_UNIFORM_FLOAT);
+    if (g.locLightSampling != -1)
+        SetShaderValue(g.shader, g.locLightSampling, &g.lightSampling, SHADER_UNIFORM_INT);
+    if (g.locSamplerMode != -1)
+        SetShaderValue(g.shader, g.locSamplerMode, &g.samplerMode, SHADER_UNIFORM_INT);
+    if (g.locAccumMode != -1)
+        SetShaderValue(g.shader, g.locAccumMode, &g.accumMode, SHADER_UNIFORM_INT);
+    if (g.locEnvSize != -1) {
+        int envSize[2] = { 0, 0 };
+        Texture2D envTex, cdfTex;
+        if (ActiveEnvMap(&envTex, &cdfTex)) {
+            envSize[0] = envTex.width;
+            envSize[1] = envTex.height;
+        }
+        SetShaderValue(g.shader, g.locEnvSize, envSize, SHADER_UNIFORM_IVEC2);
+    }
+}
+
+// Which optional paths the current scene and settings can reach
+static unsigned int RaytraceFeatureMask(void) {
+    unsigned int mask = 0;
+    int sphereCount = g.primCount - g.quadCount - g.triangleCount;
+    if (sphereCount > 0 || g.primCount == 0) mask |= RT_FEATURE_SPHERES;
+    if (g.quadCount > 0) mask |= RT_FEATURE_QUADS;
+    if (g.triangleCount > 0) mask |= RT_FEATURE_TRIANGLES;
+    if (g.aoStrength > 0.0f) mask |= RT_FEATURE_AO;
+    if (g.lightCount > 0) mask |= RT_FEATURE_LIGHTS;
+    if (g.emitterCount > 0) mask |= RT_FEATURE_EMITTERS;
+    if (g.useEnvMap == ENV_HDR_MAP || g.useEnvMap == ENV_PROCEDURAL) mask |= RT_FEATURE_ENV_MAP;
+    return mask;
+}
+
+static void RaytraceVariantDefines(unsigned int mask, char *defines, int size) {
+    snprintf(defines, size,
+        "#define HAS_SPHERES %d\n#define HAS_QUADS %d\n#define HAS_TRIANGLES %d\n"
+        "#define HAS_AO %d\n#define HAS_LIGHTS %d\n#define HAS_EMITTERS %d\n"
+        "#define HAS_ENV_MAP %d\n",
+        (mask & RT_FEATURE_SPHERES) != 0, (mask & RT_FEATURE_QUADS) != 0,
+        (mask & RT_FEATURE_TRIANGLES) != 0, (mask & RT_FEATURE_AO) != 0,
+        (mask & RT_FEATURE_LIGHTS) != 0, (mask & RT_FEATURE_EMITTERS) != 0,
+        (mask & RT_FEATURE_ENV_MAP) != 0);
+}
+
+// Make `shader` the raytrace program: locations and every non-per-frame
+// uniform are re-sent; the per-frame ones follow because every caller
+// restarts accumulation.
+static void UseRaytraceShader(Shader shader, unsigned int mask) {
+    g.shader = shader;
+    g.rtFeatures = mask;
+    LoadRaytraceLocations();
+    SetStaticRaytraceUniforms();
+    UpdateSceneUniforms();
+    if (g.locBvhNodeCount != -1)
+        SetShaderValue(g.shader, g.locBvhNodeCount, &g.bvh.nodeCount, SHADER_UNIFORM_INT);
+    SetRenderSettingUniforms();
+}
+
+static void ThawScene(void);
+
+// Start compiling raytrace.glsl for `mask` (plus FreezeScene's defines and
+// appendix when frozen) in the background, replacing any build in flight
+static bool StartRaytraceBuild(unsigned int mask, const char *defines, const char *appendix, bool frozen) {
+    char *source = LoadShaderSource("shaders/raytrace.glsl", defines, appendix);
+    if (!source) return false;
+    ShaderBuildCancel(&g.rtBuild);
+    ShaderBuildStart(&g.rtBuild, source);
+    RL_FREE(source);
+    g.rtBuildFeatures = mask;
+    g.rtBuildFrozen = frozen;
+    return true;
+}
+
+// A program compiled for `have` renders a `want` scene correctly: the extra
+// paths find zero rows or a zero strength. Only the env-map switch changes
+// what a miss returns, so it has to match.
+static bool RaytraceFeaturesCover(unsigned int have, unsigned int want) {
+    return (have & want) == want && (have & RT_FEATURE_ENV_MAP) == (want & RT_FEATURE_ENV_MAP);
+}
+
+// Point g.shader at the variant for the current feature mask. A variant seen
+// before comes from the cache; a new one compiles in the background while the
+// bound program keeps rendering if it covers the scene, and the preview
+// stands in otherwise (PollRaytraceBuild switches over once it is linked).
+static void SelectRaytraceVariant(void) {
+    unsigned int mask = RaytraceFeatureMask();
+    if (g.sceneFrozen || g.rtBuildFrozen) {
+        if (mask == (g.sceneFrozen ? g.rtFeatures : g.rtBuildFeatures)) return;
+        ThawScene();   // a setting changed what the frozen program compiled out
+    }
+    bool building = g.rtBuild.state == SHADER_BUILD_PENDING;
+    if (g.shader.id != 0 && mask == g.rtFeatures) {
+        if (building) ShaderBuildCancel(&g.rtBuild);   // toggled back before it finished
+        return;
+    }
+
+    for (int i = 0; i < g.rtVariantCount; i++) {
+        if (g.rtVariants[i].features != mask) continue;
+        if (building) ShaderBuildCancel(&g.rtBuild);
+        g.rtVariants[i].lastUsed = ++g.rtVariantClock;
+        UseRaytraceShader(g.rtVariants[i].shader, mask);
+        return;
+    }
+
+    if (!building || g.rtBuildFeatures != mask) {
+        char defines[256];
+        RaytraceVariantDefines(mask, defines, sizeof(defines));
+        if (!StartRaytraceBuild(mask, defines, NULL, false)) return;
+    }
+    if (g.shader.id == 0 || !RaytraceFeaturesCover(g.rtFeatures, mask)) {
+        g.shader = (Shader){ 0 };   // any bound one is still owned by rtVariants
+        g.rtFeatures = 0;
+        LoadRaytraceLocations();
+    }
+}
+
+// Add a linked variant to the cache, evicting the least recently used one
+static void CacheRaytraceVariant(unsigned int mask, Shader shader) {
+    int slot;
+    if (g.rtVariantCount < RT_VARIANT_CACHE_SIZE) {
+        slot = g.rtVariantCount++;
+    } else {
+        slot = 0;
+        for (int i = 1; i < g.rtVariantCount; i++)
+            if (g.rtVariants[i].lastUsed < g.rtVariants[slot].lastUsed) slot = i;
+        UnloadShader(g.rtVariants[slot].shader);
+    }
+    g.rtVariants[slot] = (ShaderVariant){ mask, shader, ++g.rtVariantClock };
+}
+
+// Once per frame: switch to the background build when it has linked
+static void PollRaytraceBuild(void) {
+    ShaderBuildState state = ShaderBuildPoll(&g.rtBuild);
+    if (state == SHADER_BUILD_FAILED) {
+        if (g.rtBuildFrozen) {
+            printf("WARNING: could not freeze the scene, staying on the texture path\n");
+            g.freezeScene = 0;
+            g.uiDirty = true;
+        } else {
+            // The bound variant (or the preview) stays; the next scene or
+            // settings change asks for this one again
+            printf("WARNING: raytrace variant 0x%02x failed to compile\n", g.rtBuildFeatures);
+        }
+        ShaderBuildCancel(&g.rtBuild);
+        g.rtBuildFrozen = false;
+        return;
+    }
+    if (state != SHADER_BUILD_READY) return;
+
+    if (g.rtBuild.fromCache) printf("INFO: raytrace variant 0x%02x loaded from the program cache\n", g.rtBuildFeatures);
+    Shader shader = ShaderBuildTake(&g.rtBuild);
+    if (g.rtBuildFrozen) {
+        g.frozenShader = shader;
+        g.sceneFrozen = true;
+        g.rtBuildFrozen = false;
+        g.uiDirty = true;
+    } else {
+        CacheRaytraceVariant(g.rtBuildFeatures, shader);
+    }
+    g.frameCount = 0;
+    UseRaytraceShader(shader, g.rtBuildFeatures);
+}
+
+// ============================================================
+// Frozen scene
+// ============================================================
+
+typedef struct GlslWriter {
+    char *buf;
+    int cap, len;   // len >= cap once anything did not fit
+} GlslWriter;
+
+static void GlslAppend(GlslWriter *w, const char *fmt, ...) {
+    if (w->len >= w->cap) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, (size_t)(w->cap - w->len), fmt, args);
+    va_end(args);
+    w->len = (n < 0) ? w->cap : w->len + n;
+}
+
+// Round-trip exact, and always a float literal: GLSL ES has no implicit
+// int -> float conversion for function arguments
+static void GlslAppendFloat(GlslWriter *w, float v) {
+    char num[32];
+    snprintf(num, sizeof(num), "%.9g", isfinite(v) ? v : 0.0f);
+    GlslAppend(w, strpbrk(num, ".e") ? "%s" : "%s.0", num);
+}
+
+static void GlslAppendVec(GlslWriter *w, const float *v, int n) {
+    GlslAppend(w, "vec%d(", n);
+    for (int k = 0; k < n; k++) {
+        if (k > 0) GlslAppend(w, ", ");
+        GlslAppendFloat(w, v[k]);
+    }
+    GlslAppend(w, ")");
+}
+
+// `count` rows of `texels` vec4s each, `stride` floats apart, as one const array
+// (one zero texel when empty: GLSL has no zero-length arrays)
+static void GlslAppendRows(GlslWriter *w, const char *name, const float *rows,
+                           int count, int texels, int stride) {
+    static const float zero[4] = { 0 };
+    int n = count > 0 ? count * texels : 1;
+    GlslAppend(w, "const vec4 %s[%d] = vec4[%d](\n", name, n, n);
+    for (int t = 0; t < n; t++) {
+        GlslAppend(w, "    ");
+        GlslAppendVec(w, count > 0 ? &rows[(t / texels) * stride + (t % texels) * 4] : zero, 4);
+        GlslAppend(w, t + 1 < n ? ",\n" : ");\n");
+    }
+}
+
+// Hit test of packed row r against literal geometry, as a GLSL boolean
+static void GlslAppendHitTest(GlslWriter *w, int r, const char *tMax) {
+    const float *row = &g.geomDataBuf[r * GEOM_ROW_FLOATS];
+    if (r >= g.quadCount + g.triangleCount) {
+        GlslAppend(w, "intersectSphere(r, ");
+        GlslAppendVec(w, row, 3);
+        GlslAppend(w, ", ");
+        GlslAppendFloat(w, row[3]);
+    } else {
+        GlslAppend(w, r < g.quadCount ? "intersectQuad(r, " : "intersectTriangle(r, ");
+        for (int c = 0; c < 3; c++) {
+            GlslAppendVec(w, &row[c * 4], 3);
+            GlslAppend(w, ", ");
+        }
+    }
+    GlslAppend(w, r >= g.quadCount + g.triangleCount ? ", %s, t, n)" : "%s, t, n)", tMax);
+}
+
+// Scene rows as const arrays and both trace queries as straight-line code
+// over every primitive, for raytrace.glsl's FROZEN_SCENE prototypes
+static void WriteFrozenSceneGlsl(GlslWriter *w) {
+    GlslAppend(w, "// Generated by FreezeScene (main_web.c)\n");
+    GlslAppendRows(w, "frozenGeom", g.geomDataBuf, g.primCount, GEOM_TEX_WIDTH, GEOM_ROW_FLOATS);
+    GlslAppendRows(w, "frozenPrimRows", g.sceneDataBuf, g.primCount, SCENE_TEX_WIDTH, SCENE_ROW_FLOATS);
+    GlslAppendRows(w, "frozenLightRows", &g.sceneDataBuf[LIGHT_ROW_BASE * SCENE_ROW_FLOATS],
+                   g.lightCount, SCENE_TEX_WIDTH, SCENE_ROW_FLOATS);
+    GlslAppendRows(w, "frozenEmitterRows", &g.sceneDataBuf[EMITTER_ROW_BASE * SCENE_ROW_FLOATS],
+                   (g.emitterCount + SCENE_TEX_WIDTH - 1) / SCENE_TEX_WIDTH,
+                   SCENE_TEX_WIDTH, SCENE_ROW_FLOATS);
+
+    GlslAppend(w,
+        "vec4 frozenGeomTexel(int prim, int col) { return frozenGeom[prim * %d + col]; }\n"
+        "vec4 frozenSceneTexel(int row, int col) {\n"
+        "    if (row < LIGHT_ROW_BASE) return frozenPrimRows[row * %d + col];\n"
+        "    if (row < EMITTER_ROW_BASE) return frozenLightRows[(row - LIGHT_ROW_BASE) * %d + col];\n"
+        "    return frozenEmitterRows[(row - EMITTER_ROW_BASE) * %d + col];\n"
+        "}\n", GEOM_TEX_WIDTH, SCENE_TEX_WIDTH, SCENE_TEX_WIDTH, SCENE_TEX_WIDTH);
+
+    GlslAppend(w, "void frozenClosestHit(in Ray r, inout float tBest, inout vec3 bestN, inout int hitIndex) {\n"
+                  "    float t;\n    vec3 n;\n");
+    for (int r = 0; r < g.primCount; r++) {
+        GlslAppend(w, "    if (");
+        GlslAppendHitTest(w, r, "tBest");
+        GlslAppend(w, " && t < tBest) { tBest = t; bestN = n; hitIndex = %d; }\n", r);
+    }
+    GlslAppend(w, "}\n");
+
+    GlslAppend(w, "bool frozenAnyHit(in Ray r, float maxDist) {\n    float t;\n    vec3 n;\n");
+    for (int r = 0; r < g.primCount; r++) {
+        GlslAppend(w, "    if (");
+        GlslAppendHitTest(w, r, "maxDist");
+        GlslAppend(w, ") return true;\n");
+    }
+    GlslAppend(w, "    return false;\n}\n");
+}
+
+// Compile the current scene into a one-off raytrace program: literal scene
+// rows and unrolled hit tests instead of texture fetches and BVH traversal.
+// For scenes that never change (kiosks, benchmarks); the next edit thaws it.
+// Compiles in the background like any variant; the texture path renders
+// meanwhile.
+static bool FreezeScene(void) {
+    g.uiDirty = true;
+    if (g.sceneFrozen || g.rtBuildFrozen) return true;
+
+    unsigned int mask = RaytraceFeatureMask();
+    char defines[512];
+    RaytraceVariantDefines(mask, defines, sizeof(defines));
+    int len = (int)strlen(defines);
+    snprintf(defines + len, sizeof(defines) - len,
+        "#define FROZEN_SCENE 1\n#define FROZEN_PRIM_COUNT %d\n#define FROZEN_QUAD_COUNT %d\n"
+        "#define FROZEN_TRIANGLE_COUNT %d\n#define FROZEN_LIGHT_COUNT %d\n#define FROZEN_EMITTER_COUNT %d\n",
+        g.primCount, g.quadCount, g.triangleCount, g.lightCount, g.emitterCount);
+
+    GlslWriter w = { (char *)RL_MALLOC(FROZEN_GLSL_BYTES), FROZEN_GLSL_BYTES, 0 };
+    WriteFrozenSceneGlsl(&w);
+    bool started = false;
+    if (w.len < w.cap) started = StartRaytraceBuild(mask, defines, w.buf, true);
+    else printf("WARNING: frozen scene source exceeds %d bytes\n", FROZEN_GLSL_BYTES);
+    RL_FREE(w.buf);
+    if (!started) {
+        printf("WARNING: could not freeze the scene, staying on the texture path\n");
+        g.freezeScene = 0;
+        return false;
+    }
+    return true;   // PollRaytraceBuild switches over
+}
+
+// Drop the frozen program or its pending build (and the request, so it is not
+// rebuilt next frame); the caller selects the texture-path variant
+static void ThawScene(void) {
+    g.freezeScene = 0;
+    if (g.rtBuildFrozen) {
+        ShaderBuildCancel(&g.rtBuild);
+        g.rtBuildFrozen = false;
+        g.uiDirty = true;
+    }
+    if (!g.sceneFrozen) return;
+    UnloadShader(g.frozenShader);
+    g.frozenShader = (Shader){ 0 };
+    g.sceneFrozen = false;
+    g.shader = (Shader){ 0 };
+    g.frameCount = 0;
+    g.uiDirty = true;
+}
+
+// Whole scene replaced (preset load, init): full repack + BVH rebuild
+static void OnSceneChanged(void) {
+    g.frameCount = 0;
+    UploadSceneData();
+    BuildSceneBVH();
+    SelectRaytraceVariant();
+    UploadBvhRows();
+    UpdateSceneUniforms();
+}
+
+static void OnRenderSettingsChanged(void) {
+    g.frameCount = 0;
+    if (g.locDisplayToneMap != -1)
+        SetShaderValue(g.displayShader, g.locDisplayToneMap, &g.toneMapMode, SHADER_UNIFORM_INT);
+    if (g.locDisplayExposure != -1)
+        SetShaderValue(g.displayShader, g.locDisplayExposure, &g.exposure, SHADER_UNIFORM_FLOAT);
+    // Accumulation format changed: recreate the full-resolution targets (none
+    // yet during InitApp); the scaled ones are checked when next used
+    if (g.full.color[0].id != 0 && g.full.mode != g.accumMode) {
+        UnloadAccumTargets(&g.full);
+        LoadAccumTargets(&g.full, SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    // Sky parameters changed while it was off screen, or it was never baked
+    if (g.useEnvMap == ENV_PROCEDURAL && g.skyDirty) BakeSky();
+    SelectRaytraceVariant();
+    SetRenderSettingUniforms();
+}
+
+// ============================================================
+// Edit queue
+// ============================================================
+
+static void QueueEdit(EditKind kind, int index, int aux) {
+    g.uiDirty = true;
+    if (g.editCount >= EDIT_QUEUE_SIZE) {
+        // Too much to track individually — fall back to one full refresh
+        g.edits[0] = (SceneEdit){ EDIT_SCENE_RELOAD, -1, -1 };
+        g.edits[1] = (SceneEdit){ EDIT_RENDER_SETTINGS, -1, -1 };
+        g.editCount = 2;
+        if (kind == EDIT_SCENE_RELOAD || kind == EDIT_RENDER_SETTINGS) return;
+    }
+    g.edits[g.editCount++] = (SceneEdit){ kind, index, aux };
+}
+
+// Re-sort the packed rows after adds/removes and mark the rows that changed.
+// Returns the row the BVH can be updated at in place — the appended row, or
+// the hole the last row moved into — when the packed layout saw the same edit
+// as prims[]; -1 when the rows were reshuffled and the BVH must be rebuilt.
+static int RemapAfterStructuralEdit(SceneEdit ed, bool single) {
+    int oldRowPrim[MAX_PRIMS], oldPrimRow[MAX_PRIMS];
+    int oldCount = g.packedPrimCount;
+    memcpy(oldRowPrim, g.rowPrim, sizeof(oldRowPrim));
+    memcpy(oldPrimRow, g.primRow, sizeof(oldPrimRow));
+    RemapPrims();
+
+    int row = ed.kind == EDIT_PRIM_ADDED ? g.primCount - 1 : oldPrimRow[ed.index];
+    bool inPlace = single;
+    for (int r = 0; inPlace && r < g.primCount; r++) {
+        int expect;
+        if (ed.kind == EDIT_PRIM_ADDED) {
+            expect = r < oldCount ? oldRowPrim[r] : ed.index;
+        } else {
+            int p = oldRowPrim[r == row ? oldCount - 1 : r];
+            expect = p == ed.aux ? ed.index : p;
+        }
+        inPlace = g.rowPrim[r] == expect;
+    }
+    if (!inPlace) {
+        int end = oldCount > g.primCount ? oldCount : g.primCount;
+        for (int r = 0; r < end; r++) g.sceneRowDirty[r] = 1;
+        return -1;
+    }
+    g.sceneRowDirty[row] = 1;
+    if (ed.kind == EDIT_PRIM_REMOVED) g.sceneRowDirty[oldCount - 1] = 1;   // vacated
+    return row;
+}
+
+// Apply every queued edit: dirty rows are repacked and uploaded once, the BVH
+// is updated once, and accumulation restarts once.
+static void FlushEdits(void) {
+    if (g.editCount == 0) return;
+
+    bool reload = false, settings = false;
+    bool emitters = false;   // emitter power/membership may have changed
+    int structural = 0;
+    SceneEdit structuralEdit = { EDIT_SCENE_RELOAD, -1, -1 };
+    // Prims to repack / refit, in final (post-removal) prims[] index space
+    unsigned char dirty[MAX_PRIMS] = {0}, refit[MAX_PRIMS] = {0};
+
+    bool sceneEdit = false;
+    for (int e = 0; e < g.editCount; e++) {
+        SceneEdit ed = g.edits[e];
+        if (ed.kind != EDIT_RENDER_SETTINGS) sceneEdit = true;
+        switch (ed.kind) {
+        case EDIT_SCENE_RELOAD:    reload = true; break;
+        case EDIT_RENDER_SETTINGS: settings = true; break;
+        case EDIT_PRIM_DATA:
+            if (ed.index >= 0 && ed.index < MAX_PRIMS) dirty[ed.index] = 1;
+            emitters = true;
+            break;
+        case EDIT_PRIM_GEOMETRY:
+            if (ed.index >= 0 && ed.index < MAX_PRIMS) dirty[ed.index] = refit[ed.index] = 1;
+            emitters = true;   // area feeds the emitter power
+            break;
+        case EDIT_LIGHT:
+            if (ed.index >= 0 && ed.index < MAX_LIGHTS) g.sceneRowDirty[LIGHT_ROW_BASE + ed.index] = 1;
+            break;
+        case EDIT_PRIM_ADDED:
+            dirty[ed.index] = 1;
+            structural++;
+            structuralEdit = ed;
+            emitters = true;
+            break;
+        case EDIT_PRIM_REMOVED:
+            // Pending repacks and refits follow the prim that moved into the hole
+            dirty[ed.index] = dirty[ed.aux];
+            refit[ed.index] = refit[ed.aux];
+            dirty[ed.aux] = refit[ed.aux] = 0;
+            structural++;
+            structuralEdit = ed;
+            emitters = true;
+            break;
+        }
+    }
+    g.editCount = 0;
+    g.frameCount = 0;
+
+    // The frozen program (or the one compiling) has the old scene compiled in
+    if ((g.sceneFrozen || g.rtBuildFrozen) && sceneEdit) {
+        ThawScene();
+        SelectRaytraceVariant();
+    }
+
+    if (reload) {
+        OnSceneChanged();
+    } else {
+        // Several adds/deletes in one frame: rebuilding is simpler than replaying
+        int structuralRow = structural > 0
+            ? RemapAfterStructuralEdit(structuralEdit, structural == 1) : -1;
+        for (int i = 0; i < g.primCount; i++)
+            if (dirty[i]) MarkPrimDirty(i);
+        if (emitters) BuildEmitterTable();
+        UploadDirtySceneRows();
+        if (structural > 0 && structuralRow < 0) {
+            BuildSceneBVH();
+        } else {
+            if (structuralEdit.kind == EDIT_PRIM_ADDED)
+                BvhInsert(&g.bvh, g.geomDataBuf, structuralRow);
+            else if (structuralEdit.kind == EDIT_PRIM_REMOVED)
+                BvhRemove(&g.bvh, structuralRow, g.primCount);
+            for (int i = 0; i < g.primCount; i++)
+                if (refit[i]) BvhRefit(&g.bvh, g.geomDataBuf, g.primRow[i]);
+        }
+        UpdateSceneBVH();
+        if (emitters) {
+            SelectRaytraceVariant();   // a type or the last emitter may have come or gone
+            UpdateSceneUniforms();
+        }
+    }
+    if (settings) OnRenderSettingsChanged();
+}
+
+// ============================================================
+// HDR environment map
+// ============================================================
+
+// float -> IEEE half, round-to-nearest; clamps to the half range (HDR suns
+// can exceed it) and flushes values below the normal range to zero
+static unsigned short FloatToHalf(float f) {
+    union { float f; unsigned int u; } v = { f };
+    unsigned int sign = (v.u >> 16) & 0x8000u;
+    int exponent = (int)((v.u >> 23) & 0xffu) - 127 + 15;
+    unsigned int mantissa = v.u & 0x7fffffu;
+    if (exponent <= 0) return (unsigned short)sign;
+    if (exponent >= 31) return (unsigned short)(sign | 0x7bffu);
+    unsigned int h = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) h++;   // carries into the exponent correctly
+    if ((h & 0x7fffu) > 0x7bffu) h = sign | 0x7bffu;
+    return (unsigned short)h;
+}
+
+// Upload an EnvMap as a filtered RGBA16F radiance texture plus its R32F CDF
+// texture, replacing whatever mapTex/cdfTex held
+static bool UploadEnvMap(const EnvMap *env, Texture2D *mapTex, Texture2D *cdfTex) {
+    int w = env->width, h = env->height;
+
+    // Row-by-row half conversion keeps the staging buffer to one scanline
+    unsigned short *row = (unsigned short *)RL_MALLOC((size_t)w * 4 * sizeof(unsigned short));
+    if (!row) return false;
+    unsigned int envId = rlLoadTexture(NULL, w, h, RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, 1);
+    for (int y = 0; y < h; y++) {
+        const float *src = &env->rgb[(size_t)y * w * 3];
+        for (int x = 0; x < w; x++) {
+            row[x * 4 + 0] = FloatToHalf(src[x * 3 + 0]);
+            row[x * 4 + 1] = FloatToHalf(src[x * 3 + 1]);
+            row[x * 4 + 2] = FloatToHalf(src[x * 3 + 2]);
+            row[x * 4 + 3] = 0x3c00;   // 1.0
+        }
+        rlUpdateTexture(envId, 0, y, w, 1, RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, row);
+    }
+    RL_FREE(row);
+    rlTextureParameters(envId, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_BILINEAR);
+    rlTextureParameters(envId, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_BILINEAR);
+    rlTextureParameters(envId, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_REPEAT);
+    rlTextureParameters(envId, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_CLAMP);
+
+    unsigned int cdfId = rlLoadTexture(env->cdf, w, h + 1, RL_PIXELFORMAT_UNCOMPRESSED_R32, 1);
+    rlTextureParameters(cdfId, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_NEAREST);
+    rlTextureParameters(cdfId, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_NEAREST);
+    rlTextureParameters(cdfId, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_CLAMP);
+    rlTextureParameters(cdfId, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_CLAMP);
+
+    if (mapTex->id > 0) rlUnloadTexture(mapTex->id);
+    if (cdfTex->id > 0) rlUnloadTexture(cdfTex->id);
+    *mapTex = (Texture2D){ .id = envId, .width = w, .height = h,
+                           .format = PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, .mipmaps = 1 };
+    *cdfTex = (Texture2D){ .id = cdfId, .width = w, .height = h + 1,
+                           .format = PIXELFORMAT_UNCOMPRESSED_R32, .mipmaps = 1 };
+    return true;
+}
+
+// Re-bake the procedural sky table after its parameters changed
+static void BakeSky(void) {
+    EnvMap sky;
+    float sunDir[3] = { g.sunDirection.x, g.sunDirection.y, g.sunDirection.z };
+    if (EnvMapBakeSky(&sky, SKY_LUT_WIDTH, SKY_LUT_HEIGHT, sunDir) != 0) {
+        printf("ERROR: Could not bake the procedural sky\n");
+        return;
+    }
+    if (UploadEnvMap(&sky, &g.skyMapTex, &g.skyCdfTex)) g.skyDirty = false;
+    EnvMapFree(&sky);
+}
+
+// Radiance + CDF textures for the current environment mode, if it uses a table
+static bool ActiveEnvMap(Texture2D *mapTex, Texture2D *cdfTex) {
+    if (g.useEnvMap == ENV_HDR_MAP) { *mapTex = g.envMapTex; *cdfTex = g.envCdfTex; }
+    else if (g.useEnvMap == ENV_PROCEDURAL) { *mapTex = g.skyMapTex; *cdfTex = g.skyCdfTex; }
+    else return false;
+    return mapTex->id > 0 && cdfTex->id > 0;
+}
+
+// Decode an .hdr, upload it as the envMap texture plus its CDF texture and
+// switch the environment to it. The CPU-side copies are dropped afterwards.
+static bool LoadEnvironmentMap(const char *path) {
+    EnvMap env;
+    if (EnvMapLoadHDR(&env, path) != 0) {
+        printf("ERROR: Could not load environment map %s\n", path);
+        return false;
+    }
+    bool ok = UploadEnvMap(&env, &g.envMapTex, &g.envCdfTex);
+    EnvMapFree(&env);
+    if (!ok) return false;
+    g.useEnvMap = ENV_HDR_MAP;
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
+    return true;
 }
 
 // Helper: get sphere center from geom for picking/dragging
@@ -511,60 +1577,69 @@ EMSCRIPTEN_KEEPALIVE float GetSphereShininess(int i) { return (i >= 0 && i < g.p
 
 EMSCRIPTEN_KEEPALIVE void SelectSphere(int i) {
     g.selectedSphere = (i >= 0 && i < g.primCount) ? i : -1;
+    g.uiDirty = true;
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereColor(int i, int r, int gr, int b) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].color = (Color){ (unsigned char)r, (unsigned char)gr, (unsigned char)b, 255 };
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereMaterial(int i, int mat) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].material = mat;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereRadius(int i, float r) {
     if (i < 0 || i >= g.primCount) return;
-    if (g.prims[i].primType == PRIM_SPHERE) g.prims[i].geom[3] = r;
-    OnSceneChanged();
+    if (g.prims[i].primType != PRIM_SPHERE) return;
+    g.prims[i].geom[3] = fmaxf(r, 0.0f);   // negative geom0.w tags flat primitives
+    QueueEdit(EDIT_PRIM_GEOMETRY, i, -1);
+}
+
+EMSCRIPTEN_KEEPALIVE void SetSpherePosition(int i, float x, float y, float z) {
+    if (i < 0 || i >= g.primCount) return;
+    if (g.prims[i].primType != PRIM_SPHERE) return;
+    g.prims[i].geom[0] = x; g.prims[i].geom[1] = y; g.prims[i].geom[2] = z;
+    QueueEdit(EDIT_PRIM_GEOMETRY, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereEmission(int i, float r, float gr, float b) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].emission = (Vector3){ r, gr, b };
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereEmissionStrength(int i, float val) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].emissionStrength = val;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereIOR(int i, float val) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].ior = val;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereRoughness(int i, float val) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].roughness = val;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereSpecular(int i, float val) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].specular = val;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void SetSphereShininess(int i, float val) {
     if (i < 0 || i >= g.primCount) return;
     g.prims[i].shininess = val;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_DATA, i, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void AddSphere(void) {
@@ -572,16 +1647,17 @@ EMSCRIPTEN_KEEPALIVE void AddSphere(void) {
     g.prims[g.primCount] = MakeLambertianSphere(g.cameraTarget, 0.5f, GRAY);
     g.selectedSphere = g.primCount;
     g.primCount++;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_ADDED, g.primCount - 1, -1);
 }
 
 EMSCRIPTEN_KEEPALIVE void DeleteSelectedSphere(void) {
     if (g.selectedSphere < 0 || g.selectedSphere >= g.primCount) return;
-    g.prims[g.selectedSphere] = g.prims[g.primCount - 1];
-    memset(&g.prims[g.primCount - 1], 0, sizeof(Primitive));
+    int removed = g.selectedSphere, last = g.primCount - 1;
+    g.prims[removed] = g.prims[last];
+    memset(&g.prims[last], 0, sizeof(Primitive));
     g.primCount--;
     g.selectedSphere = -1;
-    OnSceneChanged();
+    QueueEdit(EDIT_PRIM_REMOVED, removed, last);
 }
 
 // Light API
@@ -598,56 +1674,306 @@ EMSCRIPTEN_KEEPALIVE float GetLightPosY(int i)       { return (i >= 0 && i < g.l
 EMSCRIPTEN_KEEPALIVE float GetLightPosZ(int i)       { return (i >= 0 && i < g.lightCount) ? g.lights[i].position.z : 0; }
 EMSCRIPTEN_KEEPALIVE float GetLightRadius(int i)     { return (i >= 0 && i < g.lightCount) ? g.lights[i].radius : 0; }
 
-EMSCRIPTEN_KEEPALIVE void SetLightType(int i, int type) { if (i < 0 || i >= g.lightCount) return; g.lights[i].type = type; OnSceneChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetLightColor(int i, float r, float gr, float b) { if (i < 0 || i >= g.lightCount) return; g.lights[i].color = (Vector3){r,gr,b}; OnSceneChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetLightIntensity(int i, float val) { if (i < 0 || i >= g.lightCount) return; g.lights[i].intensity = val; OnSceneChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetLightDir(int i, float x, float y, float z) { if (i < 0 || i >= g.lightCount) return; g.lights[i].direction = (Vector3){x,y,z}; OnSceneChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetLightPos(int i, float x, float y, float z) { if (i < 0 || i >= g.lightCount) return; g.lights[i].position = (Vector3){x,y,z}; OnSceneChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetLightRadius(int i, float val) { if (i < 0 || i >= g.lightCount) return; g.lights[i].radius = val; OnSceneChanged(); }
+EMSCRIPTEN_KEEPALIVE void SetLightType(int i, int type) { if (i < 0 || i >= g.lightCount) return; g.lights[i].type = type; QueueEdit(EDIT_LIGHT, i, -1); }
+EMSCRIPTEN_KEEPALIVE void SetLightColor(int i, float r, float gr, float b) { if (i < 0 || i >= g.lightCount) return; g.lights[i].color = (Vector3){r,gr,b}; QueueEdit(EDIT_LIGHT, i, -1); }
+EMSCRIPTEN_KEEPALIVE void SetLightIntensity(int i, float val) { if (i < 0 || i >= g.lightCount) return; g.lights[i].intensity = val; QueueEdit(EDIT_LIGHT, i, -1); }
+EMSCRIPTEN_KEEPALIVE void SetLightDir(int i, float x, float y, float z) { if (i < 0 || i >= g.lightCount) return; g.lights[i].direction = (Vector3){x,y,z}; QueueEdit(EDIT_LIGHT, i, -1); }
+EMSCRIPTEN_KEEPALIVE void SetLightPos(int i, float x, float y, float z) { if (i < 0 || i >= g.lightCount) return; g.lights[i].position = (Vector3){x,y,z}; QueueEdit(EDIT_LIGHT, i, -1); }
+EMSCRIPTEN_KEEPALIVE void SetLightRadius(int i, float val) { if (i < 0 || i >= g.lightCount) return; g.lights[i].radius = val; QueueEdit(EDIT_LIGHT, i, -1); }
 
 EMSCRIPTEN_KEEPALIVE float GetAOStrength(void) { return g.aoStrength; }
 EMSCRIPTEN_KEEPALIVE float GetAORadius(void) { return g.aoRadius; }
 EMSCRIPTEN_KEEPALIVE int   GetToneMapMode(void) { return g.toneMapMode; }
 
-EMSCRIPTEN_KEEPALIVE void SetAOStrength(float val) { g.aoStrength = val; OnRenderSettingsChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetAORadius(float val) { g.aoRadius = val; OnRenderSettingsChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetToneMapMode(int mode) { g.toneMapMode = mode; OnRenderSettingsChanged(); }
+EMSCRIPTEN_KEEPALIVE void SetAOStrength(float val) { g.aoStrength = val; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
+EMSCRIPTEN_KEEPALIVE void SetAORadius(float val) { g.aoRadius = val; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
+EMSCRIPTEN_KEEPALIVE void SetToneMapMode(int mode) { g.toneMapMode = mode; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
 EMSCRIPTEN_KEEPALIVE float GetExposure(void) { return g.exposure; }
-EMSCRIPTEN_KEEPALIVE void SetExposure(float val) { g.exposure = val; OnRenderSettingsChanged(); }
+EMSCRIPTEN_KEEPALIVE void SetExposure(float val) { g.exposure = val; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
 EMSCRIPTEN_KEEPALIVE int GetSPP(void) { return g.samplesPerFrame; }
-EMSCRIPTEN_KEEPALIVE void SetSPP(int val) { g.samplesPerFrame = val > 0 ? val : 1; OnRenderSettingsChanged(); }
+EMSCRIPTEN_KEEPALIVE void SetSPP(int val) { g.samplesPerFrame = val > 0 ? val : 1; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
 EMSCRIPTEN_KEEPALIVE int GetFPSValue(void) { return GetFPS(); }
+
+// Frame-time controller: 1 = samplesPerFrame is tuned every few frames to hold
+// the frame budget (SetSPP only sets its starting point), 0 = fixed slider SPP.
+// Changing spp this way keeps the accumulation.
+EMSCRIPTEN_KEEPALIVE int GetAutoSPP(void) { return g.autoSPP; }
+EMSCRIPTEN_KEEPALIVE void SetAutoSPP(int enabled) { g.autoSPP = enabled ? 1 : 0; g.uiDirty = true; }
+EMSCRIPTEN_KEEPALIVE float GetFrameTimeTarget(void) { return g.frameTimeTarget; }
+EMSCRIPTEN_KEEPALIVE void SetFrameTimeTarget(float ms) {
+    g.frameTimeTarget = fminf(fmaxf(ms, 4.0f), 100.0f);
+    g.uiDirty = true;
+}
+EMSCRIPTEN_KEEPALIVE float GetSamplesPerSecond(void) { return g.samplesPerSecond; }
+// -1 until a timer query came back (never without timer queries: fences only bound it)
+EMSCRIPTEN_KEEPALIVE float GetTraceTimeMs(void) { return g.traceTimeMs; }
+
+// Progressive tiles: 1 = each accumulation step is traced a few tiles per frame
+// within the frame budget (spp stays as set, the controller only sizes batches)
+EMSCRIPTEN_KEEPALIVE int GetTiledRender(void) { return g.tiledRender; }
+EMSCRIPTEN_KEEPALIVE void SetTiledRender(int enabled) { g.tiledRender = enabled ? 1 : 0; g.uiDirty = true; }
+
+// Frozen scene: compiled into the shader on the next frame, after pending
+// edits land; any later scene edit, or 0 here, goes back to the texture path
+EMSCRIPTEN_KEEPALIVE int IsSceneFrozen(void) { return g.sceneFrozen ? 1 : 0; }
+EMSCRIPTEN_KEEPALIVE void SetSceneFrozen(int enabled) { g.freezeScene = enabled ? 1 : 0; g.uiDirty = true; }
 EMSCRIPTEN_KEEPALIVE int GetUncapFPS(void) { return g.uncapFPS; }
 EMSCRIPTEN_KEEPALIVE void SetUncapFPS(int val) {
     g.uncapFPS = val;
-    SetTargetFPS(val ? 0 : 60);
+    if (!g.idlePacing) SetTargetFPS(val ? 0 : 60);   // else restored on wake-up
+    g.uiDirty = true;
 }
 
+// Adaptive sampling applies from the next budget pass on — no accumulation reset
+// (a converged image is re-checked, since stopped tiles may have to resume)
+EMSCRIPTEN_KEEPALIVE int GetAdaptiveSampling(void) { return g.adaptiveSampling; }
+EMSCRIPTEN_KEEPALIVE void SetAdaptiveSampling(int enabled) {
+    g.adaptiveSampling = enabled ? 1 : 0;
+    g.converged = false;
+    g.timeToConverge = -1.0f;
+    g.uiDirty = true;
+}
+EMSCRIPTEN_KEEPALIVE float GetAdaptiveThreshold(void) { return g.adaptiveThreshold; }
+EMSCRIPTEN_KEEPALIVE void SetAdaptiveThreshold(float val) {
+    g.adaptiveThreshold = val > 1e-5f ? val : 1e-5f;
+    g.converged = false;
+    g.timeToConverge = -1.0f;
+    g.uiDirty = true;
+}
+
+// Convergence: the raytrace pass stops once the image's relative noise is
+// under the threshold and resumes on the next change. Lowering the threshold
+// resumes tracing without resetting accumulation.
+EMSCRIPTEN_KEEPALIVE float GetConvergenceThreshold(void) { return g.convergenceThreshold; }
+EMSCRIPTEN_KEEPALIVE void SetConvergenceThreshold(float val) {
+    g.convergenceThreshold = val > 0.0f ? val : 0.0f;
+    if (g.converged && g.convergenceError > g.convergenceThreshold) {
+        g.converged = false;
+        g.timeToConverge = -1.0f;
+    }
+    g.uiDirty = true;
+}
+EMSCRIPTEN_KEEPALIVE int IsConverged(void) { return g.converged ? 1 : 0; }
+EMSCRIPTEN_KEEPALIVE float GetConvergenceError(void) { return g.convergenceError; }
+EMSCRIPTEN_KEEPALIVE float GetTimeToConverge(void) { return g.timeToConverge; }
+EMSCRIPTEN_KEEPALIVE int GetFramesToConverge(void) { return g.converged ? g.framesToConverge : -1; }
+
 EMSCRIPTEN_KEEPALIVE int GetEnvMode(void) { return g.useEnvMap; }
 EMSCRIPTEN_KEEPALIVE float GetEnvIntensity(void) { return g.envIntensity; }
 EMSCRIPTEN_KEEPALIVE float GetEnvRotation(void) { return g.envRotation; }
-EMSCRIPTEN_KEEPALIVE void SetEnvMode(int mode) { g.useEnvMap = mode; OnRenderSettingsChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetEnvIntensity(float val) { g.envIntensity = val; OnRenderSettingsChanged(); }
-EMSCRIPTEN_KEEPALIVE void SetEnvRotation(float val) { g.envRotation = val; OnRenderSettingsChanged(); }
+EMSCRIPTEN_KEEPALIVE void SetEnvMode(int mode) {
+    if (mode == ENV_HDR_MAP && g.envMapTex.id == 0) mode = ENV_GRADIENT;  // nothing loaded yet
+    g.useEnvMap = mode;
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
+}
+EMSCRIPTEN_KEEPALIVE float GetSunDirX(void) { return g.sunDirection.x; }
+EMSCRIPTEN_KEEPALIVE float GetSunDirY(void) { return g.sunDirection.y; }
+EMSCRIPTEN_KEEPALIVE float GetSunDirZ(void) { return g.sunDirection.z; }
+// Re-bakes the sky table (and its sun importance CDF) on the next flush
+EMSCRIPTEN_KEEPALIVE void SetSunDirection(float x, float y, float z) {
+    if (x == 0.0f && y == 0.0f && z == 0.0f) return;
+    g.sunDirection = (Vector3){ x, y, z };
+    g.skyDirty = true;
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
+}
+// Load a Radiance .hdr from the virtual FS (shell.html writes the picked file
+// there) and switch to it. Returns 1 on success.
+EMSCRIPTEN_KEEPALIVE int LoadEnvironmentHDR(const char *path) { return LoadEnvironmentMap(path) ? 1 : 0; }
+EMSCRIPTEN_KEEPALIVE void SetEnvIntensity(float val) { g.envIntensity = val; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
+EMSCRIPTEN_KEEPALIVE void SetEnvRotation(float val) { g.envRotation = val; QueueEdit(EDIT_RENDER_SETTINGS, -1, -1); }
+
+// 0 = one light per hit (default), 1 = all lights with full soft shadows (reference)
+EMSCRIPTEN_KEEPALIVE int GetLightSampling(void) { return g.lightSampling; }
+EMSCRIPTEN_KEEPALIVE void SetLightSampling(int mode) {
+    g.lightSampling = (mode == LIGHT_SAMPLING_ALL) ? LIGHT_SAMPLING_ALL : LIGHT_SAMPLING_ONE;
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
+}
+
+// 0 = Sobol + blue-noise offset (default), 1 = plain PCG random (fallback)
+EMSCRIPTEN_KEEPALIVE int GetSamplerMode(void) { return g.samplerMode; }
+EMSCRIPTEN_KEEPALIVE void SetSamplerMode(int mode) {
+    g.samplerMode = (mode == SAMPLER_PCG) ? SAMPLER_PCG : SAMPLER_SOBOL;
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
+}
+
+// 0 = RGBA32F sum + exact sample count (default), 1 = RGBA16F running mean.
+// Switching recreates the accumulation targets and restarts accumulation.
+EMSCRIPTEN_KEEPALIVE int GetAccumMode(void) { return g.accumMode; }
+EMSCRIPTEN_KEEPALIVE void SetAccumMode(int mode) {
+    g.accumMode = (mode == ACCUM_BLEND_HALF) ? ACCUM_BLEND_HALF : ACCUM_SUM_FLOAT;
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
+}
+
+// Camera motion: 1 = reproject the accumulated history (default), 0 = restart
+EMSCRIPTEN_KEEPALIVE int GetReprojection(void) { return g.reprojection; }
+EMSCRIPTEN_KEEPALIVE void SetReprojection(int enabled) { g.reprojection = enabled ? 1 : 0; g.uiDirty = true; }
+
+// Render scale while orbiting, zooming or dragging (0.5 default, 1 = always
+// full resolution); the first still frame returns to full resolution
+EMSCRIPTEN_KEEPALIVE float GetInteractionScale(void) { return g.interactionScale; }
+EMSCRIPTEN_KEEPALIVE void SetInteractionScale(float scale) {
+    g.interactionScale = fminf(fmaxf(scale, 0.25f), 1.0f);
+    g.uiDirty = true;
+}
 
 EMSCRIPTEN_KEEPALIVE int GetCurrentScene(void) { return g.currentScene; }
 EMSCRIPTEN_KEEPALIVE void SetScene(int scene) {
     g.selectedSphere = -1;
-    g.currentScene = scene;
-    memset(g.prims, 0, sizeof(g.prims));
-    memset(g.lights, 0, sizeof(g.lights));
-    if (scene == SCENE_CORNELL) {
-        LoadCornellBoxScene();
-        g.useEnvMap = 0; // gradient for enclosed scene
-    } else {
-        LoadDefaultScene();
-        g.useEnvMap = 2; // procedural sky
-    }
-    OnSceneChanged();
-    OnRenderSettingsChanged();
+    LoadScenePreset(scene);
+    QueueEdit(EDIT_SCENE_RELOAD, -1, -1);
+    QueueEdit(EDIT_RENDER_SETTINGS, -1, -1);
     UpdateCameraFromAngles();
 }
 
+// Batch edits: `count` records of EDIT_RECORD_FLOATS floats [field, index, a, b, c]
+// (field ids must match EDIT_FIELD in shell.html). One JS->wasm crossing; the
+// whole batch lands in the next FlushEdits. Returns the number of records applied.
+#define EDIT_RECORD_FLOATS 5
+enum {
+    EDIT_FIELD_SPHERE_COLOR, EDIT_FIELD_SPHERE_MATERIAL, EDIT_FIELD_SPHERE_RADIUS,
+    EDIT_FIELD_SPHERE_POSITION, EDIT_FIELD_SPHERE_EMISSION, EDIT_FIELD_SPHERE_EMISSION_STRENGTH,
+    EDIT_FIELD_SPHERE_IOR, EDIT_FIELD_SPHERE_ROUGHNESS, EDIT_FIELD_SPHERE_SPECULAR,
+    EDIT_FIELD_SPHERE_SHININESS,
+    EDIT_FIELD_LIGHT_TYPE, EDIT_FIELD_LIGHT_COLOR, EDIT_FIELD_LIGHT_INTENSITY,
+    EDIT_FIELD_LIGHT_DIR, EDIT_FIELD_LIGHT_POS, EDIT_FIELD_LIGHT_RADIUS,
+    EDIT_FIELD_AO_STRENGTH, EDIT_FIELD_AO_RADIUS, EDIT_FIELD_TONEMAP, EDIT_FIELD_EXPOSURE,
+    EDIT_FIELD_SPP, EDIT_FIELD_ENV_MODE, EDIT_FIELD_ENV_INTENSITY, EDIT_FIELD_ENV_ROTATION,
+    EDIT_FIELD_LIGHT_SAMPLING, EDIT_FIELD_SUN_DIR, EDIT_FIELD_SAMPLER,
+    EDIT_FIELD_ADAPTIVE_SAMPLING, EDIT_FIELD_ADAPTIVE_THRESHOLD, EDIT_FIELD_CONVERGENCE_THRESHOLD,
+    EDIT_FIELD_ACCUM_MODE, EDIT_FIELD_REPROJECTION, EDIT_FIELD_INTERACTION_SCALE,
+    EDIT_FIELD_AUTO_SPP, EDIT_FIELD_FRAME_TIME_TARGET, EDIT_FIELD_TILED_RENDER,
+};
+
+EMSCRIPTEN_KEEPALIVE int ApplyEdits(const float *records, int count) {
+    if (!records) return 0;
+    int applied = 0;
+    for (int n = 0; n < count; n++) {
+        const float *r = &records[n * EDIT_RECORD_FLOATS];
+        int field = (int)r[0], i = (int)r[1];
+        float a = r[2], b = r[3], c = r[4];
+        switch (field) {
+        case EDIT_FIELD_SPHERE_COLOR:             SetSphereColor(i, (int)a, (int)b, (int)c); break;
+        case EDIT_FIELD_SPHERE_MATERIAL:          SetSphereMaterial(i, (int)a); break;
+        case EDIT_FIELD_SPHERE_RADIUS:            SetSphereRadius(i, a); break;
+        case EDIT_FIELD_SPHERE_POSITION:          SetSpherePosition(i, a, b, c); break;
+        case EDIT_FIELD_SPHERE_EMISSION:          SetSphereEmission(i, a, b, c); break;
+        case EDIT_FIELD_SPHERE_EMISSION_STRENGTH: SetSphereEmissionStrength(i, a); break;
+        case EDIT_FIELD_SPHERE_IOR:               SetSphereIOR(i, a); break;
+        case EDIT_FIELD_SPHERE_ROUGHNESS:         SetSphereRoughness(i, a); break;
+        case EDIT_FIELD_SPHERE_SPECULAR:          SetSphereSpecular(i, a); break;
+        case EDIT_FIELD_SPHERE_SHININESS:         SetSphereShininess(i, a); break;
+        case EDIT_FIELD_LIGHT_TYPE:               SetLightType(i, (int)a); break;
+        case EDIT_FIELD_LIGHT_COLOR:              SetLightColor(i, a, b, c); break;
+        case EDIT_FIELD_LIGHT_INTENSITY:          SetLightIntensity(i, a); break;
+        case EDIT_FIELD_LIGHT_DIR:                SetLightDir(i, a, b, c); break;
+        case EDIT_FIELD_LIGHT_POS:                SetLightPos(i, a, b, c); break;
+        case EDIT_FIELD_LIGHT_RADIUS:             SetLightRadius(i, a); break;
+        case EDIT_FIELD_AO_STRENGTH:              SetAOStrength(a); break;
+        case EDIT_FIELD_AO_RADIUS:                SetAORadius(a); break;
+        case EDIT_FIELD_TONEMAP:                  SetToneMapMode((int)a); break;
+        case EDIT_FIELD_EXPOSURE:                 SetExposure(a); break;
+        case EDIT_FIELD_SPP:                      SetSPP((int)a); break;
+        case EDIT_FIELD_ENV_MODE:                 SetEnvMode((int)a); break;
+        case EDIT_FIELD_ENV_INTENSITY:            SetEnvIntensity(a); break;
+        case EDIT_FIELD_ENV_ROTATION:             SetEnvRotation(a); break;
+        case EDIT_FIELD_LIGHT_SAMPLING:           SetLightSampling((int)a); break;
+        case EDIT_FIELD_SUN_DIR:                  SetSunDirection(a, b, c); break;
+        case EDIT_FIELD_SAMPLER:                  SetSamplerMode((int)a); break;
+        case EDIT_FIELD_ADAPTIVE_SAMPLING:        SetAdaptiveSampling((int)a); break;
+        case EDIT_FIELD_ADAPTIVE_THRESHOLD:       SetAdaptiveThreshold(a); break;
+        case EDIT_FIELD_CONVERGENCE_THRESHOLD:    SetConvergenceThreshold(a); break;
+        case EDIT_FIELD_ACCUM_MODE:               SetAccumMode((int)a); break;
+        case EDIT_FIELD_REPROJECTION:             SetReprojection((int)a); break;
+        case EDIT_FIELD_INTERACTION_SCALE:        SetInteractionScale(a); break;
+        case EDIT_FIELD_AUTO_SPP:                 SetAutoSPP((int)a); break;
+        case EDIT_FIELD_FRAME_TIME_TARGET:        SetFrameTimeTarget(a); break;
+        case EDIT_FIELD_TILED_RENDER:             SetTiledRender((int)a); break;
+        default: continue;
+        }
+        applied++;
+    }
+    return applied;
+}
+
+static void SyncUIState(void) {
+    UIState *u = &g.ui;
+    int generation = u->generation + 1;
+    memset(u, 0, sizeof(*u));
+    u->version = UI_STATE_VERSION;
+    u->generation = generation;
+    u->sizeBytes = (int)sizeof(UIState);
+    u->primOffset = (int)(offsetof(UIState, prims) / 4);
+    u->primStride = (int)(sizeof(UIPrimState) / 4);
+    u->lightOffset = (int)(offsetof(UIState, lights) / 4);
+    u->lightStride = (int)(sizeof(UILightState) / 4);
+    u->primCount = g.primCount;
+    u->lightCount = g.lightCount;
+    u->selected = g.selectedSphere;
+    u->currentScene = g.currentScene;
+    u->toneMapMode = g.toneMapMode;
+    u->samplesPerFrame = g.samplesPerFrame;
+    u->uncapFPS = g.uncapFPS;
+    u->envMode = g.useEnvMap;
+    u->aoStrength = g.aoStrength;
+    u->aoRadius = g.aoRadius;
+    u->exposure = g.exposure;
+    u->envIntensity = g.envIntensity;
+    u->envRotation = g.envRotation;
+    u->lightSampling = g.lightSampling;
+    u->sunDirection[0] = g.sunDirection.x;
+    u->sunDirection[1] = g.sunDirection.y;
+    u->sunDirection[2] = g.sunDirection.z;
+    u->samplerMode = g.samplerMode;
+    u->adaptiveSampling = g.adaptiveSampling;
+    u->adaptiveThreshold = g.adaptiveThreshold;
+    u->convergenceThreshold = g.convergenceThreshold;
+    u->converged = g.converged ? 1 : 0;
+    u->convergenceError = g.convergenceError;
+    u->timeToConverge = g.timeToConverge;
+    u->accumMode = g.accumMode;
+    u->reprojection = g.reprojection;
+    u->interactionScale = g.interactionScale;
+    u->autoSPP = g.autoSPP;
+    u->frameTimeTarget = g.frameTimeTarget;
+    u->tiledRender = g.tiledRender;
+    u->sceneFrozen = g.sceneFrozen ? 1 : 0;
+
+    for (int i = 0; i < g.primCount; i++) {
+        const Primitive *p = &g.prims[i];
+        UIPrimState *up = &u->prims[i];
+        up->primType = p->primType;
+        up->material = p->material;
+        up->color[0] = p->color.r; up->color[1] = p->color.g; up->color[2] = p->color.b;
+        up->emission[0] = p->emission.x; up->emission[1] = p->emission.y; up->emission[2] = p->emission.z;
+        up->emissionStrength = p->emissionStrength;
+        up->ior = p->ior;
+        up->roughness = p->roughness;
+        up->specular = p->specular;
+        up->shininess = p->shininess;
+        Vector3 c = GetPrimCenter(i);
+        up->center[0] = c.x; up->center[1] = c.y; up->center[2] = c.z;
+        up->radius = GetPrimRadius(i);
+    }
+    for (int j = 0; j < g.lightCount; j++) {
+        const Light *l = &g.lights[j];
+        UILightState *ul = &u->lights[j];
+        ul->type = l->type;
+        ul->direction[0] = l->direction.x; ul->direction[1] = l->direction.y; ul->direction[2] = l->direction.z;
+        ul->position[0] = l->position.x; ul->position[1] = l->position.y; ul->position[2] = l->position.z;
+        ul->color[0] = l->color.x; ul->color[1] = l->color.y; ul->color[2] = l->color.z;
+        ul->intensity = l->intensity;
+        ul->radius = l->radius;
+    }
+    g.uiDirty = false;
+}
+
+// Pointer + size of the UI state view; re-syncs only if something changed
+EMSCRIPTEN_KEEPALIVE const UIState *GetUIState(void) {
+    if (g.uiDirty) SyncUIState();
+    return &g.ui;
+}
+EMSCRIPTEN_KEEPALIVE int GetUIStateSize(void) { return (int)sizeof(UIState); }
+
 #endif // PLATFORM_WEB
 
 // Ray-sphere for mouse picking
@@ -672,37 +1998,137 @@ static void UpdateCameraFromAngles(void) {
     g.camera.target = g.cameraTarget;
 }
 
-static Shader LoadShaderWithVersion(const char *path) {
-    char *fragCode = LoadFileText(path);
-    if (!fragCode) { printf("ERROR: Could not load %s\n", path); return (Shader){0}; }
-    int fragLen = (int)strlen(fragCode);
+// Fragment source with the #version line for this platform: `defines` (may be
+// NULL) goes right after it, `appendix` (may be NULL) after the bundled code.
+// The code is compiled in (shader_embed.h), so nothing is read from disk or
+// fetched from the preloaded filesystem. RL_FREE the result.
+static char *LoadShaderSource(const char *path, const char *defines, const char *appendix) {
+    const char *fragCode = EmbeddedShaderSource(path);
+    if (!fragCode) { printf("ERROR: %s is not in the shader bundle (make shaders)\n", path); return NULL; }
+    if (!defines) defines = "";
+    if (!appendix) appendix = "";
+    int fragLen = (int)strlen(fragCode) + (int)strlen(defines) + (int)strlen(appendix);
     char *fullFrag = (char *)RL_MALLOC(fragLen + 64);
 #if defined(PLATFORM_WEB)
-    sprintf(fullFrag, "#version 300 es\n%s", fragCode);
+    sprintf(fullFrag, "#version 300 es\n%s%s\n%s", defines, fragCode, appendix);
 #else
-    sprintf(fullFrag, "#version 330\n%s", fragCode);
+    sprintf(fullFrag, "#version 330\n%s%s\n%s", defines, fragCode, appendix);
 #endif
-    UnloadFileText(fragCode);
+    return fullFrag;
+}
+
+static Shader LoadShaderWithVersion(const char *path, const char *defines, const char *appendix) {
+    char *fullFrag = LoadShaderSource(path, defines, appendix);
+    if (!fullFrag) return (Shader){0};
     Shader shader = LoadShaderFromMemory(NULL, fullFrag);
     RL_FREE(fullFrag);
     return shader;
 }
 
-static Texture2D CreateSceneDataTexture(void) {
-    unsigned int texId = rlLoadTexture(NULL, SCENE_TEX_WIDTH, SCENE_TEX_HEIGHT,
+// RGBA32F texture read with texelFetch (scene rows, BVH nodes)
+static Texture2D CreateDataTexture(int width, int height) {
+    unsigned int texId = rlLoadTexture(NULL, width, height,
                                        RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
     rlTextureParameters(texId, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_NEAREST);
     rlTextureParameters(texId, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_NEAREST);
     rlTextureParameters(texId, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_CLAMP);
     rlTextureParameters(texId, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_CLAMP);
-    return (Texture2D){ .id = texId, .width = SCENE_TEX_WIDTH, .height = SCENE_TEX_HEIGHT,
+    return (Texture2D){ .id = texId, .width = width, .height = height,
                         .format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, .mipmaps = 1 };
 }
 
-static void InitApp(void) {
-    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Raytracer — Full Lighting Reference");
-    SetTargetFPS(60);
+// Render texture whose color attachment is swapped for a float texture
+static RenderTexture2D LoadFloatRenderTexture(int width, int height, int format, int filter) {
+    RenderTexture2D rt = LoadRenderTexture(width, height);
+    unsigned int prevId = rt.texture.id;
+    unsigned int newTexId = rlLoadTexture(NULL, width, height, format, 1);
+    rlTextureParameters(newTexId, RL_TEXTURE_MAG_FILTER, filter);
+    rlTextureParameters(newTexId, RL_TEXTURE_MIN_FILTER, filter);
+    rlTextureParameters(newTexId, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_CLAMP);
+    rlTextureParameters(newTexId, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_CLAMP);
+    rlFramebufferAttach(rt.id, newTexId, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+    rlUnloadTexture(prevId);
+    rt.texture.id = newTexId;
+    rt.texture.format = format;   // rlgl and raylib pixel format ids match
+    return rt;
+}
+
+// Ping-pong accumulation targets for the current accumMode — RGBA32F sum +
+// sample count (point-sampled: float32 is not filterable on WebGL2) or RGBA16F
+// running mean — each with the luminance moments as a second color target
+static void LoadAccumTargets(AccumTargets *t, int width, int height) {
+    bool sum = (g.accumMode == ACCUM_SUM_FLOAT);
+    int format = sum ? RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32 : RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16;
+    int filter = sum ? RL_TEXTURE_FILTER_NEAREST : RL_TEXTURE_FILTER_BILINEAR;
+    t->width = width;
+    t->height = height;
+    for (int i = 0; i < 2; i++) {
+        t->color[i] = LoadFloatRenderTexture(width, height, format, filter);
+
+        // Second color target: per-pixel luminance moments + sample count (RGBA32F,
+        // exact counts; read with texelFetch only, so no filtering needed)
+        t->moments[i] = CreateDataTexture(width, height);
+        rlFramebufferAttach(t->color[i].id, t->moments[i].id, RL_ATTACHMENT_COLOR_CHANNEL1,
+                            RL_ATTACHMENT_TEXTURE2D, 0);
+        // Third: first-hit G-buffer for reprojecting the history on camera motion
+        t->gbuffer[i] = CreateDataTexture(width, height);
+        rlFramebufferAttach(t->color[i].id, t->gbuffer[i].id, RL_ATTACHMENT_COLOR_CHANNEL2,
+                            RL_ATTACHMENT_TEXTURE2D, 0);
+        rlEnableFramebuffer(t->color[i].id);
+        rlActiveDrawBuffers(3);
+        if (!rlFramebufferComplete(t->color[i].id))
+            printf("ERROR: %dx%d accumulation framebuffer %d incomplete\n", width, height, i);
+        rlDisableFramebuffer();
+    }
+    t->visibility = LoadFloatRenderTexture(width, height,
+        RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, RL_TEXTURE_FILTER_NEAREST);
+    t->mode = g.accumMode;
+    t->index = 0;
+    t->epoch = -1;   // nothing traced yet
+}
+
+static void UnloadAccumTargets(AccumTargets *t) {
+    for (int i = 0; i < 2; i++) {
+        if (t->color[i].id == 0) continue;
+        UnloadRenderTexture(t->color[i]);
+        rlUnloadTexture(t->moments[i].id);
+        rlUnloadTexture(t->gbuffer[i].id);
+    }
+    if (t->visibility.id != 0) UnloadRenderTexture(t->visibility);
+    *t = (AccumTargets){0};
+}
 
+// (Re)create the reduced-resolution set if the scale or accumMode changed
+static void PrepareScaledTargets(void) {
+    int width = (int)(SCREEN_WIDTH * g.interactionScale + 0.5f);
+    int height = (int)(SCREEN_HEIGHT * g.interactionScale + 0.5f);
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+    if (g.scaled.color[0].id != 0 && g.scaled.width == width && g.scaled.height == height &&
+        g.scaled.mode == g.accumMode) return;
+    UnloadAccumTargets(&g.scaled);
+    LoadAccumTargets(&g.scaled, width, height);
+}
+
+// R32F blue-noise rank tile for the Sobol sampler; id 0 if it could not be built
+static Texture2D CreateBlueNoiseTexture(void) {
+    static float values[BLUE_NOISE_TEXELS];
+    if (BlueNoiseBuild(values) != 0) {
+        printf("ERROR: Could not build the blue-noise tile\n");
+        return (Texture2D){0};
+    }
+    unsigned int texId = rlLoadTexture(values, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE,
+                                       RL_PIXELFORMAT_UNCOMPRESSED_R32, 1);
+    rlTextureParameters(texId, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_NEAREST);
+    rlTextureParameters(texId, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_NEAREST);
+    rlTextureParameters(texId, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_REPEAT);
+    rlTextureParameters(texId, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_REPEAT);
+    return (Texture2D){ .id = texId, .width = BLUE_NOISE_SIZE, .height = BLUE_NOISE_SIZE,
+                        .format = PIXELFORMAT_UNCOMPRESSED_R32, .mipmaps = 1 };
+}
+
+// Default camera, render settings and scene — shared by the window and headless paths
+static void InitDefaults(void) {
     g.camera = (Camera3D){0};
     g.camera.up = (Vector3){0.0f, 1.0f, 0.0f};
     g.camera.fovy = 45.0f;
@@ -710,6 +2136,7 @@ static void InitApp(void) {
 
     g.selectedSphere = -1;
     g.isDragging = false;
+    g.uiDirty = true;
     g.aoRadius = 0.5f;
     g.aoStrength = 0.5f;
     g.toneMapMode = 3; // AgX by default
@@ -719,79 +2146,432 @@ static void InitApp(void) {
     g.useEnvMap = 0;       // gradient by default
     g.envIntensity = 1.0f;
     g.envRotation = 0.0f;
+    g.lightSampling = LIGHT_SAMPLING_ONE;
+    g.samplerMode = SAMPLER_SOBOL;
+    g.accumMode = ACCUM_SUM_FLOAT;
+    g.reprojection = 1;
+    g.interactionScale = INTERACTION_DEFAULT_SCALE;
+    g.autoSPP = 1;
+    g.frameTimeTarget = FRAME_TIME_DEFAULT_TARGET;
+    g.traceTimeMs = -1.0f;
+    g.adaptiveSampling = 1;
+    g.adaptiveThreshold = ADAPTIVE_DEFAULT_THRESHOLD;
+    g.convergenceThreshold = CONVERGENCE_DEFAULT_THRESHOLD;
+    g.convergenceError = -1.0f;
+    g.timeToConverge = -1.0f;
+    g.sunDirection = (Vector3){ 0.6f, 0.12f, -0.7f };  // low golden-hour sun
+    g.skyDirty = true;
 
     // Load default scene
-    g.currentScene = SCENE_DEFAULT;
-    g.useEnvMap = 2; // procedural sky
-    LoadDefaultScene();
+    LoadScenePreset(SCENE_DEFAULT);
     UpdateCameraFromAngles();
+}
 
-    // Load shaders
-    g.shader = LoadShaderWithVersion("shaders/raytrace.glsl");
-    g.displayShader = LoadShaderWithVersion("shaders/display.glsl");
-
-    // Raytrace shader locations
-    g.locTime = GetShaderLocation(g.shader, "time");
-    g.locPrimCount = GetShaderLocation(g.shader, "primCount");
-    g.locLightCount = GetShaderLocation(g.shader, "lightCount");
-    g.camPosLoc = GetShaderLocation(g.shader, "cameraPosition");
-    g.invVpLoc = GetShaderLocation(g.shader, "invViewProj");
-    g.locKLinear = GetShaderLocation(g.shader, "k_linear");
-    g.locKQuadratic = GetShaderLocation(g.shader, "k_quadratic");
-    g.locAORadius = GetShaderLocation(g.shader, "aoRadius");
-    g.locAOStrength = GetShaderLocation(g.shader, "aoStrength");
-    g.locFrameCount = GetShaderLocation(g.shader, "frameCount");
-    g.locAccumTexture = GetShaderLocation(g.shader, "accumTexture");
-    g.locResolution = GetShaderLocation(g.shader, "resolution");
-    g.locSceneData = GetShaderLocation(g.shader, "sceneData");
-    g.locEmissiveCount = GetShaderLocation(g.shader, "emissiveCount");
-    g.locEmissiveIndices = GetShaderLocation(g.shader, "emissiveIndices");
-    g.locSPP = GetShaderLocation(g.shader, "samplesPerFrame");
-    g.locEnvMap = GetShaderLocation(g.shader, "envMap");
-    g.locUseEnvMap = GetShaderLocation(g.shader, "useEnvMap");
-    g.locEnvIntensity = GetShaderLocation(g.shader, "envIntensity");
-    g.locEnvRotation = GetShaderLocation(g.shader, "envRotation");
+static void InitApp(void) {
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Raytracer — Full Lighting Reference");
+    SetTargetFPS(60);
+    InitDefaults();
+
+    // Load shaders. The raytrace variant is picked by OnSceneChanged and
+    // compiles in the background; the preview is shown until it links.
+    ShaderBuildInit(SHADER_CACHE_DIR);   // no program binaries on the web
+    g.displayShader = LoadShaderWithVersion("shaders/display.glsl", NULL, NULL);
+    g.budgetShader = LoadShaderWithVersion("shaders/sample_budget.glsl", NULL, NULL);
+    g.upsampleShader = LoadShaderWithVersion("shaders/upsample.glsl", NULL, NULL);
+    g.visibilityShader = LoadShaderWithVersion("shaders/visibility.glsl", NULL, NULL);
+    g.previewShader = LoadShaderWithVersion("shaders/preview.glsl", NULL, NULL);
+    LoadRaytraceLocations();   // all -1 until the first variant links
+
+    // Upsample shader locations
+    g.locUpsampleLowGBuffer = GetShaderLocation(g.upsampleShader, "lowGBuffer");
+    g.locUpsampleGuide = GetShaderLocation(g.upsampleShader, "guideGBuffer");
+    g.locUpsampleCamPos = GetShaderLocation(g.upsampleShader, "cameraPosition");
+
+    // Visibility shader locations
+    g.locVisGeomData = GetShaderLocation(g.visibilityShader, "geomData");
+    g.locVisCamPos = GetShaderLocation(g.visibilityShader, "cameraPosition");
+    g.locVisInvViewProj = GetShaderLocation(g.visibilityShader, "invViewProj");
+    g.locVisResolution = GetShaderLocation(g.visibilityShader, "resolution");
+
+    // Preview shader locations
+    g.locPreviewGeomData = GetShaderLocation(g.previewShader, "geomData");
+    g.locPreviewSceneData = GetShaderLocation(g.previewShader, "sceneData");
+    g.locPreviewCamPos = GetShaderLocation(g.previewShader, "cameraPosition");
+    g.locPreviewInvViewProj = GetShaderLocation(g.previewShader, "invViewProj");
+    g.locPreviewResolution = GetShaderLocation(g.previewShader, "resolution");
+
+    // Sample budget shader locations
+    g.locBudgetSPP = GetShaderLocation(g.budgetShader, "samplesPerFrame");
+    g.locBudgetThreshold = GetShaderLocation(g.budgetShader, "adaptiveThreshold");
 
     // Display shader locations
     g.locDisplayToneMap = GetShaderLocation(g.displayShader, "toneMapMode");
     g.locDisplayExposure = GetShaderLocation(g.displayShader, "exposure");
 
-    // Set static uniforms
-    float kLinear = 0.09f, kQuadratic = 0.032f;
-    if (g.locKLinear != -1) SetShaderValue(g.shader, g.locKLinear, &kLinear, SHADER_UNIFORM_FLOAT);
-    if (g.locKQuadratic != -1) SetShaderValue(g.shader, g.locKQuadratic, &kQuadratic, SHADER_UNIFORM_FLOAT);
-    float res[2] = {(float)SCREEN_WIDTH, (float)SCREEN_HEIGHT};
-    if (g.locResolution != -1) SetShaderValue(g.shader, g.locResolution, res, SHADER_UNIFORM_VEC2);
+    g.blueNoiseTex = CreateBlueNoiseTexture();
 
-    // Create scene data texture
-    g.sceneDataTex = CreateSceneDataTexture();
+    // Create geometry, scene data and BVH node textures
+    g.geomDataTex = CreateDataTexture(GEOM_TEX_WIDTH, MAX_PRIMS);
+    g.sceneDataTex = CreateDataTexture(SCENE_TEX_WIDTH, SCENE_TEX_HEIGHT);
+    g.bvhDataTex = CreateDataTexture(BVH_TEX_WIDTH, BVH_MAX_NODES);
     OnSceneChanged();
     OnRenderSettingsChanged();
 
-    g.targetTexture = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);
+    LoadAccumTargets(&g.full, SCREEN_WIDTH, SCREEN_HEIGHT);
+    g.active = &g.full;
+    g.shownSet = &g.full;
+    g.guideTarget = LoadFloatRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT,
+        RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, RL_TEXTURE_FILTER_NEAREST);
+    g.upscaleTarget = LoadFloatRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT,
+        RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, RL_TEXTURE_FILTER_BILINEAR);
 
-    // RGBA16F accumulation textures
-    for (int i = 0; i < 2; i++) {
-        g.accumTexture[i] = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);
-        unsigned int prevId = g.accumTexture[i].texture.id;
-        unsigned int newTexId = rlLoadTexture(NULL, SCREEN_WIDTH, SCREEN_HEIGHT,
-                                              RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, 1);
-        rlTextureParameters(newTexId, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_BILINEAR);
-        rlTextureParameters(newTexId, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_BILINEAR);
-        rlTextureParameters(newTexId, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_CLAMP);
-        rlTextureParameters(newTexId, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_CLAMP);
-        rlFramebufferAttach(g.accumTexture[i].id, newTexId, RL_ATTACHMENT_COLOR_CHANNEL0,
-                            RL_ATTACHMENT_TEXTURE2D, 0);
-        rlUnloadTexture(prevId);
-        g.accumTexture[i].texture.id = newTexId;
-        g.accumTexture[i].texture.format = PIXELFORMAT_UNCOMPRESSED_R16G16B16A16;
-    }
+    // Per-tile sample budget, written by sample_budget.glsl and read with texelFetch
+    g.budgetTarget = LoadRenderTexture(BUDGET_TILES_X, BUDGET_TILES_Y);
+    GpuTimerInit(&g.traceTimer);
 
-    g.accumIndex = 0;
     g.frameCount = 0;
     g.prevCamPos = g.camera.position;
 }
 
+// Reduce the budget target (read back as RGBA8: R = tile spp, G/B = tile error
+// in 16-bit fixed point) to the image's mean relative variance. Converged when
+// its square root is under the threshold, or when adaptive sampling has
+// stopped every tile anyway. The read-back syncs with the GPU, hence the
+// CONVERGENCE_CHECK_INTERVAL.
+static void CheckConvergence(int adaptiveActive) {
+    Image budget = LoadImageFromTexture(g.budgetTarget.texture);
+    if (budget.data == NULL) return;
+    const unsigned char *texels = (const unsigned char *)budget.data;
+    double relVarSum = 0.0;
+    int tiles = budget.width * budget.height, tracing = 0;
+    for (int i = 0; i < tiles; i++) {
+        const unsigned char *t = &texels[i * 4];
+        double tileError = (double)(t[1] * 256 + t[2]) / 65535.0;
+        relVarSum += tileError * tileError;
+        if (t[0] > 0) tracing++;
+    }
+    UnloadImage(budget);
+
+    g.convergenceError = tiles > 0 ? (float)sqrt(relVarSum / tiles) : -1.0f;
+    g.uiDirty = true;
+    if (g.convergenceError <= g.convergenceThreshold || (adaptiveActive && tracing == 0)) {
+        g.converged = true;
+        if (g.timeToConverge < 0.0f) {
+            g.timeToConverge = (float)(GetTime() - g.convergeStartTime);
+            g.framesToConverge = g.frameCount;
+        }
+    }
+}
+
+// Count this frame's samples and, when a timed pass has come back, steer
+// samplesPerFrame so the raytrace pass fits the frame budget. The cost model is
+// ms per sample per pixel, so it carries over between full and reduced
+// resolution and a result a few frames old still predicts this frame's pass;
+// hysteresis keeps spp steady while the prediction is within the band.
+// Fence bounds (no timer queries) carry no time: spp drops when a pass ran
+// over two frames and rises after FENCE_RAISE_STREAK passes in a row finished
+// by the first poll; traceTimeMs stays -1 and sampleCost unmeasured.
+static void UpdateSampleRate(int spp, int pixels) {
+    double now = GetTime();
+    g.sampleWindowCount += (double)spp * pixels;
+    if (now - g.sampleWindowStart >= SAMPLE_RATE_WINDOW) {
+        g.samplesPerSecond = (float)(g.sampleWindowCount / (now - g.sampleWindowStart));
+        g.sampleWindowStart = now;
+        g.sampleWindowCount = 0.0;
+    }
+    double ms, samples;
+    GpuTimeKind kind;
+    if (!GpuTimerPoll(&g.traceTimer, &ms, &samples, &kind) || samples <= 0.0) return;
+    if (kind != GPU_TIME_MEASURED) {
+        if (g.tiledRender || pixels == 0) return;
+        int next = spp;
+        if (kind == GPU_TIME_OVER_FRAME) {
+            g.fenceFastStreak = 0;
+            next = (int)(spp / SPP_MAX_STEP_UP);
+            if (next > spp - 1) next = spp - 1;
+            if (next < 1) next = 1;
+        } else if (++g.fenceFastStreak >= FENCE_RAISE_STREAK) {
+            g.fenceFastStreak = 0;
+            next = (int)(spp * SPP_MAX_STEP_UP);
+            if (next < spp + 1) next = spp + 1;
+            if (next > 64) next = 64;
+        }
+        if (next != g.samplesPerFrame) {
+            g.samplesPerFrame = next;
+            if (g.locSPP != -1) SetShaderValue(g.shader, g.locSPP, &g.samplesPerFrame, SHADER_UNIFORM_INT);
+            g.uiDirty = true;
+        }
+        return;
+    }
+
+    g.traceTimeMs = (float)ms;
+    double cost = ms / samples;
+    g.sampleCost = (g.sampleCost > 0.0) ? 0.5 * g.sampleCost + 0.5 * cost : cost;
+    if (g.tiledRender || pixels == 0) return;   // tiles keep the user's spp and spread it over frames instead
+    float budget = g.frameTimeTarget * FRAME_TIME_TRACE_SHARE;
+    double predicted = g.sampleCost * spp * pixels;   // this frame's pass
+    int want = (int)(budget / (g.sampleCost * pixels));
+    if (want < 1) want = 1;
+    if (want > 64) want = 64;
+
+    int next = spp;
+    if (predicted > budget * SPP_HYSTERESIS_HIGH && want < spp) {
+        next = want;
+    } else if (predicted < budget * SPP_HYSTERESIS_LOW && want > spp) {
+        int step = (int)(spp * SPP_MAX_STEP_UP);
+        if (step < spp + 1) step = spp + 1;
+        next = want < step ? want : step;
+    }
+    if (next != g.samplesPerFrame) {
+        g.samplesPerFrame = next;
+        if (g.locSPP != -1) SetShaderValue(g.shader, g.locSPP, &g.samplesPerFrame, SHADER_UNIFORM_INT);
+        g.uiDirty = true;
+    }
+}
+
+// Bind the raytrace shader's inputs. raylib's batch releases its texture slots
+// on every flush, so this is repeated before each scissored tile.
+static void BindTraceInputs(Texture2D prevAccum, Texture2D prevMoments, Texture2D prevGBuffer) {
+    if (g.locSceneData != -1) SetShaderValueTexture(g.shader, g.locSceneData, g.sceneDataTex);
+    if (g.locBvhData != -1) SetShaderValueTexture(g.shader, g.locBvhData, g.bvhDataTex);
+    Texture2D envTex, envCdfTex;
+    if (ActiveEnvMap(&envTex, &envCdfTex)) {
+        if (g.locEnvMap != -1) SetShaderValueTexture(g.shader, g.locEnvMap, envTex);
+        rlActiveTextureSlot(ENV_CDF_TEXTURE_UNIT);
+        rlEnableTexture(envCdfTex.id);
+        rlActiveTextureSlot(0);
+    }
+    if (g.blueNoiseTex.id > 0) {
+        rlActiveTextureSlot(BLUE_NOISE_TEXTURE_UNIT);
+        rlEnableTexture(g.blueNoiseTex.id);
+        rlActiveTextureSlot(0);
+    }
+    rlActiveTextureSlot(MOMENTS_TEXTURE_UNIT);
+    rlEnableTexture(prevMoments.id);
+    rlActiveTextureSlot(SAMPLE_BUDGET_TEXTURE_UNIT);
+    rlEnableTexture(g.budgetTarget.texture.id);
+    rlActiveTextureSlot(GBUFFER_TEXTURE_UNIT);
+    rlEnableTexture(prevGBuffer.id);
+    rlActiveTextureSlot(GEOMETRY_TEXTURE_UNIT);
+    rlEnableTexture(g.geomDataTex.id);
+    rlActiveTextureSlot(0);
+    if (g.locAccumTexture != -1)
+        SetShaderValueTexture(g.shader, g.locAccumTexture, prevAccum);
+}
+
+// Pixel rectangle of TRACE_TILE_SIZE tile `tile` in a width x height target
+// (framebuffer coordinates, origin bottom-left like gl_FragCoord)
+static void TraceTileRect(int tile, int width, int height, int *x, int *y, int *w, int *h) {
+    int tilesX = (width + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE;
+    *x = (tile % tilesX) * TRACE_TILE_SIZE;
+    *y = (tile / tilesX) * TRACE_TILE_SIZE;
+    *w = (*x + TRACE_TILE_SIZE <= width) ? TRACE_TILE_SIZE : width - *x;
+    *h = (*y + TRACE_TILE_SIZE <= height) ? TRACE_TILE_SIZE : height - *y;
+}
+
+// Run the raytrace shader over `target` (its size sets the resolution) with
+// `set`'s latest step as history and its visibility pre-pass as the canvas;
+// gbufferOnly writes just the first-hit G-buffer as color. With tiles, only
+// those TRACE_TILE_SIZE tiles are shaded (one scissored draw each); NULL
+// shades the whole target.
+static void TraceToTarget(RenderTexture2D target, const AccumTargets *set, int gbufferOnly,
+                          const int *tiles, int tileCount) {
+    int width = target.texture.width, height = target.texture.height;
+    float res[2] = {(float)width, (float)height};
+    Texture2D canvas = set->visibility.texture;
+    int useVisibility = g.visibilityValid && canvas.width == width && canvas.height == height;
+    if (g.locResolution != -1) SetShaderValue(g.shader, g.locResolution, res, SHADER_UNIFORM_VEC2);
+    if (g.locGBufferOnly != -1) SetShaderValue(g.shader, g.locGBufferOnly, &gbufferOnly, SHADER_UNIFORM_INT);
+    if (g.locUseVisibility != -1) SetShaderValue(g.shader, g.locUseVisibility, &useVisibility, SHADER_UNIFORM_INT);
+    if (tiles == NULL) tileCount = 1;
+    BeginTextureMode(target);
+        rlDisableColorBlend();
+        BeginShaderMode(g.shader);
+            for (int i = 0; i < tileCount; i++) {
+                if (tiles != NULL) {
+                    int x, y, w, h;
+                    TraceTileRect(tiles[i], width, height, &x, &y, &w, &h);
+                    rlDrawRenderBatchActive();
+                    rlEnableScissorTest();
+                    rlScissor(x, y, w, h);
+                }
+                BindTraceInputs(set->color[set->index].texture, set->moments[set->index],
+                                set->gbuffer[set->index]);
+                DrawTexturePro(canvas, (Rectangle){0, 0, (float)canvas.width, (float)-canvas.height},
+                    (Rectangle){0, 0, res[0], res[1]}, (Vector2){0, 0}, 0.0f, WHITE);
+            }
+        EndShaderMode();
+        rlDisableScissorTest();
+        rlEnableColorBlend();
+    EndTextureMode();
+}
+
+// Visibility pre-pass into `set->visibility`: every primitive rasterized with
+// its index + 1 as vertex color — quads and triangles as they are (two-sided),
+// spheres as camera-facing quads on their tangent circle's plane, which
+// visibility.glsl trims to the exact sphere. False when the camera is inside a
+// sphere or grazing one closer than the near plane (no impostor can stand for
+// it): the step then traces primary rays.
+static bool RasterizeVisibility(AccumTargets *set, Matrix invViewProj) {
+    bool valid = true;
+    float res[2] = {(float)set->width, (float)set->height};
+    Vector3 cam = g.camera.position;
+    BeginTextureMode(set->visibility);
+        ClearBackground(BLANK);
+        rlDisableColorBlend();     // float32 target
+        rlDisableBackfaceCulling();
+        BeginMode3D(g.camera);
+            BeginShaderMode(g.visibilityShader);
+                if (g.locVisCamPos != -1) SetShaderValue(g.visibilityShader, g.locVisCamPos, &cam, SHADER_UNIFORM_VEC3);
+                if (g.locVisInvViewProj != -1) SetShaderValueMatrix(g.visibilityShader, g.locVisInvViewProj, invViewProj);
+                if (g.locVisResolution != -1) SetShaderValue(g.visibilityShader, g.locVisResolution, res, SHADER_UNIFORM_VEC2);
+                if (g.locVisGeomData != -1) SetShaderValueTexture(g.visibilityShader, g.locVisGeomData, g.geomDataTex);
+                rlBegin(RL_TRIANGLES);
+                for (int i = 0; i < g.primCount; i++) {
+                    const float *p = g.prims[i].geom;
+                    Vector3 v[4];
+                    if (g.prims[i].primType == PRIM_SPHERE) {
+                        Vector3 c = {p[0], p[1], p[2]};
+                        float r = p[3];
+                        Vector3 w = Vector3Subtract(c, cam);
+                        float d = Vector3Length(w);
+                        if (d <= r * 1.001f) { valid = false; continue; }
+                        // Silhouette: the circle where the tangent cone touches
+                        // the sphere. Its plane lies behind every visible point
+                        // but no farther than the tangent length, so the quad
+                        // stays inside the frustum even for a huge sphere seen
+                        // from just above (ground near the horizon); a plane
+                        // through c would sit far past the far clip plane.
+                        float tangentDist = d - r * r / d;
+                        if (tangentDist <= RL_CULL_DISTANCE_NEAR * 2.0f) { valid = false; continue; }
+                        float s = r * sqrtf(d * d - r * r) / d * 1.02f;
+                        Vector3 fwd = Vector3Scale(w, 1.0f / d);
+                        c = Vector3Add(cam, Vector3Scale(fwd, tangentDist));
+                        Vector3 helper = fabsf(fwd.y) < 0.99f ? (Vector3){0, 1, 0} : (Vector3){1, 0, 0};
+                        Vector3 right = Vector3Scale(Vector3Normalize(Vector3CrossProduct(fwd, helper)), s);
+                        Vector3 up = Vector3Scale(Vector3Normalize(Vector3CrossProduct(right, fwd)), s);
+                        v[0] = Vector3Subtract(Vector3Subtract(c, right), up);
+                        v[1] = Vector3Subtract(Vector3Add(c, right), up);
+                        v[2] = Vector3Add(Vector3Add(c, right), up);
+                        v[3] = Vector3Add(Vector3Subtract(c, right), up);
+                    } else if (g.prims[i].primType == PRIM_QUAD) {
+                        Vector3 q = {p[0], p[1], p[2]}, u = {p[4], p[5], p[6]}, w = {p[8], p[9], p[10]};
+                        v[0] = q;
+                        v[1] = Vector3Add(q, u);
+                        v[2] = Vector3Add(Vector3Add(q, u), w);
+                        v[3] = Vector3Add(q, w);
+                    } else {
+                        v[0] = (Vector3){p[0], p[1], p[2]};
+                        v[1] = (Vector3){p[4], p[5], p[6]};
+                        v[2] = (Vector3){p[8], p[9], p[10]};
+                    }
+                    rlColor4ub((unsigned char)(g.primRow[i] + 1), 0, 0, 255);
+                    rlVertex3f(v[0].x, v[0].y, v[0].z);
+                    rlVertex3f(v[1].x, v[1].y, v[1].z);
+                    rlVertex3f(v[2].x, v[2].y, v[2].z);
+                    if (g.prims[i].primType != PRIM_TRIANGLE) {
+                        rlVertex3f(v[0].x, v[0].y, v[0].z);
+                        rlVertex3f(v[2].x, v[2].y, v[2].z);
+                        rlVertex3f(v[3].x, v[3].y, v[3].z);
+                    }
+                }
+                rlEnd();
+            EndShaderMode();
+        EndMode3D();
+        rlEnableBackfaceCulling();
+        rlEnableColorBlend();
+    EndTextureMode();
+    return valid;
+}
+
+// Order the tiles of a width x height target centre-first: the middle of the
+// screen, where the user is looking, refines before the borders
+static int BuildTileOrder(int width, int height) {
+    int tilesX = (width + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE;
+    int tilesY = (height + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE;
+    int count = tilesX * tilesY;
+    float dist[MAX_TRACE_TILES];
+    for (int i = 0; i < count; i++) {
+        float dx = ((i % tilesX) + 0.5f) * TRACE_TILE_SIZE - width * 0.5f;
+        float dy = ((i / tilesX) + 0.5f) * TRACE_TILE_SIZE - height * 0.5f;
+        float d = dx * dx + dy * dy;
+        int j = i;
+        for (; j > 0 && dist[j - 1] > d; j--) {   // insertion sort, a few dozen tiles
+            dist[j] = dist[j - 1];
+            g.tileOrder[j] = g.tileOrder[j - 1];
+        }
+        dist[j] = d;
+        g.tileOrder[j] = i;
+    }
+    return count;
+}
+
+// Stand-in while the raytrace program compiles: the visibility pre-pass at
+// full resolution, shaded flat by preview.glsl straight to the screen
+static void DrawShaderPreview(void) {
+    Matrix view = GetCameraMatrix(g.camera);
+    float aspect = (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT;
+    Matrix proj = MatrixPerspective(g.camera.fovy * DEG2RAD, aspect, 0.1f, 100.0f);
+    Matrix invViewProj = MatrixInvert(MatrixMultiply(view, proj));
+    RasterizeVisibility(&g.full, invViewProj);   // the next trace step redoes it
+
+    float res[2] = {(float)SCREEN_WIDTH, (float)SCREEN_HEIGHT};
+    Texture2D vis = g.full.visibility.texture;
+    BeginDrawing();
+        ClearBackground(BLACK);
+        BeginShaderMode(g.previewShader);
+            if (g.locPreviewCamPos != -1) SetShaderValue(g.previewShader, g.locPreviewCamPos, &g.camera.position, SHADER_UNIFORM_VEC3);
+            if (g.locPreviewInvViewProj != -1) SetShaderValueMatrix(g.previewShader, g.locPreviewInvViewProj, invViewProj);
+            if (g.locPreviewResolution != -1) SetShaderValue(g.previewShader, g.locPreviewResolution, res, SHADER_UNIFORM_VEC2);
+            if (g.locPreviewGeomData != -1) SetShaderValueTexture(g.previewShader, g.locPreviewGeomData, g.geomDataTex);
+            if (g.locPreviewSceneData != -1) SetShaderValueTexture(g.previewShader, g.locPreviewSceneData, g.sceneDataTex);
+            DrawTextureRec(vis, (Rectangle){0, 0, (float)vis.width, (float)-vis.height}, (Vector2){0, 0}, WHITE);
+        EndShaderMode();
+        DrawText(g.rtBuild.state == SHADER_BUILD_PENDING ? "Compiling shaders..." : "Raytrace shader failed to compile",
+                 10, 36, 20, WHITE);
+        DrawFPS(10, 10);
+    EndDrawing();
+}
+
+// Display pass: the last complete step, with the finished tiles of a
+// full-resolution step in progress (traced into `partial`) drawn over it
+static void PresentFrame(bool showPartial, Texture2D partial) {
+    Texture2D shown = (g.shownSet == &g.scaled) ? g.upscaleTarget.texture
+                                                : g.full.color[g.full.index].texture;
+    BeginDrawing();
+        ClearBackground(BLACK);
+        BeginShaderMode(g.displayShader);
+            DrawTextureRec(shown,
+                (Rectangle){0, 0, (float)shown.width, (float)-shown.height},
+                (Vector2){0, 0}, WHITE);
+            if (showPartial) {
+                for (int i = 0; i < g.tilesDone; i++) {
+                    int x, y, w, h;
+                    TraceTileRect(g.tileOrder[i], SCREEN_WIDTH, SCREEN_HEIGHT, &x, &y, &w, &h);
+                    DrawTexturePro(partial, (Rectangle){(float)x, (float)y, (float)w, (float)-h},
+                        (Rectangle){(float)x, (float)(SCREEN_HEIGHT - y - h), (float)w, (float)h},
+                        (Vector2){0, 0}, 0.0f, WHITE);
+                }
+            }
+        EndShaderMode();
+        DrawFPS(10, 10);
+    EndDrawing();
+}
+
+// Converged: run the loop at CONVERGED_IDLE_FPS instead of the render rate
+// (on the web by timer instead of every animation frame); restored as soon as
+// a frame traces or previews again
+static void SetIdlePacing(bool idle) {
+    if (idle == g.idlePacing) return;
+    g.idlePacing = idle;
+#if defined(PLATFORM_WEB)
+    if (idle) emscripten_set_main_loop_timing(EM_TIMING_SETTIMEOUT, 1000 / CONVERGED_IDLE_FPS);
+    else emscripten_set_main_loop_timing(EM_TIMING_RAF, 1);
+#else
+    SetTargetFPS(idle ? CONVERGED_IDLE_FPS : (g.uncapFPS ? 0 : 60));
+#endif
+}
+
 static void UpdateDrawFrame(void) {
     // Camera orbit
     if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
@@ -838,6 +2618,7 @@ static void UpdateDrawFrame(void) {
             if (t > 0.0f && t < closestT) { closestT = t; closestIdx = i; }
         }
         g.selectedSphere = closestIdx;
+        g.uiDirty = true;
         g.isDragging = (closestIdx != -1);
     }
 
@@ -855,94 +2636,330 @@ static void UpdateDrawFrame(void) {
                 g.prims[g.selectedSphere].geom[0] += right.x * delta.x * mf + up.x * (-delta.y) * mf;
                 g.prims[g.selectedSphere].geom[1] += right.y * delta.x * mf + up.y * (-delta.y) * mf;
                 g.prims[g.selectedSphere].geom[2] += right.z * delta.x * mf + up.z * (-delta.y) * mf;
+                QueueEdit(EDIT_PRIM_GEOMETRY, g.selectedSphere, -1);
             }
-            OnSceneChanged();
         }
     }
 
-    // Camera change detection
+    // Apply this frame's queued edits (JS setters + drag) in one upload
+    FlushEdits();
+    if (g.freezeScene && !g.sceneFrozen && g.rtBuild.state != SHADER_BUILD_PENDING) {
+        FreezeScene();   // after any variant build, so the two never race
+    } else if (!g.freezeScene && (g.sceneFrozen || g.rtBuildFrozen)) {
+        ThawScene();
+        SelectRaytraceVariant();
+    }
+    PollRaytraceBuild();
+    if (g.shader.id == 0) {
+        SetIdlePacing(false);
+        DrawShaderPreview();
+        return;
+    }
+    // An edit reset throws away the history of both resolutions
+    int editReset = (g.frameCount == 0);
+    if (editReset) g.historyEpoch++;
+
+    // Camera change detection. The shader reprojects the old view's history
+    // (frameCount still restarts: warm-up, AO and convergence start over)
+    // unless an edit has already thrown it away.
+    int moved = 0;
     if (g.camera.position.x != g.prevCamPos.x ||
         g.camera.position.y != g.prevCamPos.y ||
         g.camera.position.z != g.prevCamPos.z) {
+        moved = 1;
         g.frameCount = 0;
         g.prevCamPos = g.camera.position;
     }
 
-    g.frameCount++;
-    if (g.locFrameCount != -1)
-        SetShaderValue(g.shader, g.locFrameCount, &g.frameCount, SHADER_UNIFORM_INT);
-    float t = (float)GetTime();
-    if (g.locTime != -1) SetShaderValue(g.shader, g.locTime, &t, SHADER_UNIFORM_FLOAT);
+    // Dynamic resolution: trace the reduced set while the user orbits, zooms
+    // or drags and the image is changing under them; the first still frame
+    // goes back to full resolution, picking up its own (reprojected) history
+    if (wheel != 0.0f) g.lastWheelTime = GetTime();
+    int interacting = g.isDragging || IsMouseButtonDown(MOUSE_BUTTON_RIGHT) ||
+        GetTime() - g.lastWheelTime < WHEEL_INTERACTION_HOLD;
+    int useScaled = interacting && g.interactionScale < 1.0f &&
+        (g.active == &g.scaled || moved || editReset);
+    if (useScaled) PrepareScaledTargets();
+    AccumTargets *set = useScaled ? &g.scaled : &g.full;
+    int switched = (set != g.active);
+    if (switched || set->epoch < 0) g.frameCount = 0;   // other set, or just (re)created
+    int reproject = (moved || switched) && g.reprojection && set->epoch == g.historyEpoch;
+
+    // A tiled accumulation step may span several displayed frames; anything
+    // that resets frameCount abandons it and starts a new one
+    int stepping = g.tilesDone < g.tileCount;
+    if (g.frameCount == 0) {
+        // Accumulation restarted (edit, camera move, settings): noisy again
+        if (g.converged || g.timeToConverge >= 0.0f) g.uiDirty = true;
+        g.converged = false;
+        g.convergenceError = -1.0f;
+        g.timeToConverge = -1.0f;
+        g.convergeStartTime = GetTime();
+    } else if (g.converged && !stepping) {
+        // Nothing changed since convergence: no tracing, only the display pass
+        // of the last frame at a low rate, so the window survives expose and
+        // resize and raylib's swap, input polling and frame timing keep going
+        SetIdlePacing(true);
+        UpdateSampleRate(0, 0);
+        PresentFrame(false, (Texture2D){ 0 });
+        return;
+    }
+    SetIdlePacing(false);
 
-    // Rasterize (canvas for shader)
-    BeginTextureMode(g.targetTexture);
-        ClearBackground(LIGHTGRAY);
-        BeginMode3D(g.camera);
-            for (int i = 0; i < g.primCount; i++) {
-                if (g.prims[i].primType == PRIM_SPHERE) {
-                    Vector3 c = GetPrimCenter(i);
-                    DrawSphere(c, GetPrimRadius(i), g.prims[i].color);
-                }
-            }
-            if (g.selectedSphere >= 0 && g.selectedSphere < g.primCount &&
-                g.prims[g.selectedSphere].primType == PRIM_SPHERE) {
-                Vector3 c = GetPrimCenter(g.selectedSphere);
-                DrawSphereWires(c, GetPrimRadius(g.selectedSphere) + 0.02f, 8, 8, YELLOW);
-            }
-            DrawGrid(10, 1.0f);
-        EndMode3D();
-    EndTextureMode();
+    if (g.frameCount == 0 || !stepping) {
+        g.frameCount++;
+        if (g.locFrameCount != -1)
+            SetShaderValue(g.shader, g.locFrameCount, &g.frameCount, SHADER_UNIFORM_INT);
+        float t = (float)GetTime();
+        if (g.locTime != -1) SetShaderValue(g.shader, g.locTime, &t, SHADER_UNIFORM_FLOAT);
 
-    // Camera uniforms
-    Matrix view = GetCameraMatrix(g.camera);
-    float aspect = (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT;
-    Matrix proj = MatrixPerspective(g.camera.fovy * DEG2RAD, aspect, 0.1f, 100.0f);
-    Matrix invViewProj = MatrixInvert(MatrixMultiply(view, proj));
-    if (g.camPosLoc != -1) SetShaderValue(g.shader, g.camPosLoc, &g.camera.position, SHADER_UNIFORM_VEC3);
-    if (g.invVpLoc != -1) SetShaderValueMatrix(g.shader, g.invVpLoc, invViewProj);
+        // Camera uniforms (they stay bound for every tile of the step)
+        Matrix view = GetCameraMatrix(g.camera);
+        float aspect = (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT;
+        Matrix proj = MatrixPerspective(g.camera.fovy * DEG2RAD, aspect, 0.1f, 100.0f);
+        g.stepViewProj = MatrixMultiply(view, proj);
+        Matrix invViewProj = MatrixInvert(g.stepViewProj);
+        if (g.camPosLoc != -1) SetShaderValue(g.shader, g.camPosLoc, &g.camera.position, SHADER_UNIFORM_VEC3);
+        if (g.invVpLoc != -1) SetShaderValueMatrix(g.shader, g.invVpLoc, invViewProj);
+        if (g.locPrevViewProj != -1) SetShaderValueMatrix(g.shader, g.locPrevViewProj, set->viewProj);
+        if (g.locReprojectFrame != -1) SetShaderValue(g.shader, g.locReprojectFrame, &reproject, SHADER_UNIFORM_INT);
+
+        // Sample budget pass: once warmed up, last step's moments decide how many
+        // samples each tile takes in this one (0 = converged) and feed the
+        // convergence check. Full resolution only: the reduced set is transient.
+        int warmedUp = !useScaled && g.frameCount > ADAPTIVE_WARMUP_FRAMES;
+        int adaptiveActive = g.adaptiveSampling && warmedUp;
+        int checkConvergence = g.convergenceThreshold > 0.0f && warmedUp &&
+            (g.frameCount - ADAPTIVE_WARMUP_FRAMES) % CONVERGENCE_CHECK_INTERVAL == 0;
+        if (adaptiveActive || checkConvergence) {
+            if (g.locBudgetSPP != -1)
+                SetShaderValue(g.budgetShader, g.locBudgetSPP, &g.samplesPerFrame, SHADER_UNIFORM_INT);
+            if (g.locBudgetThreshold != -1)
+                SetShaderValue(g.budgetShader, g.locBudgetThreshold, &g.adaptiveThreshold, SHADER_UNIFORM_FLOAT);
+            BeginTextureMode(g.budgetTarget);
+                BeginShaderMode(g.budgetShader);
+                    DrawTextureRec(set->moments[set->index],
+                        (Rectangle){0, 0, (float)BUDGET_TILES_X, (float)BUDGET_TILES_Y},
+                        (Vector2){0, 0}, WHITE);
+                EndShaderMode();
+            EndTextureMode();
+            // This step still renders; the frames after it idle
+            if (checkConvergence) CheckConvergence(adaptiveActive);
+        }
+        if (g.locAdaptiveSampling != -1)
+            SetShaderValue(g.shader, g.locAdaptiveSampling, &adaptiveActive, SHADER_UNIFORM_INT);
 
-    // Raytrace pass
-    int readIdx = g.accumIndex;
-    int writeIdx = 1 - g.accumIndex;
-    BeginTextureMode(g.accumTexture[writeIdx]);
-        BeginShaderMode(g.shader);
-            if (g.locSceneData != -1) SetShaderValueTexture(g.shader, g.locSceneData, g.sceneDataTex);
-            if (g.locEnvMap != -1 && g.envMapTex.id > 0)
-                SetShaderValueTexture(g.shader, g.locEnvMap, g.envMapTex);
-            if (g.locAccumTexture != -1)
-                SetShaderValueTexture(g.shader, g.locAccumTexture, g.accumTexture[readIdx].texture);
-            DrawTextureRec(g.targetTexture.texture,
-                (Rectangle){0, 0, (float)g.targetTexture.texture.width, (float)-g.targetTexture.texture.height},
-                (Vector2){0, 0}, WHITE);
-        EndShaderMode();
-    EndTextureMode();
-    g.accumIndex = writeIdx;
+        // Visibility pre-pass: primary hits for the whole step
+        g.visibilityValid = RasterizeVisibility(set, invViewProj);
 
-    // Display pass
-    BeginDrawing();
-        ClearBackground(BLACK);
-        BeginShaderMode(g.displayShader);
-            DrawTextureRec(g.accumTexture[g.accumIndex].texture,
-                (Rectangle){0, 0, (float)g.accumTexture[g.accumIndex].texture.width,
-                             (float)-g.accumTexture[g.accumIndex].texture.height},
-                (Vector2){0, 0}, WHITE);
-        EndShaderMode();
-        DrawFPS(10, 10);
-    EndDrawing();
+        g.active = set;
+        g.tileCount = BuildTileOrder(set->width, set->height);
+        g.tilesDone = 0;
+    }
+
+    // Raytrace pass (MRT: color + moments + G-buffer). Float32 targets cannot blend on
+    // WebGL2 without EXT_float_blend, and the shader blends by itself anyway.
+    // Tiled: only as many tiles as fit the frame budget, centre first.
+    int writeIdx = 1 - set->index;
+    int batch = g.tileCount - g.tilesDone;
+    if (g.tiledRender) {
+        int tileTarget = 1;   // until the cost of a sample is measured
+        if (g.sampleCost > 0.0) {
+            double tileCost = g.sampleCost * g.samplesPerFrame * TRACE_TILE_SIZE * TRACE_TILE_SIZE;
+            tileTarget = (int)(g.frameTimeTarget * FRAME_TIME_TRACE_SHARE / tileCost);
+        }
+        if (tileTarget < 1) tileTarget = 1;
+        if (tileTarget < batch) batch = tileTarget;
+    }
+    int pixels = 0;
+    for (int i = g.tilesDone; i < g.tilesDone + batch; i++) {
+        int x, y, w, h;
+        TraceTileRect(g.tileOrder[i], set->width, set->height, &x, &y, &w, &h);
+        pixels += w * h;
+    }
+    int timed = (g.autoSPP || g.tiledRender) &&
+        ((++g.timingFrame % SPP_TIMING_INTERVAL) == 0 ||
+         (g.sampleCost == 0.0 && g.traceTimer.queries));   // fences never measure a cost
+    if (timed) timed = GpuTimerBegin(&g.traceTimer);
+    TraceToTarget(set->color[writeIdx], set, 0,
+                  batch < g.tileCount ? &g.tileOrder[g.tilesDone] : NULL, batch);
+    if (timed) GpuTimerEnd(&g.traceTimer, (double)g.samplesPerFrame * pixels);
+    UpdateSampleRate(g.samplesPerFrame, pixels);
+    g.tilesDone += batch;
+
+    if (g.tilesDone == g.tileCount) {
+        // Step complete: it becomes the history and what is displayed
+        set->index = writeIdx;
+        set->epoch = g.historyEpoch;
+        set->viewProj = g.stepViewProj;
+        g.shownSet = set;
+
+        // Reduced resolution: first hits of every full-resolution pixel guide the
+        // upsampling of the traced image, so edges stay where they are
+        if (set == &g.scaled) {
+            TraceToTarget(g.guideTarget, set, 1, NULL, 0);
+            BeginTextureMode(g.upscaleTarget);
+                BeginShaderMode(g.upsampleShader);
+                    if (g.locUpsampleCamPos != -1)
+                        SetShaderValue(g.upsampleShader, g.locUpsampleCamPos, &g.camera.position, SHADER_UNIFORM_VEC3);
+                    if (g.locUpsampleLowGBuffer != -1)
+                        SetShaderValueTexture(g.upsampleShader, g.locUpsampleLowGBuffer, set->gbuffer[set->index]);
+                    if (g.locUpsampleGuide != -1)
+                        SetShaderValueTexture(g.upsampleShader, g.locUpsampleGuide, g.guideTarget.texture);
+                    DrawTexturePro(set->color[set->index].texture,
+                        (Rectangle){0, 0, (float)set->width, (float)set->height},
+                        (Rectangle){0, 0, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT},
+                        (Vector2){0, 0}, 0.0f, WHITE);
+                EndShaderMode();
+            EndTextureMode();
+        }
+    }
+
+    PresentFrame(g.tilesDone < g.tileCount && set == &g.full && g.shownSet == &g.full,
+                 g.full.color[writeIdx].texture);
+}
+
+#if !defined(PLATFORM_WEB)
+// ============================================================
+// Headless CPU render: ./raylib_project --headless out.pfm [options]
+// ============================================================
+static int RunHeadless(int argc, char **argv) {
+    const char *outPath = "render.pfm";
+    int width = SCREEN_WIDTH, height = SCREEN_HEIGHT, spp = 64, threads = 0;
+    int scene = SCENE_DEFAULT, allLights = 0, pcgSampler = 0;
+    const char *envPath = NULL;
+    float adaptiveThreshold = 0.0f;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--headless") == 0 && v && v[0] != '-') { outPath = v; i++; }
+        else if (strcmp(a, "--scene") == 0 && v)   { scene = atoi(v); i++; }
+        else if (strcmp(a, "--spp") == 0 && v)     { spp = atoi(v); i++; }
+        else if (strcmp(a, "--width") == 0 && v)   { width = atoi(v); i++; }
+        else if (strcmp(a, "--height") == 0 && v)  { height = atoi(v); i++; }
+        else if (strcmp(a, "--threads") == 0 && v) { threads = atoi(v); i++; }
+        else if (strcmp(a, "--all-lights") == 0)   { allLights = 1; }
+        else if (strcmp(a, "--pcg") == 0)          { pcgSampler = 1; }
+        else if (strcmp(a, "--adaptive") == 0 && v) { adaptiveThreshold = (float)atof(v); i++; }
+        else if (strcmp(a, "--env") == 0 && v)     { envPath = v; i++; }
+        else if (strcmp(a, "--headless") != 0) {
+            printf("Usage: %s --headless [out.pfm] [--scene N] [--spp N] "
+                   "[--width W] [--height H] [--threads N] [--all-lights] [--pcg] [--adaptive T] "
+                   "[--env map.hdr]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0 || spp <= 0) { printf("ERROR: invalid size or spp\n"); return 1; }
+
+    InitDefaults();
+    LoadScenePreset(scene);
+    UpdateCameraFromAngles();
+    PackSceneData();
+    BuildSceneBVH();
+    BvhPack(&g.bvh, g.bvhDataBuf);
+
+    EnvMap env = {0};
+    if (envPath) {
+        if (EnvMapLoadHDR(&env, envPath) != 0) {
+            printf("ERROR: Could not load environment map %s\n", envPath);
+            return 1;
+        }
+        g.useEnvMap = ENV_HDR_MAP;
+    } else if (g.useEnvMap == ENV_PROCEDURAL) {
+        float sunDir[3] = { g.sunDirection.x, g.sunDirection.y, g.sunDirection.z };
+        if (EnvMapBakeSky(&env, SKY_LUT_WIDTH, SKY_LUT_HEIGHT, sunDir) != 0) {
+            printf("ERROR: Could not bake the procedural sky\n");
+            return 1;
+        }
+    }
+
+    static float blueNoise[BLUE_NOISE_TEXELS];
+    if (BlueNoiseBuild(blueNoise) != 0) {
+        printf("ERROR: Could not build the blue-noise tile\n");
+        EnvMapFree(&env);
+        return 1;
+    }
+
+    Matrix view = GetCameraMatrix(g.camera);
+    Matrix proj = MatrixPerspective(g.camera.fovy * DEG2RAD, (float)width / (float)height, 0.1f, 100.0f);
+    float16 invViewProj = MatrixToFloatV(MatrixInvert(MatrixMultiply(view, proj)));
+
+    CpuTracerScene sc = {
+        .geomData = g.geomDataBuf, .sceneData = g.sceneDataBuf, .primCount = g.primCount, .lightCount = g.lightCount,
+        .quadCount = g.quadCount, .triangleCount = g.triangleCount,
+        .bvhNodes = g.bvhDataBuf, .bvhNodeCount = g.bvh.nodeCount,
+        .emitterCount = g.emitterCount,
+        .envRgb = env.rgb, .envCdf = env.cdf, .envWidth = env.width, .envHeight = env.height,
+        .blueNoise = blueNoise,
+    };
+    CpuTracerSettings st = {
+        .width = width, .height = height, .samplesPerPixel = spp, .threads = threads,
+        .cameraPosition = { g.camera.position.x, g.camera.position.y, g.camera.position.z },
+        .kLinear = 0.09f, .kQuadratic = 0.032f,
+        .aoRadius = g.aoRadius, .aoStrength = g.aoStrength,
+        .envMode = g.useEnvMap, .envIntensity = g.envIntensity, .envRotation = g.envRotation,
+        .lightSampling = allLights ? LIGHT_SAMPLING_ALL : LIGHT_SAMPLING_ONE,
+        .samplerMode = pcgSampler ? SAMPLER_PCG : SAMPLER_SOBOL,
+        .adaptiveThreshold = adaptiveThreshold,
+    };
+    memcpy(st.invViewProj, invViewProj.v, sizeof(st.invViewProj));
+
+    float *rgb = (float *)RL_MALLOC((size_t)width * height * 3 * sizeof(float));
+    if (!rgb) { printf("ERROR: out of memory\n"); EnvMapFree(&env); return 1; }
+    // GetTime() needs a window; use the monotonic clock directly
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int rc = CpuTracerRender(&sc, &st, rgb);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (rc == 0) rc = CpuTracerWritePFM(outPath, rgb, width, height);
+    RL_FREE(rgb);
+    EnvMapFree(&env);
+    if (rc != 0) { printf("ERROR: headless render failed\n"); return 1; }
+    printf("Rendered %dx%d @ %d spp in %.2fs -> %s\n", width, height, spp,
+           (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9, outPath);
+    return 0;
 }
+#endif
 
-int main(void) {
+int main(int argc, char **argv) {
+#if !defined(PLATFORM_WEB)
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--headless") == 0) return RunHeadless(argc, argv);
+#endif
     InitApp();
+    // Desktop: --env map.hdr; on the web shell.html loads maps through LoadEnvironmentHDR
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--env") == 0) LoadEnvironmentMap(argv[i + 1]);
+    // Desktop: --freeze bakes the start-up scene into the shader (kiosk/benchmark)
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--freeze") == 0) g.freezeScene = 1;
 #if defined(PLATFORM_WEB)
     emscripten_set_main_loop(UpdateDrawFrame, 0, 1);
 #else
     while (!WindowShouldClose()) UpdateDrawFrame();
-    if (g.shader.id != 0) UnloadShader(g.shader);
+    for (int i = 0; i < g.rtVariantCount; i++) UnloadShader(g.rtVariants[i].shader);
+    if (g.sceneFrozen) UnloadShader(g.frozenShader);
+    ShaderBuildCancel(&g.rtBuild);
+    if (g.previewShader.id != 0) UnloadShader(g.previewShader);
     if (g.displayShader.id != 0) UnloadShader(g.displayShader);
-    UnloadRenderTexture(g.targetTexture);
-    UnloadRenderTexture(g.accumTexture[0]);
-    UnloadRenderTexture(g.accumTexture[1]);
+    if (g.budgetShader.id != 0) UnloadShader(g.budgetShader);
+    if (g.upsampleShader.id != 0) UnloadShader(g.upsampleShader);
+    if (g.visibilityShader.id != 0) UnloadShader(g.visibilityShader);
+    UnloadAccumTargets(&g.full);
+    UnloadAccumTargets(&g.scaled);
+    UnloadRenderTexture(g.guideTarget);
+    UnloadRenderTexture(g.upscaleTarget);
+    UnloadRenderTexture(g.budgetTarget);
+    GpuTimerUnload(&g.traceTimer);
+    rlUnloadTexture(g.geomDataTex.id);
     rlUnloadTexture(g.sceneDataTex.id);
+    rlUnloadTexture(g.bvhDataTex.id);
+    if (g.envMapTex.id > 0) rlUnloadTexture(g.envMapTex.id);
+    if (g.envCdfTex.id > 0) rlUnloadTexture(g.envCdfTex.id);
+    if (g.skyMapTex.id > 0) rlUnloadTexture(g.skyMapTex.id);
+    if (g.skyCdfTex.id > 0) rlUnloadTexture(g.skyCdfTex.id);
+    if (g.blueNoiseTex.id > 0) rlUnloadTexture(g.blueNoiseTex.id);
     CloseWindow();
 #endif
     return 0;
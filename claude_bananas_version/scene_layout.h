@@ -0,0 +1,96 @@
+#ifndef SCENE_LAYOUT_H
+#define SCENE_LAYOUT_H
+
+// Scene data texture layout shared by the host (main_web.c), the CPU
+// backend (cpu_tracer.c) and shaders/raytrace.glsl.
+// Must match shader defines. Split hot/cold: traversal reads only the compact
+// geometry texture, the material row is fetched once for the winning hit.
+
+#define MAX_PRIMS 64
+#define MAX_LIGHTS 8
+#define MAX_EMITTERS MAX_PRIMS     // every primitive may be emissive
+
+// Geometry texture: one row per primitive, 3 texels (RGBA32F)
+//   Col 0: [geom0.xyz, radius (sphere) | GEOM_TAG_QUAD | GEOM_TAG_TRIANGLE]
+//   Col 1: [geom1.xyz, 0]
+//   Col 2: [geom2.xyz, 0]
+// Sphere: geom0 = center; quad: Q, u, v; triangle: A, B, C. The type is
+// folded into geom0.w (radii are >= 0, tags negative), so a sphere test is
+// a single fetch and a quad/triangle test three.
+// Rows (in both textures) are sorted by type — quads, then triangles, then
+// spheres — so the shader and CPU port get a row's type from the quadCount /
+// triangleCount ranges; the host keeps a prims[] <-> row remap for the editor.
+#define GEOM_TEX_WIDTH 3
+#define GEOM_ROW_FLOATS (GEOM_TEX_WIDTH * 4)         // 12 floats per row
+#define GEOM_TAG_QUAD     -1.0f
+#define GEOM_TAG_TRIANGLE -2.0f
+#define GEOM_PRIM_TYPE(w) ((w) >= 0.0f ? PRIM_SPHERE : (w) > -1.5f ? PRIM_QUAD : PRIM_TRIANGLE)
+
+// Material/light texture, 4 texels per row:
+// Prim i at row i:
+//   Col 0: [color.rgb, materialType]
+//   Col 1: [emission.rgb, emissionStrength]
+//   Col 2: [ior, roughness, specular, shininess]
+//   Col 3: [boundingSphere: center.xyz, radius] (brute-force CPU loops only)
+// Light j at row LIGHT_ROW_BASE + j, cols 0-2 (see raytrace.glsl)
+#define SCENE_TEX_WIDTH 4
+#define SCENE_ROW_FLOATS (SCENE_TEX_WIDTH * 4)       // 16 floats per row
+#define LIGHT_ROW_BASE MAX_PRIMS   // lights start at row 64
+
+// Emitter alias table (power-proportional NEE selection), one texel per slot,
+// SCENE_TEX_WIDTH slots per row starting at EMITTER_ROW_BASE:
+//   slot k = [prim index, alias threshold, alias slot, selection pdf]
+// Pick k uniformly, keep it if the leftover fraction < threshold, else use the alias.
+#define EMITTER_ROW_BASE (LIGHT_ROW_BASE + MAX_LIGHTS)        // row 72
+#define EMITTER_ROWS (MAX_EMITTERS / SCENE_TEX_WIDTH)         // 16 rows
+#define SCENE_TEX_HEIGHT (MAX_PRIMS + MAX_LIGHTS + EMITTER_ROWS) // 88 rows
+
+// BVH node texture: one node per row, 2 texels wide (RGBA32F)
+//   Col 0: [bmin.xyz, left child | prim index (leaf)]
+//   Col 1: [bmax.xyz, right child | -1 (leaf)]
+// Binary tree with single-primitive leaves -> at most 2N-1 nodes.
+#define BVH_TEX_WIDTH 2
+#define BVH_ROW_FLOATS (BVH_TEX_WIDTH * 4)
+#define BVH_MAX_NODES (2 * MAX_PRIMS)
+#define BVH_STACK_SIZE 32   // traversal stack in the shader; builder keeps depth below this
+
+// Primitive types
+#define PRIM_SPHERE   0
+#define PRIM_QUAD     1
+#define PRIM_TRIANGLE 2
+
+// Materials
+#define MAT_LAMBERTIAN 0
+#define MAT_METAL      1
+#define MAT_EMISSIVE   2
+#define MAT_DIELECTRIC 3
+
+// Light types
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_POINT       1
+
+// Explicit-light sampling (lightSampling uniform)
+#define LIGHT_SAMPLING_ONE 0   // one light per hit, chosen by estimated contribution
+#define LIGHT_SAMPLING_ALL 1   // every light, soft lights with several shadow rays (reference)
+
+// Sample generation (samplerMode uniform)
+#define SAMPLER_SOBOL 0   // Owen-scrambled Sobol per dimension, blue-noise offset per pixel
+#define SAMPLER_PCG   1   // independent PCG stream per sample (fallback)
+
+// Adaptive sampling (raytrace.glsl + sample_budget.glsl, cpu_tracer.c)
+#define ADAPTIVE_TILE_SIZE         16     // pixels per budget tile edge
+#define ADAPTIVE_WARMUP_FRAMES     16     // full-rate frames before tiles may stop
+#define ADAPTIVE_DEFAULT_THRESHOLD 0.01f  // target relative standard error per tile
+#define ADAPTIVE_LUM_FLOOR         0.05f  // noise in dark pixels is judged against this
+
+// Accumulation modes (accumMode uniform). Both keep alpha such that
+// display.glsl resolves the pixel as rgb / max(a, 1).
+#define ACCUM_SUM_FLOAT  0   // RGBA32F running sum, exact sample count in alpha
+#define ACCUM_BLEND_HALF 1   // RGBA16F running mean, blend weight floored at 1/4096
+
+// Environment modes (useEnvMap uniform)
+#define ENV_GRADIENT   0
+#define ENV_HDR_MAP    1
+#define ENV_PROCEDURAL 2   // golden-hour sky, baked to a lat-long table by EnvMapBakeSky
+
+#endif // SCENE_LAYOUT_H
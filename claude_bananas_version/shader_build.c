@@ -0,0 +1,349 @@
+// Non-blocking shader program builds + desktop program binary cache — see shader_build.h
+
+#include "shader_build.h"
+#include "rlgl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(PLATFORM_WEB)
+#include <GLES3/gl3.h>
+#include <emscripten/html5.h>
+#define GLFN(name) gl##name
+#else
+#if defined(_WIN32)
+#include <direct.h>
+#define MakeDir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDir(path) mkdir(path, 0755)
+#endif
+
+// raylib owns the context and its GL loader; the entry points used here come
+// from its bundled GLFW instead
+typedef void (*GLFWglproc)(void);
+GLFWglproc glfwGetProcAddress(const char *procname);
+
+#if defined(_WIN32) && !defined(APIENTRY)
+#define APIENTRY __stdcall
+#elif !defined(APIENTRY)
+#define APIENTRY
+#endif
+
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef int GLint;
+typedef int GLsizei;
+typedef char GLchar;
+typedef unsigned char GLubyte;
+
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_INFO_LOG_LENGTH                0x8B84
+#define GL_VENDOR                         0x1F00
+#define GL_RENDERER                       0x1F01
+#define GL_VERSION                        0x1F02
+#define GL_EXTENSIONS                     0x1F03
+#define GL_NUM_EXTENSIONS                 0x821D
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH          0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS     0x87FE
+
+#define GL_ENTRY_POINTS(X) \
+    X(GLuint, CreateShader, (GLenum type)) \
+    X(void, ShaderSource, (GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length)) \
+    X(void, CompileShader, (GLuint shader)) \
+    X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint *params)) \
+    X(void, GetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog)) \
+    X(void, DeleteShader, (GLuint shader)) \
+    X(GLuint, CreateProgram, (void)) \
+    X(void, AttachShader, (GLuint program, GLuint shader)) \
+    X(void, DetachShader, (GLuint program, GLuint shader)) \
+    X(void, BindAttribLocation, (GLuint program, GLuint index, const GLchar *name)) \
+    X(void, LinkProgram, (GLuint program)) \
+    X(void, GetProgramiv, (GLuint program, GLenum pname, GLint *params)) \
+    X(void, GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog)) \
+    X(void, DeleteProgram, (GLuint program)) \
+    X(const GLubyte *, GetString, (GLenum name)) \
+    X(const GLubyte *, GetStringi, (GLenum name, GLuint index)) \
+    X(void, GetIntegerv, (GLenum pname, GLint *data)) \
+    X(void, ProgramParameteri, (GLuint program, GLenum pname, GLint value)) \
+    X(void, GetProgramBinary, (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *format, void *binary)) \
+    X(void, ProgramBinary, (GLuint program, GLenum format, const void *binary, GLsizei length)) \
+    X(void, MaxShaderCompilerThreadsKHR, (GLuint count))
+
+#define GL_DECLARE(ret, name, args) ret (APIENTRY *name) args;
+static struct { GL_ENTRY_POINTS(GL_DECLARE) } gl;
+#undef GL_DECLARE
+#define GLFN(name) gl.name
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Without KHR_parallel_shader_compile, polls before the (blocking) status check
+#define SHADER_BUILD_DEFER_FRAMES 2
+#define PROGRAM_BINARY_MAGIC 0x42505452u   // "RTPB"
+
+// raylib's default vertex stage, with its attribute and uniform names
+#if defined(PLATFORM_WEB)
+#define SHADER_VERSION_LINE "#version 300 es\n"
+#else
+#define SHADER_VERSION_LINE "#version 330\n"
+#endif
+static const char *kVertexSource = SHADER_VERSION_LINE
+    "in vec3 vertexPosition;\n"
+    "in vec2 vertexTexCoord;\n"
+    "in vec4 vertexColor;\n"
+    "out vec2 fragTexCoord;\n"
+    "out vec4 fragColor;\n"
+    "uniform mat4 mvp;\n"
+    "void main() {\n"
+    "    fragTexCoord = vertexTexCoord;\n"
+    "    fragColor = vertexColor;\n"
+    "    gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+    "}\n";
+
+typedef struct ProgramBinaryHeader {
+    unsigned int magic;
+    unsigned int format;      // glGetProgramBinary format enum
+    unsigned int length;      // bytes after the header
+    unsigned int reserved;
+    unsigned long long key;   // repeated so a renamed file cannot alias
+} ProgramBinaryHeader;
+
+static struct {
+    bool parallel;
+    bool binaryCache;
+    char cacheDir[256];
+    unsigned long long driverHash;
+} s;
+
+#if !defined(PLATFORM_WEB)
+// FNV-1a, chained through `h`
+static unsigned long long HashString(unsigned long long h, const char *str) {
+    for (const unsigned char *p = (const unsigned char *)str; p && *p; p++) {
+        h ^= *p;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static bool HasExtension(const char *name) {
+    if (!gl.GetStringi) return false;
+    GLint count = 0;
+    gl.GetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *ext = (const char *)gl.GetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (ext && strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
+static void CachePath(unsigned long long key, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.bin", s.cacheDir, key);
+}
+
+// Link b->program from the cached binary; false (file removed if stale) to compile instead
+static bool LoadCachedProgram(ShaderBuild *b) {
+    char path[320];
+    CachePath(b->key, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    ProgramBinaryHeader header;
+    void *data = NULL;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              header.magic == PROGRAM_BINARY_MAGIC && header.key == b->key &&
+              header.length > 0 && (data = malloc(header.length)) != NULL &&
+              fread(data, 1, header.length, f) == header.length;
+    fclose(f);
+    if (ok) {
+        b->program = gl.CreateProgram();
+        gl.ProgramBinary(b->program, header.format, data, (GLsizei)header.length);
+        GLint linked = 0;
+        gl.GetProgramiv(b->program, GL_LINK_STATUS, &linked);
+        ok = linked != 0;
+        if (!ok) {
+            gl.DeleteProgram(b->program);
+            b->program = 0;
+        }
+    }
+    free(data);
+    if (!ok) remove(path);   // unreadable or rejected by this driver
+    return ok;
+}
+
+static void StoreCachedProgram(const ShaderBuild *b) {
+    GLint length = 0;
+    gl.GetProgramiv(b->program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    void *data = malloc((size_t)length);
+    if (!data) return;
+    GLenum format = 0;
+    GLsizei written = 0;
+    gl.GetProgramBinary(b->program, length, &written, &format, data);
+    char path[320];
+    CachePath(b->key, path, sizeof(path));
+    FILE *f = (written > 0) ? fopen(path, "wb") : NULL;
+    if (f) {
+        ProgramBinaryHeader header = { PROGRAM_BINARY_MAGIC, format, (unsigned int)written, 0, b->key };
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(data, 1, (size_t)written, f) == (size_t)written;
+        fclose(f);
+        if (!ok) remove(path);
+    }
+    free(data);
+}
+#endif
+
+void ShaderBuildInit(const char *cacheDir) {
+    memset(&s, 0, sizeof(s));
+#if defined(PLATFORM_WEB)
+    (void)cacheDir;   // WebGL has no program binaries; browsers cache compiled programs themselves
+    s.parallel = emscripten_webgl_enable_extension(emscripten_webgl_get_current_context(),
+                                                   "KHR_parallel_shader_compile");
+#else
+#define GL_LOAD(ret, name, args) gl.name = (ret (APIENTRY *) args)glfwGetProcAddress("gl" #name);
+    GL_ENTRY_POINTS(GL_LOAD)
+#undef GL_LOAD
+    if (HasExtension("GL_KHR_parallel_shader_compile")) {
+        s.parallel = true;
+    } else if (HasExtension("GL_ARB_parallel_shader_compile")) {
+        gl.MaxShaderCompilerThreadsKHR =
+            (void (APIENTRY *)(GLuint))glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+        s.parallel = true;
+    } else {
+        gl.MaxShaderCompilerThreadsKHR = NULL;
+    }
+    if (s.parallel && gl.MaxShaderCompilerThreadsKHR)
+        gl.MaxShaderCompilerThreadsKHR(0xFFFFFFFFu);   // as many threads as the driver likes
+
+    GLint formats = 0;
+    if (gl.GetProgramBinary && gl.ProgramBinary && gl.ProgramParameteri)
+        gl.GetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (cacheDir && formats > 0) {
+        snprintf(s.cacheDir, sizeof(s.cacheDir), "%s", cacheDir);
+        MakeDir(s.cacheDir);   // fails harmlessly when it exists
+        s.binaryCache = true;
+        unsigned long long h = 0xcbf29ce484222325ull;
+        h = HashString(h, (const char *)gl.GetString(GL_VENDOR));
+        h = HashString(h, (const char *)gl.GetString(GL_RENDERER));
+        s.driverHash = HashString(h, (const char *)gl.GetString(GL_VERSION));
+    }
+#endif
+}
+
+bool ShaderBuildIsParallel(void) {
+    return s.parallel;
+}
+
+void ShaderBuildStart(ShaderBuild *b, const char *fragSource) {
+    memset(b, 0, sizeof(*b));
+    b->state = SHADER_BUILD_PENDING;
+#if !defined(PLATFORM_WEB)
+    if (s.binaryCache) {
+        b->key = HashString(HashString(s.driverHash, kVertexSource), fragSource) | 1;
+        if (LoadCachedProgram(b)) {
+            b->fromCache = true;
+            b->state = SHADER_BUILD_READY;
+            return;
+        }
+    }
+#endif
+    // Compile and link without asking for status: that query is what blocks
+    b->vertex = GLFN(CreateShader)(GL_VERTEX_SHADER);
+    GLFN(ShaderSource)(b->vertex, 1, &kVertexSource, NULL);
+    GLFN(CompileShader)(b->vertex);
+    b->fragment = GLFN(CreateShader)(GL_FRAGMENT_SHADER);
+    GLFN(ShaderSource)(b->fragment, 1, &fragSource, NULL);
+    GLFN(CompileShader)(b->fragment);
+
+    b->program = GLFN(CreateProgram)();
+    GLFN(AttachShader)(b->program, b->vertex);
+    GLFN(AttachShader)(b->program, b->fragment);
+    GLFN(BindAttribLocation)(b->program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION,
+                             RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+    GLFN(BindAttribLocation)(b->program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD,
+                             RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+    GLFN(BindAttribLocation)(b->program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR,
+                             RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+#if !defined(PLATFORM_WEB)
+    if (b->key) gl.ProgramParameteri(b->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, 1);
+#endif
+    GLFN(LinkProgram)(b->program);
+}
+
+static void PrintInfoLog(unsigned int object, bool program) {
+    GLint length = 0;
+    if (program) GLFN(GetProgramiv)(object, GL_INFO_LOG_LENGTH, &length);
+    else GLFN(GetShaderiv)(object, GL_INFO_LOG_LENGTH, &length);
+    if (length <= 1) return;
+    char *log = (char *)malloc((size_t)length);
+    if (!log) return;
+    if (program) GLFN(GetProgramInfoLog)(object, length, NULL, log);
+    else GLFN(GetShaderInfoLog)(object, length, NULL, log);
+    printf("%s\n", log);
+    free(log);
+}
+
+ShaderBuildState ShaderBuildPoll(ShaderBuild *b) {
+    if (b->state != SHADER_BUILD_PENDING) return b->state;
+    b->framesWaited++;
+    if (s.parallel) {
+        GLint done = 0;
+        GLFN(GetProgramiv)(b->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) return SHADER_BUILD_PENDING;
+    } else if (b->framesWaited < SHADER_BUILD_DEFER_FRAMES) {
+        return SHADER_BUILD_PENDING;
+    }
+
+    GLint linked = 0;
+    GLFN(GetProgramiv)(b->program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLint compiled = 0;
+        GLFN(GetShaderiv)(b->fragment, GL_COMPILE_STATUS, &compiled);
+        printf("ERROR: shader program failed to %s\n", compiled ? "link" : "compile");
+        if (!compiled) PrintInfoLog(b->fragment, false);
+        else PrintInfoLog(b->program, true);
+        ShaderBuildCancel(b);
+        b->state = SHADER_BUILD_FAILED;
+        return b->state;
+    }
+    GLFN(DetachShader)(b->program, b->vertex);
+    GLFN(DetachShader)(b->program, b->fragment);
+    GLFN(DeleteShader)(b->vertex);
+    GLFN(DeleteShader)(b->fragment);
+    b->vertex = b->fragment = 0;
+#if !defined(PLATFORM_WEB)
+    if (b->key) StoreCachedProgram(b);
+#endif
+    b->state = SHADER_BUILD_READY;
+    return b->state;
+}
+
+Shader ShaderBuildTake(ShaderBuild *b) {
+    Shader shader = { 0 };
+    if (b->state != SHADER_BUILD_READY) return shader;
+    shader.id = b->program;
+    shader.locs = (int *)RL_CALLOC(RL_MAX_SHADER_LOCATIONS, sizeof(int));
+    for (int i = 0; i < RL_MAX_SHADER_LOCATIONS; i++) shader.locs[i] = -1;
+    shader.locs[SHADER_LOC_VERTEX_POSITION] = rlGetLocationAttrib(shader.id, RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+    shader.locs[SHADER_LOC_VERTEX_TEXCOORD01] = rlGetLocationAttrib(shader.id, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+    shader.locs[SHADER_LOC_VERTEX_COLOR] = rlGetLocationAttrib(shader.id, RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+    shader.locs[SHADER_LOC_MATRIX_MVP] = rlGetLocationUniform(shader.id, RL_DEFAULT_SHADER_UNIFORM_NAME_MVP);
+    shader.locs[SHADER_LOC_COLOR_DIFFUSE] = rlGetLocationUniform(shader.id, RL_DEFAULT_SHADER_UNIFORM_NAME_COLOR);
+    shader.locs[SHADER_LOC_MAP_DIFFUSE] = rlGetLocationUniform(shader.id, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE0);
+    memset(b, 0, sizeof(*b));
+    return shader;
+}
+
+void ShaderBuildCancel(ShaderBuild *b) {
+    if (b->program) GLFN(DeleteProgram)(b->program);
+    if (b->vertex) GLFN(DeleteShader)(b->vertex);
+    if (b->fragment) GLFN(DeleteShader)(b->fragment);
+    memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,56 @@
+#ifndef SHADER_BUILD_H
+#define SHADER_BUILD_H
+
+// Non-blocking shader program builds for main_web.c. A build compiles one
+// fragment shader against raylib's default vertex stage and links it without
+// waiting: where the driver has KHR_parallel_shader_compile (WebGL2 on most
+// browsers, recent desktop drivers) completion is polled with
+// COMPLETION_STATUS_KHR; elsewhere the status check that blocks is deferred
+// a few frames so the driver gets a head start.
+//
+// Desktop only: linked programs are kept as glGetProgramBinary blobs in a
+// cache directory, keyed by a hash of the sources and the GL vendor, renderer
+// and version strings, so a warm start skips compilation altogether. A blob
+// the driver rejects (driver update) is deleted and the source is compiled.
+
+#include <stdbool.h>
+#include "raylib.h"
+
+typedef enum ShaderBuildState {
+    SHADER_BUILD_IDLE = 0,
+    SHADER_BUILD_PENDING,
+    SHADER_BUILD_READY,
+    SHADER_BUILD_FAILED,
+} ShaderBuildState;
+
+typedef struct ShaderBuild {
+    ShaderBuildState state;
+    unsigned int program, vertex, fragment;
+    unsigned long long key;    // binary cache key; 0 = not cached
+    int framesWaited;          // polls so far (deferred status check)
+    bool fromCache;
+} ShaderBuild;
+
+// Once after InitWindow. cacheDir (desktop) holds the program binaries;
+// NULL disables the cache.
+void ShaderBuildInit(const char *cacheDir);
+
+// True when completion can be polled without blocking
+bool ShaderBuildIsParallel(void);
+
+// Start building fragSource (complete, #version line included). A cached
+// binary makes the build READY right away.
+void ShaderBuildStart(ShaderBuild *b, const char *fragSource);
+
+// Advance a PENDING build; blocks only for the deferred check without
+// KHR_parallel_shader_compile. Logs the info log on failure.
+ShaderBuildState ShaderBuildPoll(ShaderBuild *b);
+
+// Hand a READY build over as a raylib Shader (locations set up as
+// LoadShaderFromMemory does, so UnloadShader frees it) and reset b
+Shader ShaderBuildTake(ShaderBuild *b);
+
+// Drop a build in any state
+void ShaderBuildCancel(ShaderBuild *b);
+
+#endif // SHADER_BUILD_H
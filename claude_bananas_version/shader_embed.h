@@ -0,0 +1,14 @@
+#ifndef SHADER_EMBED_H
+#define SHADER_EMBED_H
+
+// Shader sources compiled into the binary. shaders_embedded.c is generated by
+// `make shaders` (tools/shader_bundle.c): every shaders/*.glsl with its
+// #includes from shaders/lib resolved, comments and unreachable functions
+// stripped and whitespace minified. No #version line; LoadShaderSource
+// prepends it like it did for the files.
+
+// Bundled source for path (e.g. "shaders/raytrace.glsl"), NULL if it was not
+// part of the bundle
+const char *EmbeddedShaderSource(const char *path);
+
+#endif // SHADER_EMBED_H
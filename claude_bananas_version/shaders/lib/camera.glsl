@@ -0,0 +1,5 @@
+// Unit direction of the camera ray through `ndc` ([-1, 1]^2 on the near plane)
+vec3 cameraRayDir(mat4 invViewProj, vec3 cameraPosition, vec2 ndc) {
+    vec4 worldPos4 = invViewProj * vec4(ndc, -1.0, 1.0);
+    return normalize(worldPos4.xyz / worldPos4.w - cameraPosition);
+}
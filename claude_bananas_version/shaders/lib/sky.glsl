@@ -0,0 +1,5 @@
+// Gradient sky (useEnvMap = ENV_GRADIENT): white horizon to blue zenith
+vec3 skyGradient(vec3 dir) {
+    float a = 0.5 * (dir.y + 1.0);
+    return mix(vec3(0.3, 0.5, 0.8), vec3(1.0), a);
+}
@@ -0,0 +1,52 @@
+// NOTE: #version directive is prepended by C code at load time
+// Compile-time stand-in: shown while the raytrace program builds in the
+// background. Shades the visibility pre-pass (texture0, R = row + 1) with the
+// hit row's albedo under a headlight plus its emission, and the gradient sky
+// where nothing was hit. Display-referred output, drawn straight to the screen.
+
+#ifdef GL_ES
+precision highp float;
+precision highp int;
+#endif
+
+out vec4 finalColor;
+
+uniform sampler2D texture0;      // visibility pre-pass, screen-sized
+uniform sampler2D geomData;      // same layouts as raytrace.glsl
+uniform sampler2D sceneData;
+uniform vec3 cameraPosition;
+uniform mat4 invViewProj;
+uniform vec2 resolution;
+
+#include "camera.glsl"
+#include "sky.glsl"
+
+void main() {
+    vec3 dir = cameraRayDir(invViewProj, cameraPosition, gl_FragCoord.xy / resolution * 2.0 - 1.0);
+    // Same size and projection as the screen, so the pixel maps 1:1
+    int row = int(texelFetch(texture0, ivec2(gl_FragCoord.xy), 0).r + 0.5) - 1;
+
+    vec3 color;
+    if (row < 0) {
+        color = skyGradient(dir);
+    } else {
+        vec4 g0 = texelFetch(geomData, ivec2(0, row), 0);
+        vec3 g1 = texelFetch(geomData, ivec2(1, row), 0).xyz;
+        vec3 g2 = texelFetch(geomData, ivec2(2, row), 0).xyz;
+        vec3 n;
+        if (g0.w >= 0.0) {           // sphere: the pre-pass already trimmed it, so disc >= 0
+            vec3 oc = cameraPosition - g0.xyz;
+            float b = dot(dir, oc);
+            float t = -b - sqrt(max(b * b - dot(oc, oc) + g0.w * g0.w, 0.0));
+            n = (cameraPosition + dir * t - g0.xyz) / g0.w;
+        } else if (g0.w > -1.5) {    // quad: Q, u, v
+            n = normalize(cross(g1, g2));
+        } else {                     // triangle: A, B, C
+            n = normalize(cross(g1 - g0.xyz, g2 - g0.xyz));
+        }
+        vec4 albedo = texelFetch(sceneData, ivec2(0, row), 0);
+        vec4 emission = texelFetch(sceneData, ivec2(1, row), 0);
+        color = albedo.rgb * (0.2 + 0.8 * abs(dot(n, dir))) + emission.rgb * emission.a;
+    }
+    finalColor = vec4(pow(clamp(color, 0.0, 1.0), vec3(1.0 / 2.2)), 1.0);
+}
@@ -6,54 +6,121 @@ precision highp float;
 precision highp int;
 #endif
 
+#ifndef MAX_DEPTH
 #define MAX_DEPTH 8
+#endif
 #define MAX_PRIMS 64
 #define MAX_LIGHTS 8
 #define AO_SAMPLES 4
 #define SOFT_SHADOW_SAMPLES 4
+#define LIGHT_SAMPLING_ONE 0  // one light per hit, picked by estimated contribution
+#define LIGHT_SAMPLING_ALL 1  // every light, SOFT_SHADOW_SAMPLES rays each (reference)
+#define SAMPLER_SOBOL 0       // Owen-scrambled Sobol, blue-noise offset per pixel
+#define SAMPLER_PCG   1       // independent PCG stream per sample (fallback)
+#define BLUE_NOISE_SIZE 64
+#define ADAPTIVE_TILE_SIZE 16  // sampleBudget texel = one tile of pixels
+#define ACCUM_SUM_FLOAT  0     // accumTexture = running sum + exact sample count
+#define ACCUM_BLEND_HALF 1     // accumTexture = running mean (RGBA16F)
 #define PI 3.14159265359
 #define EPSILON 0.001
 
+// Feature switches, injected by the host per scene/settings variant (see
+// SelectRaytraceVariant in main_web.c). Loaded without them, every path is in.
+#ifndef HAS_SPHERES
+#define HAS_SPHERES 1
+#endif
+#ifndef HAS_QUADS
+#define HAS_QUADS 1
+#endif
+#ifndef HAS_TRIANGLES
+#define HAS_TRIANGLES 1
+#endif
+#ifndef HAS_AO
+#define HAS_AO 1
+#endif
+#ifndef HAS_LIGHTS
+#define HAS_LIGHTS 1
+#endif
+#ifndef HAS_EMITTERS
+#define HAS_EMITTERS 1
+#endif
+#ifdef HAS_ENV_MAP
+#define ENV_TABLE_ACTIVE (HAS_ENV_MAP != 0)
+#else
+#define ENV_TABLE_ACTIVE (useEnvMap == 1 || useEnvMap == 2)
+#endif
+
 // Primitive types
 #define PRIM_SPHERE   0
 #define PRIM_QUAD     1
 #define PRIM_TRIANGLE 2
 
-// Scene data texture layout (8 pixels wide, RGBA32F):
-// Each primitive = 1 ROW, 8 columns:
-//   Col 0: [primType, 0, 0, 0]
-//   Col 1: [color.rgb, materialType]
-//   Col 2: [emission.rgb, emissionStrength]
-//   Col 3: [ior, roughness, specular, shininess]
-//   Col 4: [geom0] — type-specific
-//   Col 5: [geom1]
-//   Col 6: [geom2]
-//   Col 7: [boundingSphere: center.xyz, radius]
+// Geometry texture (3 pixels wide, RGBA32F), one row per primitive — the
+// only scene data traversal touches. Rows are sorted by type: quads in
+// [0, quadCount), then triangleCount triangles, then spheres up to primCount.
+//   Col 0: [geom0.xyz, radius (sphere) | -1 (quad) | -2 (triangle)]
+//   Col 1: [geom1.xyz, 0]
+//   Col 2: [geom2.xyz, 0]
 //
-// Sphere geom:  col4 = [center.xyz, radius]
-// Quad geom:    col4 = [Q.xyz, 0], col5 = [u.xyz, 0], col6 = [v.xyz, 0]
-// Triangle geom: col4 = [A.xyz, 0], col5 = [B.xyz, 0], col6 = [C.xyz, 0]
+// Sphere geom:   col0 = [center.xyz, radius]
+// Quad geom:     col0 = [Q.xyz, -1], col1 = [u.xyz, 0], col2 = [v.xyz, 0]
+// Triangle geom: col0 = [A.xyz, -2], col1 = [B.xyz, 0], col2 = [C.xyz, 0]
+//
+// Scene data texture (4 pixels wide, RGBA32F), fetched once per hit:
+// Primitive i at row i:
+//   Col 0: [color.rgb, materialType]
+//   Col 1: [emission.rgb, emissionStrength]
+//   Col 2: [ior, roughness, specular, shininess]
+//   Col 3: [boundingSphere: center.xyz, radius] (host-side; traversal uses the BVH)
 //
 // Light j at row (LIGHT_ROW_BASE + j):
 //   Col 0: [type, direction.xyz]
 //   Col 1: [position.xyz, intensity]
 //   Col 2: [color.rgb, radius]
+//
+// Emitter alias table from row EMITTER_ROW_BASE, 4 slots per row (slot k at col k%4):
+//   [prim index, alias threshold, alias slot, selection pdf]
 
+#define SCENE_TEX_WIDTH 4
 #define LIGHT_ROW_BASE MAX_PRIMS
+#define EMITTER_ROW_BASE (LIGHT_ROW_BASE + MAX_LIGHTS)
+
+// BVH node texture (2 pixels wide, RGBA32F), one node per row, root = row 0:
+//   Col 0: [bmin.xyz, left child  | prim index for leaves]
+//   Col 1: [bmax.xyz, right child | -1 for leaves]
+#define BVH_STACK_SIZE 32
 
 in vec2 fragTexCoord;
-out vec4 finalColor;
+layout(location = 0) out vec4 finalColor;
+layout(location = 1) out vec4 momentsOut;  // [mean lum, mean lum^2, sample count, 1]
+layout(location = 2) out vec4 gbufferOut;  // first hit of the pixel-centre ray, packGBuffer()
 
-uniform sampler2D texture0;
+uniform sampler2D texture0;     // visibility.glsl pre-pass: R = primitive index + 1, 0 = sky
+uniform sampler2D geomData;      // bound by hand on GEOMETRY_TEXTURE_UNIT
 uniform sampler2D sceneData;
+uniform sampler2D bvhData;
 uniform sampler2D accumTexture;
 
 uniform vec3 cameraPosition;
 uniform mat4 invViewProj;
+#ifdef FROZEN_SCENE
+// Frozen scene (FreezeScene in main_web.c): the counts are compile-time
+// constants and the scene rows and hit tests are generated GLSL appended
+// after this file, so no scene or BVH texture is read
+const int primCount = FROZEN_PRIM_COUNT;
+const int quadCount = FROZEN_QUAD_COUNT;
+const int triangleCount = FROZEN_TRIANGLE_COUNT;
+const int lightCount = FROZEN_LIGHT_COUNT;
+const int emissiveCount = FROZEN_EMITTER_COUNT;
+#else
 uniform int primCount;
+uniform int quadCount;           // row ranges by type, see primTypeOf()
+uniform int triangleCount;
 uniform int lightCount;
-uniform int emissiveCount;
-uniform int emissiveIndices[16]; // indices of emissive primitives (max 16)
+uniform int emissiveCount;       // slots in the emitter alias table
+#endif
+uniform int bvhNodeCount;
+uniform int lightSampling;       // LIGHT_SAMPLING_ONE / LIGHT_SAMPLING_ALL
 uniform float k_linear;
 uniform float k_quadratic;
 uniform float aoRadius;
@@ -63,9 +130,25 @@ uniform int frameCount;
 uniform vec2 resolution;
 uniform int samplesPerFrame; // SPP per frame (1-16)
 uniform sampler2D envMap;
-uniform int useEnvMap;       // 0=sky gradient, 1=HDR env map, 2=procedural sky
+uniform int useEnvMap;       // 0=sky gradient, 1=HDR env map, 2=procedural sky (baked into envMap)
 uniform float envIntensity;
 uniform float envRotation;
+uniform sampler2D envCdf;    // env_map.h CDF rows, bound by hand to its own texture unit
+uniform ivec2 envSize;       // envMap size in texels; (0, 0) = nothing bound
+uniform int samplerMode;     // SAMPLER_SOBOL / SAMPLER_PCG
+uniform sampler2D blueNoise; // blue_noise.h rank tile, bound by hand like envCdf
+uniform sampler2D momentsTexture; // previous momentsOut, bound by hand
+uniform sampler2D sampleBudget;   // sample_budget.glsl output: spp / 255 per tile, bound by hand
+uniform int adaptiveSampling;     // 1 = take spp from sampleBudget instead of samplesPerFrame
+uniform int accumMode;            // ACCUM_SUM_FLOAT / ACCUM_BLEND_HALF
+uniform sampler2D gbufferTexture; // previous gbufferOut, bound by hand
+uniform mat4 prevViewProj;        // view-projection accumTexture was rendered with
+uniform int reprojectFrame;       // 1 = camera moved: reproject history instead of reading in place
+uniform int useVisibility;        // 1 = texture0 matches this target: primary hits come from it
+uniform int gbufferOnly;          // 1 = upsampling guide: write the first-hit G-buffer as color, no shading
+
+#include "camera.glsl"
+#include "sky.glsl"
 
 // ============================================================
 // Structs
@@ -82,11 +165,36 @@ struct HitRecord {
     bool isHit;
 };
 
+#ifdef FROZEN_SCENE
+vec4 frozenGeomTexel(int prim, int col);
+vec4 frozenSceneTexel(int row, int col);
+void frozenClosestHit(in Ray r, inout float tBest, inout vec3 bestN, inout int hitIndex);
+bool frozenAnyHit(in Ray r, float maxDist);
+#endif
+
 // ============================================================
-// Scene data access via texelFetch (8-wide horizontal layout)
+// Scene data access via texelFetch (geometry rows + material rows)
 // ============================================================
+vec4 geomTexel(int prim, int col) {
+#ifdef FROZEN_SCENE
+    return frozenGeomTexel(prim, col);
+#else
+    return texelFetch(geomData, ivec2(col, prim), 0);
+#endif
+}
+
+// Type from the row range alone — no fetch, and a test on uniforms
+int primTypeOf(int prim) {
+    if (prim < quadCount) return PRIM_QUAD;
+    return prim < quadCount + triangleCount ? PRIM_TRIANGLE : PRIM_SPHERE;
+}
+
 vec4 sceneTexel(int row, int col) {
+#ifdef FROZEN_SCENE
+    return frozenSceneTexel(row, col);
+#else
     return texelFetch(sceneData, ivec2(col, row), 0);
+#endif
 }
 
 void getPrimMat(int idx,
@@ -94,9 +202,9 @@ void getPrimMat(int idx,
                 out vec3 emission, out float emissionStrength,
                 out float ior, out float roughness,
                 out float specular, out float shininess) {
-    vec4 d1 = sceneTexel(idx, 1);
-    vec4 d2 = sceneTexel(idx, 2);
-    vec4 d3 = sceneTexel(idx, 3);
+    vec4 d1 = sceneTexel(idx, 0);
+    vec4 d2 = sceneTexel(idx, 1);
+    vec4 d3 = sceneTexel(idx, 2);
     color = d1.xyz;
     material = int(d1.w + 0.5);
     emission = d2.xyz;
@@ -153,9 +261,97 @@ vec3 randomUnitVec3() {
     return rv / sqrt(lenSq);
 }
 
-vec3 cosineWeightedHemisphere(vec3 normal) {
-    float u1 = randomDouble();
-    float u2 = randomDouble();
+// ============================================================
+// Sampler — one stream per sample dimension
+// ============================================================
+// Each random decision of a path draws from its own dimension, so the same
+// decision lines up across the samples of a pixel:
+//   dim 0: camera jitter; then SAMPLE_DIMS_PER_BOUNCE per bounce (bounceDim).
+// SAMPLER_SOBOL gives dimension d the 2D Sobol (0,2)-sequence, shuffled and
+// Owen-scrambled with seeds hashed from d (Burley 2020 padding), and shifts it
+// per pixel by the blue-noise tile — every pixel walks the same well
+// stratified sequence, offset so that neighbours' errors differ. SAMPLER_PCG
+// answers every request from randomDouble() instead.
+#define SAMPLE_LIGHT_PICK    0   // 1D: explicit light selection
+#define SAMPLE_EMITTER_PICK  1   // 1D: alias-table slot + coin
+#define SAMPLE_EMITTER_POINT 2   // 2D: point on the emitter
+#define SAMPLE_ENV_TEXEL     3   // 2D: env CDF row / column
+#define SAMPLE_ENV_JITTER    4   // 2D: position inside the env texel
+#define SAMPLE_SCATTER       5   // 2D: BRDF direction (x doubles as the dielectric coin)
+#define SAMPLE_RR            6   // 1D: Russian roulette
+#define SAMPLE_DIMS_PER_BOUNCE 7
+
+uint samplerIndex;    // this sample's position in the pixel's sequence
+ivec2 samplerPixel;
+
+int bounceDim(int depth, int dim) {
+    return 1 + depth * SAMPLE_DIMS_PER_BOUNCE + dim;
+}
+
+uint reverseBits(uint x) {
+    x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+    x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+    x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+    x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+    return (x >> 16u) | (x << 16u);
+}
+
+// Laine-Karras hash: each output bit depends only on the input bits below it
+uint laineKarrasPermutation(uint x, uint seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Base-2 Owen scramble: each bit flipped by a hash of the bits above it
+uint nestedUniformScramble(uint x, uint seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+// Sobol dimension 1; dimension 0 is reverseBits(i)
+uint sobolDim1(uint i) {
+    uint v = 0x80000000u;
+    uint x = 0u;
+    for (; i != 0u; i >>= 1u) {
+        if ((i & 1u) != 0u) x ^= v;
+        v ^= v >> 1u;
+    }
+    return x;
+}
+
+float blueNoiseShift(int slot) {
+    // R2-sequence tile offsets keep the per-slot shifts decorrelated
+    ivec2 offset = ivec2(fract(vec2(0.7548776662, 0.5698402910) * float(slot)) * float(BLUE_NOISE_SIZE));
+    return texelFetch(blueNoise, (samplerPixel + offset) & (BLUE_NOISE_SIZE - 1), 0).r;
+}
+
+float uintToUnit(uint x) {
+    return float(x >> 8u) * (1.0 / 16777216.0);
+}
+
+float sample1D(int dim) {
+    if (samplerMode == SAMPLER_PCG) return randomDouble();
+    uint seed = pcgHash(uint(dim) * 0x9e3779b9u + 1u);
+    uint i = nestedUniformScramble(samplerIndex, seed);
+    float u = uintToUnit(nestedUniformScramble(reverseBits(i), pcgHash(seed)));
+    return fract(u + blueNoiseShift(2 * dim));
+}
+
+vec2 sample2D(int dim) {
+    if (samplerMode == SAMPLER_PCG) return vec2(randomDouble(), randomDouble());
+    uint seed = pcgHash(uint(dim) * 0x9e3779b9u + 1u);
+    uint i = nestedUniformScramble(samplerIndex, seed);
+    vec2 u = vec2(uintToUnit(nestedUniformScramble(reverseBits(i), pcgHash(seed))),
+                  uintToUnit(nestedUniformScramble(sobolDim1(i), pcgHash(seed + 1u))));
+    return fract(u + vec2(blueNoiseShift(2 * dim), blueNoiseShift(2 * dim + 1)));
+}
+
+vec3 cosineWeightedHemisphere(vec3 normal, vec2 u) {
+    float u1 = u.x;
+    float u2 = u.y;
     float r = sqrt(u2);
     float theta = 2.0 * PI * u1;
     float x = r * cos(theta);
@@ -245,82 +441,189 @@ bool intersectTriangle(in Ray r, in vec3 A, in vec3 B, in vec3 C,
 }
 
 // ============================================================
-// Unified scene trace (closest-hit and any-hit in one function)
+// BVH traversal (closest-hit and any-hit)
 // ============================================================
 
-// Quick bounding sphere rejection (no sqrt — uses discriminant sign only)
-bool rayMissesBounds(in Ray r, vec3 center, float radius, float maxDist) {
-    vec3 oc = r.origin - center;
-    float b = dot(r.direction, oc);
-    float c = dot(oc, oc) - radius * radius;
-    // If discriminant < 0, ray misses entirely
-    if (b * b - c < 0.0) return true;
-    // If sphere is entirely behind ray origin (closest point is behind us)
-    if (b > 0.0 && c > 0.0) return true;
+vec4 bvhTexel(int node, int col) {
+    return texelFetch(bvhData, ivec2(col, node), 0);
+}
+
+// 1/dir with zero components nudged away from 0 so the slab test stays finite
+vec3 safeInverse(vec3 d) {
+    return 1.0 / mix(d, vec3(1e-8), lessThan(abs(d), vec3(1e-8)));
+}
+
+// Slab test: entry distance of the ray into [bmin, bmax] within (0, tMax), or 1e38 on miss
+float intersectAABB(vec3 ro, vec3 invDir, vec3 bmin, vec3 bmax, float tMax) {
+    vec3 t0 = (bmin - ro) * invDir;
+    vec3 t1 = (bmax - ro) * invDir;
+    vec3 tSmall = min(t0, t1);
+    vec3 tBig = max(t0, t1);
+    float tNear = max(max(tSmall.x, tSmall.y), max(tSmall.z, 0.0));
+    float tFar = min(min(tBig.x, tBig.y), min(tBig.z, tMax));
+    return tNear <= tFar ? tNear : 1e38;
+}
+
+float intersectNodeBounds(in Ray r, vec3 invDir, int node, float tMax) {
+    return intersectAABB(r.origin, invDir, bvhTexel(node, 0).xyz, bvhTexel(node, 1).xyz, tMax);
+}
+
+// Only the types the variant was built for are tested; with a single type
+// there is no dispatch at all
+bool intersectPrim(int i, in Ray r, float tMax, out float tHit, out vec3 hitN) {
+#if !HAS_SPHERES && !HAS_QUADS && !HAS_TRIANGLES
+    tHit = 1e38;
+    hitN = vec3(0.0);
     return false;
+#else
+    vec4 g0 = geomTexel(i, 0);
+#if HAS_SPHERES
+#if HAS_QUADS || HAS_TRIANGLES
+    if (primTypeOf(i) == PRIM_SPHERE)
+#endif
+        return intersectSphere(r, g0.xyz, g0.w, tMax, tHit, hitN);
+#endif
+#if HAS_QUADS || HAS_TRIANGLES
+    vec4 g1 = geomTexel(i, 1);
+    vec4 g2 = geomTexel(i, 2);
+#if HAS_QUADS
+#if HAS_TRIANGLES
+    if (i < quadCount)
+#endif
+        return intersectQuad(r, g0.xyz, g1.xyz, g2.xyz, tMax, tHit, hitN);
+#endif
+#if HAS_TRIANGLES
+    return intersectTriangle(r, g0.xyz, g1.xyz, g2.xyz, tMax, tHit, hitN);
+#endif
+#endif
+#endif
 }
 
-// Closest-hit: finds nearest intersection (for primary/scatter rays)
+// Closest-hit: front-to-back ordered traversal (for primary/scatter rays)
 void findClosestHit(in Ray r, out HitRecord closestHit, out int hitIndex) {
     closestHit = HitRecord(1e38, vec3(0.0), vec3(0.0), false);
     hitIndex = -1;
     float tBest = 1e38;
-    int count = min(primCount, MAX_PRIMS);
-
-    for (int i = 0; i < count; i++) {
-        int ptype = int(sceneTexel(i, 0).x + 0.5);
-        vec4 g0 = sceneTexel(i, 4);
-        float tHit;
-        vec3 hitN;
-        bool hit = false;
-
-        if (ptype == PRIM_SPHERE) {
-            hit = intersectSphere(r, g0.xyz, g0.w, tBest, tHit, hitN);
+#ifdef FROZEN_SCENE
+    vec3 frozenN = vec3(0.0);
+    frozenClosestHit(r, tBest, frozenN, hitIndex);
+    if (hitIndex >= 0)
+        closestHit = HitRecord(tBest, r.origin + tBest * r.direction, frozenN, true);
+#else
+    if (bvhNodeCount <= 0) return;
+
+    vec3 invDir = safeInverse(r.direction);
+    if (intersectNodeBounds(r, invDir, 0, tBest) >= 1e38) return;
+
+    int stackNode[BVH_STACK_SIZE];
+    float stackT[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = 0;
+
+    while (true) {
+        vec4 n0 = bvhTexel(node, 0);
+        vec4 n1 = bvhTexel(node, 1);
+        if (n1.w < 0.0) {
+            // Leaf: one primitive
+            int i = int(n0.w + 0.5);
+            float tHit;
+            vec3 hitN;
+            if (intersectPrim(i, r, tBest, tHit, hitN) && tHit < tBest) {
+                tBest = tHit;
+                closestHit.t = tHit;
+                closestHit.hitPoint = r.origin + tHit * r.direction;
+                closestHit.normal = hitN;
+                closestHit.isHit = true;
+                hitIndex = i;
+            }
         } else {
-            vec4 g1 = sceneTexel(i, 5);
-            vec4 g2 = sceneTexel(i, 6);
-            if (ptype == PRIM_QUAD) {
-                hit = intersectQuad(r, g0.xyz, g1.xyz, g2.xyz, tBest, tHit, hitN);
-            } else {
-                hit = intersectTriangle(r, g0.xyz, g1.xyz, g2.xyz, tBest, tHit, hitN);
+            int left = int(n0.w + 0.5);
+            int right = int(n1.w + 0.5);
+            float tL = intersectNodeBounds(r, invDir, left, tBest);
+            float tR = intersectNodeBounds(r, invDir, right, tBest);
+            if (tL < 1e38 && tR < 1e38) {
+                // Visit the nearer child first, defer the farther one
+                bool leftFirst = tL <= tR;
+                if (sp < BVH_STACK_SIZE) {
+                    stackNode[sp] = leftFirst ? right : left;
+                    stackT[sp] = leftFirst ? tR : tL;
+                    sp++;
+                }
+                node = leftFirst ? left : right;
+                continue;
+            } else if (tL < 1e38) {
+                node = left;
+                continue;
+            } else if (tR < 1e38) {
+                node = right;
+                continue;
             }
         }
 
-        if (hit && tHit < tBest) {
-            tBest = tHit;
-            closestHit.t = tHit;
-            closestHit.hitPoint = r.origin + tHit * r.direction;
-            closestHit.normal = hitN;
-            closestHit.isHit = true;
-            hitIndex = i;
+        // Pop the next deferred node that can still beat tBest
+        bool found = false;
+        while (sp > 0) {
+            sp--;
+            if (stackT[sp] < tBest) {
+                node = stackNode[sp];
+                found = true;
+                break;
+            }
         }
+        if (!found) break;
+    }
+#endif
+}
+
+// Primary hit from the visibility pre-pass: visPrim is the primitive rasterized
+// under the pixel (VIS_MISS = sky, VIS_UNKNOWN = no usable pre-pass). Only that
+// primitive is intersected; a ray that slips off it takes the BVH after all.
+#define VIS_MISS -1
+#define VIS_UNKNOWN -2
+
+void findPrimaryHit(in Ray r, int visPrim, out HitRecord hit, out int hitIndex) {
+    float tHit;
+    vec3 hitN;
+    if (visPrim == VIS_MISS) {
+        hit = HitRecord(1e38, vec3(0.0), vec3(0.0), false);
+        hitIndex = -1;
+    } else if (visPrim >= 0 && intersectPrim(visPrim, r, 1e38, tHit, hitN)) {
+        hit = HitRecord(tHit, r.origin + tHit * r.direction, hitN, true);
+        hitIndex = visPrim;
+    } else {
+        findClosestHit(r, hit, hitIndex);
     }
 }
 
-// Any-hit: returns immediately on first intersection (for shadow/AO)
+// Any-hit: returns on the first intersection (for shadow/AO)
 bool anyHitWithin(in Ray r, float maxDist) {
-    int count = min(primCount, MAX_PRIMS);
-    for (int i = 0; i < count; i++) {
-        int ptype = int(sceneTexel(i, 0).x + 0.5);
-        vec4 g0 = sceneTexel(i, 4);
-        float tHit;
-        vec3 hitN;
-
-        if (ptype == PRIM_SPHERE) {
-            if (intersectSphere(r, g0.xyz, g0.w, maxDist, tHit, hitN)) return true;
-        } else {
-            vec4 bs = sceneTexel(i, 7);
-            if (rayMissesBounds(r, bs.xyz, bs.w, maxDist)) continue;
-            vec4 g1 = sceneTexel(i, 5);
-            vec4 g2 = sceneTexel(i, 6);
-            if (ptype == PRIM_QUAD) {
-                if (intersectQuad(r, g0.xyz, g1.xyz, g2.xyz, maxDist, tHit, hitN)) return true;
-            } else {
-                if (intersectTriangle(r, g0.xyz, g1.xyz, g2.xyz, maxDist, tHit, hitN)) return true;
-            }
+#ifdef FROZEN_SCENE
+    return frozenAnyHit(r, maxDist);
+#else
+    if (bvhNodeCount <= 0) return false;
+    vec3 invDir = safeInverse(r.direction);
+
+    int stackNode[BVH_STACK_SIZE];
+    int sp = 0;
+    stackNode[sp++] = 0;
+
+    while (sp > 0) {
+        int node = stackNode[--sp];
+        vec4 n0 = bvhTexel(node, 0);
+        vec4 n1 = bvhTexel(node, 1);
+        if (intersectAABB(r.origin, invDir, n0.xyz, n1.xyz, maxDist) >= 1e38) continue;
+
+        if (n1.w < 0.0) {
+            float tHit;
+            vec3 hitN;
+            if (intersectPrim(int(n0.w + 0.5), r, maxDist, tHit, hitN)) return true;
+        } else if (sp + 2 <= BVH_STACK_SIZE) {
+            stackNode[sp++] = int(n1.w + 0.5);
+            stackNode[sp++] = int(n0.w + 0.5);
         }
     }
     return false;
+#endif
 }
 
 // ============================================================
@@ -331,7 +634,7 @@ float computeAO(in vec3 hitPoint, in vec3 normal) {
     float occlusion = 0.0;
     float effectiveRadius = max(aoRadius, 0.01);
     for (int i = 0; i < AO_SAMPLES; i++) {
-        vec3 dir = cosineWeightedHemisphere(normal);
+        vec3 dir = cosineWeightedHemisphere(normal, vec2(randomDouble(), randomDouble()));
         Ray aoRay = Ray(hitPoint + normal * EPSILON, dir);
         if (anyHitWithin(aoRay, effectiveRadius)) {
             occlusion += 1.0;
@@ -346,10 +649,10 @@ float computeAO(in vec3 hitPoint, in vec3 normal) {
 float computeShadowFactor(in vec3 hitPoint, in vec3 normal,
                           in vec3 toLight, in float maxDist,
                           in vec3 lightPos, in float lightRadius,
-                          in int lightType) {
+                          in int lightType, in int samples) {
     if (lightRadius > 0.001) {
         float visible = 0.0;
-        for (int s = 0; s < SOFT_SHADOW_SAMPLES; s++) {
+        for (int s = 0; s < samples; s++) {
             vec3 jitter = (randomVec3() * 2.0 - 1.0) * lightRadius;
             vec3 jitteredDir;
             float jitteredDist;
@@ -367,13 +670,46 @@ float computeShadowFactor(in vec3 hitPoint, in vec3 normal,
                 visible += 1.0;
             }
         }
-        return visible / float(SOFT_SHADOW_SAMPLES);
+        return visible / float(samples);
     } else {
         Ray shadowRay = Ray(hitPoint + normal * EPSILON, toLight);
         return anyHitWithin(shadowRay, maxDist) ? 0.0 : 1.0;
     }
 }
 
+// ============================================================
+// Explicit lights
+// ============================================================
+
+// Unit direction, attenuated intensity and shadow-ray length from P to a light
+void lightIncidence(in int lType, in vec3 lDir, in vec3 lPos, in float lInt,
+                    in vec3 P, out vec3 toLight, out float attIntensity,
+                    out float maxShadowDist) {
+    if (lType == 1) {
+        vec3 dirToLight = lPos - P;
+        float dLight = length(dirToLight);
+        toLight = dirToLight / dLight;
+        attIntensity = lInt / (1.0 + k_linear * dLight + k_quadratic * dLight * dLight);
+        maxShadowDist = dLight;
+    } else {
+        toLight = normalize(-lDir);
+        attIntensity = lInt;
+        maxShadowDist = 1e38;
+    }
+}
+
+// Unshadowed contribution estimate used to pick a light: luminance x
+// attenuated intensity x cosine. Zero exactly where shadeLight() is zero.
+float estimateLight(in int li, in vec3 P, in vec3 N) {
+    int lType; vec3 lDir; vec3 lPos; vec3 lCol; float lInt; float lRad;
+    getLight(li, lType, lDir, lPos, lCol, lInt, lRad);
+    vec3 toLight;
+    float attIntensity, maxShadowDist;
+    lightIncidence(lType, lDir, lPos, lInt, P, toLight, attIntensity, maxShadowDist);
+    float NdotL = max(dot(N, toLight), 0.0);
+    return dot(lCol, vec3(0.2126, 0.7152, 0.0722)) * attIntensity * NdotL;
+}
+
 // ============================================================
 // GGX / Cook-Torrance PBR
 // ============================================================
@@ -402,9 +738,9 @@ vec3 F_Schlick(float cosTheta, vec3 F0) {
 }
 
 // GGX importance sampling: sample half-vector H from the NDF
-vec3 sampleGGX(vec3 N, float alpha) {
-    float u1 = randomDouble();
-    float u2 = randomDouble();
+vec3 sampleGGX(vec3 N, float alpha, vec2 u) {
+    float u1 = u.x;
+    float u2 = u.y;
 
     // Sample spherical coords for H in tangent space
     float a2 = alpha * alpha;
@@ -427,15 +763,15 @@ vec3 sampleGGX(vec3 N, float alpha) {
 // Emissive primitive sampling (Next Event Estimation)
 // ============================================================
 
-// Sample a random point on a quad surface, return direction and PDF
-bool sampleQuadLight(int idx, vec3 hitPoint, out vec3 lightDir, out float lightDist, out float pdf) {
-    vec3 Q = sceneTexel(idx, 4).xyz;
-    vec3 u = sceneTexel(idx, 5).xyz;
-    vec3 v = sceneTexel(idx, 6).xyz;
+// Sample a point on a quad surface from u, return direction and PDF
+bool sampleQuadLight(int idx, vec3 hitPoint, vec2 uPoint, out vec3 lightDir, out float lightDist, out float pdf) {
+    vec3 Q = geomTexel(idx, 0).xyz;
+    vec3 u = geomTexel(idx, 1).xyz;
+    vec3 v = geomTexel(idx, 2).xyz;
 
-    // Random point on quad
-    float s = randomDouble();
-    float t = randomDouble();
+    // Point on quad
+    float s = uPoint.x;
+    float t = uPoint.y;
     vec3 pointOnLight = Q + u * s + v * t;
 
     vec3 toLight = pointOnLight - hitPoint;
@@ -458,9 +794,38 @@ bool sampleQuadLight(int idx, vec3 hitPoint, out vec3 lightDir, out float lightD
     return true;
 }
 
-// Sample a random point on a sphere light, return direction and PDF (solid angle)
-bool sampleSphereLight(int idx, vec3 hitPoint, out vec3 lightDir, out float lightDist, out float pdf) {
-    vec4 g0 = sceneTexel(idx, 4);
+// Uniform point on triangle ABC (sqrt-warped barycentrics), area PDF -> solid angle
+bool sampleTriangleLight(int idx, vec3 hitPoint, vec2 u, out vec3 lightDir, out float lightDist, out float pdf) {
+    vec3 A = geomTexel(idx, 0).xyz;
+    vec3 B = geomTexel(idx, 1).xyz;
+    vec3 C = geomTexel(idx, 2).xyz;
+
+    float su = sqrt(u.x);
+    float r2 = u.y;
+    float b0 = 1.0 - su;
+    float b1 = r2 * su;
+    vec3 pointOnLight = A * b0 + B * b1 + C * (1.0 - b0 - b1);
+
+    vec3 toLight = pointOnLight - hitPoint;
+    float dist2 = dot(toLight, toLight);
+    lightDist = sqrt(dist2);
+    lightDir = toLight / lightDist;
+
+    vec3 n = cross(B - A, C - A);
+    float len = length(n);
+    if (len < 1e-8) return false;
+    float area = 0.5 * len;
+
+    float cosAtLight = abs(dot(n / len, -lightDir));
+    if (cosAtLight < 1e-8) return false;
+
+    pdf = dist2 / (area * cosAtLight);
+    return true;
+}
+
+// Sample a point on a sphere light from u, return direction and PDF (solid angle)
+bool sampleSphereLight(int idx, vec3 hitPoint, vec2 u, out vec3 lightDir, out float lightDist, out float pdf) {
+    vec4 g0 = geomTexel(idx, 0);
     vec3 center = g0.xyz;
     float radius = g0.w;
 
@@ -473,8 +838,8 @@ bool sampleSphereLight(int idx, vec3 hitPoint, out vec3 lightDir, out float ligh
     float cosThetaMax = sqrt(max(0.0, 1.0 - sinThetaMax2));
 
     // Sample uniform cone
-    float u1 = randomDouble();
-    float u2 = randomDouble();
+    float u1 = u.x;
+    float u2 = u.y;
     float cosTheta = 1.0 + u1 * (cosThetaMax - 1.0);
     float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
     float phi = 2.0 * PI * u2;
@@ -498,6 +863,22 @@ bool sampleSphereLight(int idx, vec3 hitPoint, out vec3 lightDir, out float ligh
     return true;
 }
 
+vec4 emitterTexel(int slot) {
+    int row = slot / SCENE_TEX_WIDTH;
+    return sceneTexel(EMITTER_ROW_BASE + row, slot - row * SCENE_TEX_WIDTH);
+}
+
+// O(1) power-proportional emitter pick via the alias table.
+// The leftover fraction of the slot draw doubles as the alias coin.
+int sampleEmitter(float u1, out float selectPdf) {
+    float u = u1 * float(emissiveCount);
+    int slot = min(int(u), emissiveCount - 1);
+    vec4 e = emitterTexel(slot);
+    if (u - float(slot) >= e.y) e = emitterTexel(int(e.z + 0.5));
+    selectPdf = e.w;
+    return int(e.x + 0.5);
+}
+
 // Power heuristic (beta=2)
 float powerHeuristic(float pdfA, float pdfB) {
     float a2 = pdfA * pdfA;
@@ -512,7 +893,7 @@ float cosinePdf(float NdotL) {
 // ============================================================
 // Dielectric scattering (Snell + Schlick)
 // ============================================================
-void scatterDielectric(in Ray currentRay, in HitRecord hit, in float ior,
+void scatterDielectric(in Ray currentRay, in HitRecord hit, in float ior, in float u,
                        out Ray scattered, out vec3 attenuation) {
     vec3 unitDir = normalize(currentRay.direction);
     vec3 normal;
@@ -535,7 +916,7 @@ void scatterDielectric(in Ray currentRay, in HitRecord hit, in float ior,
     float reflectance = r0 + (1.0 - r0) * pow(1.0 - cosTheta, 5.0);
 
     vec3 direction;
-    if (cannotRefract || reflectance > randomDouble()) {
+    if (cannotRefract || reflectance > u) {
         direction = reflect(unitDir, normal);
         scattered = Ray(hit.hitPoint + normal * EPSILON, direction);
     } else {
@@ -557,53 +938,72 @@ vec2 dirToEquirect(vec3 dir) {
     return vec2(phi / (2.0 * PI) + 0.5, theta / PI + 0.5);
 }
 
-// Procedural HDR sky: golden hour cinematic
-vec3 proceduralSky(vec3 dir) {
-    // Low sun for golden hour drama
-    vec3 sunDir = normalize(vec3(0.6, 0.12, -0.7));
-    float sunDot = max(dot(dir, sunDir), 0.0);
-
-    // Deep twilight gradient
-    float t = max(dir.y, 0.0);
-    vec3 zenith  = vec3(0.04, 0.06, 0.18);  // deep navy
-    vec3 mid     = vec3(0.12, 0.08, 0.22);  // dusky purple
-    vec3 horizon = vec3(0.5, 0.25, 0.12);   // burnt orange horizon
-
-    vec3 sky = mix(horizon, mid, pow(t, 0.3));
-    sky = mix(sky, zenith, pow(t, 0.8));
-
-    // Sun: large warm glow near horizon
-    float sunDisk = pow(sunDot, 512.0) * 8.0;
-    float sunHalo = pow(sunDot, 4.0) * 0.6;
-    float sunBloom = pow(sunDot, 16.0) * 1.5;
-    vec3 sunColor = vec3(1.0, 0.65, 0.3);
-    sky += sunColor * (sunDisk + sunBloom) + vec3(1.0, 0.8, 0.5) * sunHalo;
-
-    // Ground: dark warm
-    if (dir.y < 0.0) {
-        vec3 ground = vec3(0.08, 0.06, 0.04);
-        sky = mix(ground, horizon, exp(dir.y * 6.0));
-    }
-
-    return sky;
-}
-
 // Get environment radiance for a ray direction
 vec3 sampleEnvironment(vec3 dir) {
     vec3 color;
-    if (useEnvMap == 1) {
-        vec2 uv = dirToEquirect(dir);
-        color = texture(envMap, uv).rgb;
-    } else if (useEnvMap == 2) {
-        color = proceduralSky(dir);
+    if (ENV_TABLE_ACTIVE) {
+        // Loaded .hdr or the host-baked procedural sky — same lat-long table
+        color = texture(envMap, dirToEquirect(dir)).rgb;
     } else {
-        // Simple gradient (original)
-        float a = 0.5 * (dir.y + 1.0);
-        color = mix(vec3(0.3, 0.5, 0.8), vec3(1.0), a);
+        color = skyGradient(dir);
     }
     return color * envIntensity;
 }
 
+// ============================================================
+// HDR environment importance sampling (marginal/conditional CDFs)
+// ============================================================
+bool envSamplingEnabled() {
+    return ENV_TABLE_ACTIVE && envSize.x > 0;
+}
+
+// First entry of CDF row `row` (n entries) that exceeds u
+int envCdfSearch(int row, int n, float u) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (texelFetch(envCdf, ivec2(mid, row), 0).r > u) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+float envCdfMass(int row, int i) {
+    float prev = (i > 0) ? texelFetch(envCdf, ivec2(i - 1, row), 0).r : 0.0;
+    return texelFetch(envCdf, ivec2(i, row), 0).r - prev;
+}
+
+// Solid-angle pdf of a direction inside texel (x, y) with cos(latitude) = cosLat:
+// texel pmf x texel count is the uv density, 2 pi^2 cos(lat) the uv -> sphere Jacobian
+float envTexelPdf(int x, int y, float cosLat) {
+    if (cosLat <= 1e-6) return 0.0;
+    float pmf = envCdfMass(envSize.y, y) * envCdfMass(y, x);
+    return pmf * float(envSize.x * envSize.y) / (2.0 * PI * PI * cosLat);
+}
+
+// Pdf with which sampleEnvLight() generates dir
+float envLightPdf(vec3 dir) {
+    vec2 uv = dirToEquirect(dir);
+    int x = min(int(fract(uv.x) * float(envSize.x)), envSize.x - 1);
+    int y = clamp(int(uv.y * float(envSize.y)), 0, envSize.y - 1);
+    return envTexelPdf(x, y, sqrt(max(1.0 - dir.y * dir.y, 0.0)));
+}
+
+// Direction roughly proportional to environment radiance: row from the
+// marginal CDF, column from that row's conditional, uniform within the texel
+bool sampleEnvLight(vec2 uTexel, vec2 uJitter, out vec3 dir, out float pdf) {
+    int y = envCdfSearch(envSize.y, envSize.y, uTexel.y);
+    int x = envCdfSearch(y, envSize.x, uTexel.x);
+    vec2 uv = vec2((float(x) + uJitter.x) / float(envSize.x),
+                   (float(y) + uJitter.y) / float(envSize.y));
+    float lat = (uv.y - 0.5) * PI;
+    float phi = (uv.x - 0.5) * 2.0 * PI - envRotation;
+    float cosLat = cos(lat);
+    dir = vec3(cosLat * cos(phi), sin(lat), cosLat * sin(phi));
+    pdf = envTexelPdf(x, y, cosLat);
+    return pdf > 0.0;
+}
+
 // ============================================================
 // Evaluate BRDF for a given (N, V, L) — returns BRDF * NdotL
 // ============================================================
@@ -628,22 +1028,59 @@ vec3 evalBRDF(vec3 N, vec3 V, vec3 L, vec3 hitColor, int hitMat, float hitRough)
     }
 }
 
+// Pdf of L under the scatter step's sampling: GGX half-vector for metal, cosine otherwise
+float brdfPdf(vec3 N, vec3 V, vec3 L, int hitMat, float hitRough) {
+    float NdotL = dot(N, L);
+    if (NdotL <= 0.0) return 0.0;
+    if (hitMat != 1) return cosinePdf(NdotL);
+    vec3 H = normalize(L + V);
+    float alpha = max(hitRough * hitRough, 0.002);
+    float NdotH = max(dot(N, H), 0.0);
+    float VdotH = max(dot(V, H), 0.0);
+    return D_GGX(NdotH, alpha) * NdotH / (4.0 * VdotH + 1e-7);
+}
+
+// Shadowed direct contribution (BRDF * NdotL * radiance) of explicit light li;
+// soft lights average `shadowSamples` jittered shadow rays
+vec3 shadeLight(int li, vec3 P, vec3 N, vec3 V, vec3 hitColor, int hitMat,
+                float hitRough, int shadowSamples) {
+    int lType; vec3 lDir; vec3 lPos; vec3 lCol; float lInt; float lRad;
+    getLight(li, lType, lDir, lPos, lCol, lInt, lRad);
+    vec3 toLight;
+    float attIntensity, maxShadowDist;
+    lightIncidence(lType, lDir, lPos, lInt, P, toLight, attIntensity, maxShadowDist);
+
+    if (dot(N, toLight) <= 0.0) return vec3(0.0);
+    float shadow = computeShadowFactor(P, N, toLight, maxShadowDist,
+                                       lPos, lRad, lType, shadowSamples);
+    if (shadow <= 0.0) return vec3(0.0);
+    return evalBRDF(N, V, toLight, hitColor, hitMat, hitRough) * lCol * attIntensity * shadow;
+}
+
 // ============================================================
 // Main ray tracing loop with NEE + MIS
 // ============================================================
-vec3 colorRayIterative(in Ray initialRay) {
+// visPrim: primary-hit hint for findPrimaryHit (VIS_UNKNOWN = trace the BVH)
+vec3 colorRayIterative(in Ray initialRay, int visPrim) {
     vec3 outColor = vec3(0.0);
     vec3 throughput = vec3(1.0);
     Ray currentRay = initialRay;
     bool lastBounceSpecular = false;
+    float lastBrdfPdf = 0.0;     // pdf of currentRay's direction, for env MIS
 
     for (int depth = 0; depth < MAX_DEPTH; depth++) {
         HitRecord closestHit;
         int hitIndex;
-        findClosestHit(currentRay, closestHit, hitIndex);
+        if (depth == 0) findPrimaryHit(currentRay, visPrim, closestHit, hitIndex);
+        else findClosestHit(currentRay, closestHit, hitIndex);
 
         if (hitIndex == -1) {
-            outColor += throughput * sampleEnvironment(normalize(currentRay.direction));
+            vec3 envDir = normalize(currentRay.direction);
+            vec3 envL = sampleEnvironment(envDir);
+            // BRDF-sampled half of the environment MIS pair
+            if (envSamplingEnabled() && depth > 0 && !lastBounceSpecular)
+                envL *= powerHeuristic(lastBrdfPdf, envLightPdf(envDir));
+            outColor += throughput * envL;
             break;
         }
 
@@ -668,100 +1105,136 @@ vec3 colorRayIterative(in Ray initialRay) {
 
         // AO — skip during early convergence for speed, enable once settled
         float ao = 1.0;
+#if HAS_AO
         if (depth < 3 && frameCount > 8) {
             ao = computeAO(closestHit.hitPoint, closestHit.normal);
         }
+#endif
 
         vec3 N = closestHit.normal;
         vec3 V = normalize(cameraPosition - closestHit.hitPoint);
         if (depth > 0) V = normalize(-currentRay.direction);
 
         // === Direct lighting from explicit lights ===
+#if HAS_LIGHTS
         int lCount = min(lightCount, MAX_LIGHTS);
-        for (int li = 0; li < lCount; li++) {
-            int lType; vec3 lDir; vec3 lPos; vec3 lCol; float lInt; float lRad;
-            getLight(li, lType, lDir, lPos, lCol, lInt, lRad);
-
-            vec3 toLight;
-            float attIntensity, maxShadowDist;
-
-            if (lType == 1) {
-                vec3 dirToLight = lPos - closestHit.hitPoint;
-                float dLight = length(dirToLight);
-                toLight = dirToLight / dLight;
-                attIntensity = lInt / (1.0 + k_linear * dLight + k_quadratic * dLight * dLight);
-                maxShadowDist = dLight;
-            } else {
-                toLight = normalize(-lDir);
-                attIntensity = lInt;
-                maxShadowDist = 1e38;
+        if (lightSampling == LIGHT_SAMPLING_ALL) {
+            for (int li = 0; li < lCount; li++) {
+                outColor += throughput * shadeLight(li, closestHit.hitPoint, N, V,
+                    hitColor, hitMat, hitRough, SOFT_SHADOW_SAMPLES) * ao;
             }
-
-            float NdotL = max(dot(N, toLight), 0.0);
-            if (NdotL <= 0.0) continue;
-
-            float shadow = computeShadowFactor(closestHit.hitPoint, N,
-                toLight, maxShadowDist, lPos, lRad, lType);
-
-            if (shadow > 0.0) {
-                vec3 brdfVal = evalBRDF(N, V, toLight, hitColor, hitMat, hitRough);
-                outColor += throughput * brdfVal * lCol * attIntensity * shadow * ao;
+        } else if (lCount > 0) {
+            // Pick one light with probability proportional to its unshadowed
+            // estimate and trace a single shadow ray toward it
+            float lWeight[MAX_LIGHTS];
+            float lTotal = 0.0;
+            for (int li = 0; li < lCount; li++) {
+                lWeight[li] = estimateLight(li, closestHit.hitPoint, N);
+                lTotal += lWeight[li];
+            }
+            if (lTotal > 0.0) {
+                float u = sample1D(bounceDim(depth, SAMPLE_LIGHT_PICK)) * lTotal;
+                int pick = lCount - 1;
+                for (int li = 0; li < lCount; li++) {
+                    u -= lWeight[li];
+                    if (u < 0.0) { pick = li; break; }
+                }
+                // Float round-off can land the fallback on a zero-weight light
+                if (lWeight[pick] > 0.0) {
+                    float selectPdf = lWeight[pick] / lTotal;
+                    outColor += throughput * shadeLight(pick, closestHit.hitPoint, N, V,
+                        hitColor, hitMat, hitRough, 1) * ao / selectPdf;
+                }
             }
         }
+#endif
 
         // === NEE: Sample emissive primitives directly ===
+#if HAS_EMITTERS
         if (emissiveCount > 0 && hitMat != 3) {
-            // Pick a random emissive primitive
-            int emIdx = emissiveIndices[int(randomDouble() * float(min(emissiveCount, 16)))];
-            int emType = int(sceneTexel(emIdx, 0).x + 0.5);
+            // Pick an emissive primitive proportional to its emitted power
+            float selectPdf;
+            int emIdx = sampleEmitter(sample1D(bounceDim(depth, SAMPLE_EMITTER_PICK)), selectPdf);
+            int emType = primTypeOf(emIdx);
 
             vec3 lightDir;
             float lightDist, lightPdf;
             bool sampled = false;
+            vec2 uLight = sample2D(bounceDim(depth, SAMPLE_EMITTER_POINT));
 
+#if HAS_QUADS
             if (emType == PRIM_QUAD)
-                sampled = sampleQuadLight(emIdx, closestHit.hitPoint, lightDir, lightDist, lightPdf);
-            else if (emType == PRIM_SPHERE)
-                sampled = sampleSphereLight(emIdx, closestHit.hitPoint, lightDir, lightDist, lightPdf);
+                sampled = sampleQuadLight(emIdx, closestHit.hitPoint, uLight, lightDir, lightDist, lightPdf);
+#endif
+#if HAS_SPHERES
+            if (emType == PRIM_SPHERE)
+                sampled = sampleSphereLight(emIdx, closestHit.hitPoint, uLight, lightDir, lightDist, lightPdf);
+#endif
+#if HAS_TRIANGLES
+            if (emType == PRIM_TRIANGLE)
+                sampled = sampleTriangleLight(emIdx, closestHit.hitPoint, uLight, lightDir, lightDist, lightPdf);
+#endif
 
             if (sampled) {
+                lightPdf *= selectPdf;   // solid-angle pdf x selection probability
                 float NdotL = dot(N, lightDir);
                 if (NdotL > 0.0) {
                     // Shadow test
                     Ray shadowRay = Ray(closestHit.hitPoint + N * EPSILON, lightDir);
                     if (!anyHitWithin(shadowRay, lightDist - 2.0 * EPSILON)) {
-                        // Fetch only emission (col 2) — skip full material read
-                        vec4 emData = sceneTexel(emIdx, 2);
+                        // Fetch only emission (col 1) — skip full material read
+                        vec4 emData = sceneTexel(emIdx, 1);
                         vec3 Le = emData.xyz * emData.w;
                         vec3 brdfVal = evalBRDF(N, V, lightDir, hitColor, hitMat, hitRough);
 
                         // MIS weight (power heuristic): light PDF vs BRDF PDF
                         float brdfPdf = (hitMat == 1) ? 0.0 : cosinePdf(NdotL); // approximate
-                        float misWeight = powerHeuristic(lightPdf / float(emissiveCount), brdfPdf);
+                        float misWeight = powerHeuristic(lightPdf, brdfPdf);
 
                         if (lightPdf > 1e-10) {
-                            outColor += throughput * Le * brdfVal * misWeight
-                                      * float(emissiveCount) / lightPdf * ao;
+                            outColor += throughput * Le * brdfVal * misWeight / lightPdf * ao;
                         }
                     }
                 }
             }
         }
+#endif
+
+        // === NEE: importance-sample the HDR environment ===
+        // Skipped where the bounce below is treated as specular: those paths
+        // pick up the environment at full weight when they escape
+        bool specularHit = hitMat == 3 || (hitMat == 1 && hitRough < 0.1);
+        if (envSamplingEnabled() && !specularHit) {
+            vec3 envDir;
+            float envPdf;
+            if (sampleEnvLight(sample2D(bounceDim(depth, SAMPLE_ENV_TEXEL)),
+                               sample2D(bounceDim(depth, SAMPLE_ENV_JITTER)), envDir, envPdf) &&
+                dot(N, envDir) > 0.0) {
+                Ray shadowRay = Ray(closestHit.hitPoint + N * EPSILON, envDir);
+                if (!anyHitWithin(shadowRay, 1e38)) {
+                    vec3 brdfVal = evalBRDF(N, V, envDir, hitColor, hitMat, hitRough);
+                    float misWeight = powerHeuristic(envPdf, brdfPdf(N, V, envDir, hitMat, hitRough));
+                    // No AO factor: the escaped-ray half of this MIS pair has none either
+                    outColor += throughput * sampleEnvironment(envDir) * brdfVal * misWeight / envPdf;
+                }
+            }
+        }
 
         // === Scatter ray for next bounce ===
         Ray scattered;
         vec3 attenuation;
         lastBounceSpecular = false;
+        vec2 uScatter = sample2D(bounceDim(depth, SAMPLE_SCATTER));
 
         if (hitMat == 3) {
-            scatterDielectric(currentRay, closestHit, hitIOR, scattered, attenuation);
+            scatterDielectric(currentRay, closestHit, hitIOR, uScatter.x, scattered, attenuation);
             throughput *= attenuation * hitColor;
             lastBounceSpecular = true;
         } else if (hitMat == 1) {
             // Metal: GGX importance sampling
             float alpha = max(hitRough * hitRough, 0.002);
             vec3 Vm = normalize(-currentRay.direction);
-            vec3 H = sampleGGX(N, alpha);
+            vec3 H = sampleGGX(N, alpha, uScatter);
             vec3 L = reflect(-Vm, H);
 
             float NdotL = dot(N, L);
@@ -776,12 +1249,14 @@ vec3 colorRayIterative(in Ray initialRay) {
             float weight = G * VdotH / (NdotH * NdotV + 1e-7);
 
             scattered = Ray(closestHit.hitPoint + N * EPSILON, L);
+            lastBrdfPdf = D_GGX(NdotH, alpha) * NdotH / (4.0 * VdotH + 1e-7);
             throughput *= F * weight;
             lastBounceSpecular = (hitRough < 0.1);
         } else {
             // Lambertian: cosine-weighted hemisphere
-            vec3 scatterDir = cosineWeightedHemisphere(N);
+            vec3 scatterDir = cosineWeightedHemisphere(N, uScatter);
             scattered = Ray(closestHit.hitPoint + N * EPSILON, scatterDir);
+            lastBrdfPdf = cosinePdf(dot(N, scatterDir));
             throughput *= hitColor;
         }
 
@@ -790,7 +1265,7 @@ vec3 colorRayIterative(in Ray initialRay) {
         // Russian roulette after depth 2 (more aggressive with MIS)
         if (depth > 2) {
             float p = clamp(max(throughput.x, max(throughput.y, throughput.z)), 0.05, 0.95);
-            if (randomDouble() > p) break;
+            if (sample1D(bounceDim(depth, SAMPLE_RR)) > p) break;
             throughput /= p;
         }
     }
@@ -801,43 +1276,205 @@ vec3 colorRayIterative(in Ray initialRay) {
 // ============================================================
 // Main — outputs LINEAR HDR, multi-sample per frame
 // ============================================================
+// ============================================================
+// Temporal reprojection
+// ============================================================
+// On camera motion each pixel's first hit is projected into the previous view
+// and that view's accumulation is reused if the same surface is visible there.
+#define REPROJECT_MAX_HISTORY 256.0     // samples kept, so view-dependent shading catches up
+#define REPROJECT_PLANE_TOLERANCE 0.01  // plane distance, relative to hit distance
+#define REPROJECT_NORMAL_COS 0.9
+#define REPROJECT_GLOSSY_ROUGHNESS 0.3  // sharper metals (and glass) are never reprojected
+#define GBUFFER_MISS -1.0
+#define GBUFFER_VIEW_DEPENDENT 4194304.0  // 2^22 flag above the packed normal
+
+vec2 octSign(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 octEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return (n.z >= 0.0) ? n.xy : (1.0 - abs(n.yx)) * octSign(n.xy);
+}
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * octSign(n.xy);
+    return normalize(n);
+}
+
+// xyz = world hit point, w = octahedral normal at 11 bits per axis as an
+// exactly representable integer (+ GBUFFER_VIEW_DEPENDENT), or GBUFFER_MISS
+vec4 packGBuffer(vec3 P, vec3 N, bool viewDependent) {
+    vec2 o = floor((octEncode(N) * 0.5 + 0.5) * 2047.0 + 0.5);
+    return vec4(P, o.x * 2048.0 + o.y + (viewDependent ? GBUFFER_VIEW_DEPENDENT : 0.0));
+}
+
+vec3 gbufferNormal(float w) {
+    if (w >= GBUFFER_VIEW_DEPENDENT) w -= GBUFFER_VIEW_DEPENDENT;
+    float ox = floor(w / 2048.0);
+    return octDecode(vec2(ox, w - ox * 2048.0) / 2047.0 * 2.0 - 1.0);
+}
+
+// Trace the un-jittered pixel-centre ray (the one the pre-pass rasterized, so
+// visPrim is exact for it); P is its hit point, or a point far
+// along it on a miss (projects like a direction)
+vec4 primaryGBuffer(int visPrim, out vec3 P) {
+    Ray r = Ray(cameraPosition, cameraRayDir(invViewProj, cameraPosition, fragTexCoord * 2.0 - 1.0));
+    HitRecord hit;
+    int hitIndex;
+    findPrimaryHit(r, visPrim, hit, hitIndex);
+    if (hitIndex == -1) {
+        P = r.origin + r.direction * 1e4;
+        return vec4(P, GBUFFER_MISS);
+    }
+    vec3 color; int mat; vec3 emission; float emStr, ior, rough, spec, shine;
+    getPrimMat(hitIndex, color, mat, emission, emStr, ior, rough, spec, shine);
+    P = hit.hitPoint;
+    return packGBuffer(P, hit.normal, mat == 3 || (mat == 1 && rough < REPROJECT_GLOSSY_ROUGHNESS));
+}
+
+// Previous accumulation + moments for this pixel's first hit, read where the
+// previous camera saw it. False (no history) when it was off screen, another
+// surface was there (disocclusion: plane distance or normal mismatch), or the
+// surface's shading depends on the view.
+bool reprojectHistory(vec4 gbuf, vec3 P, out vec4 prevAccum, out vec4 prevMoments) {
+    prevAccum = vec4(0.0);
+    prevMoments = vec4(0.0);
+    if (gbuf.w >= GBUFFER_VIEW_DEPENDENT) return false;
+
+    vec4 clip = prevViewProj * vec4(P, 1.0);
+    if (clip.w <= 0.0) return false;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0)))) return false;
+    ivec2 prevPixel = ivec2(uv * resolution);
+
+    vec4 prevG = texelFetch(gbufferTexture, prevPixel, 0);
+    if (gbuf.w == GBUFFER_MISS) {
+        if (prevG.w != GBUFFER_MISS) return false;
+    } else {
+        if (prevG.w < 0.0 || prevG.w >= GBUFFER_VIEW_DEPENDENT) return false;
+        vec3 N = gbufferNormal(gbuf.w);
+        if (dot(N, gbufferNormal(prevG.w)) < REPROJECT_NORMAL_COS) return false;
+        if (abs(dot(prevG.xyz - P, N)) > REPROJECT_PLANE_TOLERANCE * length(P - cameraPosition))
+            return false;
+    }
+
+    prevAccum = texelFetch(accumTexture, prevPixel, 0);
+    prevMoments = texelFetch(momentsTexture, prevPixel, 0);
+    float count = prevMoments.z;
+    if (count > REPROJECT_MAX_HISTORY) {
+        // Keep the mean, forget the oldest samples (the sum mode's alpha is the count)
+        if (accumMode == ACCUM_SUM_FLOAT) prevAccum *= REPROJECT_MAX_HISTORY / count;
+        prevMoments.z = REPROJECT_MAX_HISTORY;
+    }
+    return count > 0.0;
+}
+
 void main() {
     uvec2 pixelCoord = uvec2(gl_FragCoord.xy);
-    int spp = clamp(samplesPerFrame, 1, 64);
+    ivec2 pixel = ivec2(pixelCoord);
     vec2 pixelSize = 2.0 / resolution;
 
+    // Visibility pre-pass: the centre ray's primitive, and the hint for the
+    // jittered sample rays where all four neighbours agree (edges and thin
+    // features, where a jittered ray may see something else, use the BVH)
+    int centerPrim = VIS_UNKNOWN, samplePrim = VIS_UNKNOWN;
+    if (useVisibility == 1) {
+        ivec2 maxPixel = ivec2(resolution) - 1;
+        float id = texelFetch(texture0, pixel, 0).r;
+        centerPrim = int(id + 0.5) - 1;
+        if (texelFetch(texture0, max(pixel - ivec2(1, 0), ivec2(0)), 0).r == id &&
+            texelFetch(texture0, min(pixel + ivec2(1, 0), maxPixel), 0).r == id &&
+            texelFetch(texture0, max(pixel - ivec2(0, 1), ivec2(0)), 0).r == id &&
+            texelFetch(texture0, min(pixel + ivec2(0, 1), maxPixel), 0).r == id)
+            samplePrim = centerPrim;
+    }
+
+    vec3 firstHit;
+    vec4 gbuf = primaryGBuffer(centerPrim, firstHit);
+    gbufferOut = gbuf;
+    if (gbufferOnly == 1) {
+        finalColor = gbuf;
+        return;
+    }
+
+    // History: last frame's accumulation and per-pixel luminance moments +
+    // exact sample count, reprojected if the camera moved. A full reset
+    // (frameCount <= 1 without reprojection) starts from zero.
+    vec4 prevAccum, prevMoments;
+    float prevCount;
+    bool freshStart = false;
+    if (reprojectFrame == 1) {
+        reprojectHistory(gbuf, firstHit, prevAccum, prevMoments);
+        prevCount = prevMoments.z;
+    } else {
+        prevAccum = texture(accumTexture, fragTexCoord);
+        prevMoments = texelFetch(momentsTexture, pixel, 0);
+        freshStart = frameCount <= 1;
+        prevCount = freshStart ? 0.0 : prevMoments.z;
+    }
+    vec3 prev = prevAccum.rgb / max(prevAccum.a, 1.0);   // running mean so far
+
+    int spp = clamp(samplesPerFrame, 1, 64);
+    if (adaptiveSampling == 1) {
+        spp = int(texelFetch(sampleBudget, pixel / ADAPTIVE_TILE_SIZE, 0).r * 255.0 + 0.5);
+        if (spp == 0) {
+            // Tile converged: carry both targets over untouched
+            finalColor = prevAccum;
+            momentsOut = prevMoments;
+            return;
+        }
+    }
+
     vec3 accumColor = vec3(0.0);
+    float lumSum = 0.0, lumSqSum = 0.0;
+    samplerPixel = pixel;
 
     for (int s = 0; s < spp; s++) {
         // Unique RNG seed per sample: pixel + frame + sample index
         rngState = pixelCoord.x * 1973u + pixelCoord.y * 9277u
                  + uint(frameCount) * 26699u + uint(s) * 39293u;
         randomDouble();
+        samplerIndex = uint(prevCount) + uint(s);
 
-        vec2 jitter = (vec2(randomDouble(), randomDouble()) - 0.5) * pixelSize;
+        vec2 jitter = (sample2D(0) - 0.5) * pixelSize;
         vec2 ndc = fragTexCoord * 2.0 - 1.0 + jitter;
         vec4 clipPos = vec4(ndc, -1.0, 1.0);
         vec4 worldPos4 = invViewProj * clipPos;
         vec3 worldPos = worldPos4.xyz / worldPos4.w;
 
         Ray sampleRay = Ray(cameraPosition, normalize(worldPos - cameraPosition));
-        accumColor += colorRayIterative(sampleRay);
+        vec3 sampleColor = colorRayIterative(sampleRay, samplePrim);
+        accumColor += sampleColor;
+        float lum = dot(sampleColor, vec3(0.2126, 0.7152, 0.0722));
+        lumSum += lum;
+        lumSqSum += lum * lum;
     }
 
     vec3 outputColor = accumColor / float(spp);
-
-    // Temporal accumulation — always blend, never flash black
-    vec3 prev = texture(accumTexture, fragTexCoord).rgb;
-    if (frameCount <= 1) {
-        // First frame after camera move: aggressively replace but keep old as fallback
-        // Avoids black flash — stale pixels from old angle are better than nothing
+    float count = prevCount + float(spp);
+    momentsOut = vec4((prevMoments.x * prevCount + lumSum) / count,
+                      (prevMoments.y * prevCount + lumSqSum) / count,
+                      count, 1.0);
+
+    // Temporal accumulation
+    if (accumMode == ACCUM_SUM_FLOAT) {
+        // Exact sum + count; display.glsl divides only at presentation. A fresh
+        // start (edits, or a camera move with reprojection off) begins a new
+        // sum: nothing of the old image may enter it, since the convergence
+        // check only sees the new samples in the moments target.
+        finalColor = freshStart ? vec4(accumColor, float(spp))
+                                : vec4(prevAccum.rgb + accumColor, prevAccum.a + float(spp));
+    } else if (freshStart) {
+        // Running mean: keep 30% of the old image for one frame to avoid a
+        // black flash; the next frames weigh it out by sample count
         float prevLum = dot(prev, vec3(0.299, 0.587, 0.114));
-        float blend = (prevLum > 0.001) ? 0.7 : 1.0; // if prev has data, keep 30%
-        outputColor = mix(prev, outputColor, blend);
+        float blend = (prevLum > 0.001) ? 0.7 : 1.0;
+        finalColor = vec4(mix(prev, outputColor, blend), 1.0);
     } else {
-        float blendFactor = 1.0 / min(float(frameCount), 4096.0);
-        outputColor = mix(prev, outputColor, blendFactor);
+        // Weighted by sample count: adaptive tiles take different spp per frame
+        float blendFactor = max(float(spp) / count, 1.0 / 4096.0);
+        finalColor = vec4(mix(prev, outputColor, blendFactor), 1.0);
     }
-
-    finalColor = vec4(outputColor, 1.0);
 }
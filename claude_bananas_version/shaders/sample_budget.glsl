@@ -0,0 +1,56 @@
+// NOTE: #version directive is prepended by C code at load time
+// Sample budget pass: one fragment per ADAPTIVE_TILE_SIZE^2 tile of the
+// raytrace target. Reads the per-pixel luminance moments, estimates the tile's
+// relative noise and writes how many samples each pixel of the tile should
+// take next frame (R = spp / 255, read by raytrace.glsl main()). G/B carry the
+// tile error as 16-bit fixed point for the host's convergence check.
+
+#ifdef GL_ES
+precision highp float;
+precision highp int;
+#endif
+
+#define ADAPTIVE_TILE_SIZE 16
+#define ADAPTIVE_LUM_FLOOR 0.05  // noise in dark pixels is judged against this
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform sampler2D texture0;      // raytrace momentsOut: [mean lum, mean lum^2, count, 1]
+uniform int samplesPerFrame;     // base spp, what every tile got before adaptive kicked in
+uniform float adaptiveThreshold; // target relative standard error of the pixel means
+
+void main() {
+    ivec2 origin = ivec2(gl_FragCoord.xy) * ADAPTIVE_TILE_SIZE;
+    ivec2 size = textureSize(texture0, 0);
+
+    // Mean over the tile of each pixel mean's relative variance:
+    // sample variance / count / (mean + floor)^2
+    float relVarSum = 0.0;
+    int pixels = 0;
+    for (int y = 0; y < ADAPTIVE_TILE_SIZE; y++) {
+        for (int x = 0; x < ADAPTIVE_TILE_SIZE; x++) {
+            ivec2 p = origin + ivec2(x, y);
+            if (p.x >= size.x || p.y >= size.y) continue;
+            vec4 m = texelFetch(texture0, p, 0);
+            if (m.z < 1.0) continue;
+            float variance = max(m.y - m.x * m.x, 0.0) * m.z / max(m.z - 1.0, 1.0);
+            float denom = m.x + ADAPTIVE_LUM_FLOOR;
+            relVarSum += variance / m.z / (denom * denom);
+            pixels++;
+        }
+    }
+    float tileError = (pixels > 0) ? sqrt(relVarSum / float(pixels)) : 1.0;
+
+    // Converged tiles stop; the rest get more samples the further they are from
+    // the target, up to twice the base rate so frame time stays bounded
+    int base = clamp(samplesPerFrame, 1, 64);
+    int spp = 0;
+    if (tileError > adaptiveThreshold) {
+        float boost = clamp(sqrt(tileError / adaptiveThreshold), 1.0, 2.0);
+        spp = clamp(int(ceil(float(base) * boost)), 1, 64);
+    }
+
+    float q = floor(clamp(tileError, 0.0, 1.0) * 65535.0 + 0.5);
+    finalColor = vec4(float(spp), floor(q / 256.0), mod(q, 256.0), 255.0) / 255.0;
+}
@@ -0,0 +1,87 @@
+// NOTE: #version directive is prepended by C code at load time
+// Upsample pass: brings the reduced-resolution accumulation traced during
+// camera/sphere interaction back to full resolution. Each full-resolution
+// pixel blends its 2x2 low-resolution neighbours with bilinear weights scaled
+// by how well their first hit matches its own (joint bilateral upsampling),
+// so silhouettes and creases stay sharp instead of bleeding across edges.
+// The guide is a one-ray-per-pixel first-hit pass of raytrace.glsl.
+
+#ifdef GL_ES
+precision highp float;
+precision highp int;
+#endif
+
+#define GBUFFER_MISS -1.0
+#define GBUFFER_VIEW_DEPENDENT 4194304.0  // must match raytrace.glsl
+#define UPSAMPLE_PLANE_TOLERANCE 0.02     // plane distance, relative to hit distance
+#define UPSAMPLE_NORMAL_POWER 8.0
+
+in vec2 fragTexCoord;
+out vec4 finalColor;
+
+uniform sampler2D texture0;      // low-resolution accumulation (sum + count or running mean)
+uniform sampler2D lowGBuffer;    // its G-buffer, raytrace.glsl gbufferOut
+uniform sampler2D guideGBuffer;  // full-resolution first hits, same packing
+uniform vec3 cameraPosition;
+
+vec2 octSign(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * octSign(n.xy);
+    return normalize(n);
+}
+
+vec3 gbufferNormal(float w) {
+    if (w >= GBUFFER_VIEW_DEPENDENT) w -= GBUFFER_VIEW_DEPENDENT;
+    float ox = floor(w / 2048.0);
+    return octDecode(vec2(ox, w - ox * 2048.0) / 2047.0 * 2.0 - 1.0);
+}
+
+// How likely a low-resolution texel saw the same surface as the guide pixel:
+// 1 = same plane and orientation, 0 = a different surface (or hit vs miss)
+float geometryWeight(vec4 guide, vec4 low) {
+    if (guide.w == GBUFFER_MISS) return (low.w == GBUFFER_MISS) ? 1.0 : 0.0;
+    if (low.w < 0.0) return 0.0;
+    vec3 N = gbufferNormal(guide.w);
+    float normalW = pow(max(dot(N, gbufferNormal(low.w)), 0.0), UPSAMPLE_NORMAL_POWER);
+    float tolerance = UPSAMPLE_PLANE_TOLERANCE * length(guide.xyz - cameraPosition);
+    float planeW = max(1.0 - abs(dot(low.xyz - guide.xyz, N)) / tolerance, 0.0);
+    return normalW * planeW;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 fullSize = textureSize(guideGBuffer, 0);
+    ivec2 lowSize = textureSize(texture0, 0);
+    vec4 guide = texelFetch(guideGBuffer, pixel, 0);
+
+    vec2 lowPos = (vec2(pixel) + 0.5) * vec2(lowSize) / vec2(fullSize) - 0.5;
+    ivec2 base = ivec2(floor(lowPos));
+    vec2 f = lowPos - vec2(base);
+
+    vec3 sum = vec3(0.0), bilinear = vec3(0.0), best = vec3(0.0);
+    float weightSum = 0.0, bestWeight = -1.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 o = ivec2(i & 1, i >> 1);
+        ivec2 p = clamp(base + o, ivec2(0), lowSize - 1);
+        vec4 c = texelFetch(texture0, p, 0);
+        vec3 mean = c.rgb / max(c.a, 1.0);   // sum mode: alpha is the count
+        float wb = (o.x == 1 ? f.x : 1.0 - f.x) * (o.y == 1 ? f.y : 1.0 - f.y);
+        float wg = geometryWeight(guide, texelFetch(lowGBuffer, p, 0));
+        sum += mean * wb * wg;
+        weightSum += wb * wg;
+        bilinear += mean * wb;
+        if (wg > bestWeight) { bestWeight = wg; best = mean; }
+    }
+
+    // No neighbour matches well (thin feature the low resolution missed):
+    // take the closest match, or plain bilinear if none saw this surface
+    vec3 color;
+    if (weightSum > 1e-4) color = sum / weightSum;
+    else if (bestWeight > 0.0) color = best;
+    else color = bilinear;
+    finalColor = vec4(color, 1.0);
+}
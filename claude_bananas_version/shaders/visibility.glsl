@@ -0,0 +1,42 @@
+// NOTE: #version directive is prepended by C code at load time
+// Visibility pre-pass: the host rasterizes every primitive with its index + 1
+// in the vertex color's red byte (quads and triangles as triangles, spheres as
+// camera-facing impostor quads). This shader trims the impostors to the exact
+// sphere silhouette and depth, so the depth test leaves, per pixel centre, the
+// primitive the primary ray hits first. R = index + 1, 0 = nothing (sky).
+
+#ifdef GL_ES
+precision highp float;
+precision highp int;
+#endif
+
+in vec2 fragTexCoord;
+in vec4 fragColor;
+out vec4 finalColor;
+
+uniform sampler2D geomData;      // same layout as raytrace.glsl
+uniform vec3 cameraPosition;
+uniform mat4 invViewProj;
+uniform vec2 resolution;
+uniform mat4 mvp;                // raylib's, shared with the default vertex shader
+
+#include "camera.glsl"
+
+void main() {
+    int id = int(fragColor.r * 255.0 + 0.5) - 1;
+    float depth = gl_FragCoord.z;
+    vec4 sphere = texelFetch(geomData, ivec2(0, id), 0);
+    if (sphere.w >= 0.0) {      // radius; quads and triangles carry negative tags
+        vec3 dir = cameraRayDir(invViewProj, cameraPosition, gl_FragCoord.xy / resolution * 2.0 - 1.0);
+        vec3 oc = cameraPosition - sphere.xyz;
+        float b = dot(dir, oc);
+        float disc = b * b - (dot(oc, oc) - sphere.w * sphere.w);
+        if (disc < 0.0) discard;
+        float t = -b - sqrt(disc);
+        if (t <= 0.0) discard;   // camera inside: the host never draws that impostor
+        vec4 clip = mvp * vec4(cameraPosition + dir * t, 1.0);
+        depth = clip.z / clip.w * 0.5 + 0.5;
+    }
+    gl_FragDepth = depth;
+    finalColor = vec4(float(id + 1), 0.0, 0.0, 1.0);
+}
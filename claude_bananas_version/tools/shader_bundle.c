@@ -0,0 +1,456 @@
+// Build-time shader bundler (make shaders): resolves #include "file", strips
+// comments and every function main() cannot reach, collapses whitespace, and
+// writes the result as a .glsl file or as C strings for EmbeddedShaderSource()
+// (shader_embed.h).
+//
+//   shader_bundle [-I dir]... [--keep name,...] -o out.glsl file.glsl
+//   shader_bundle [-I dir]... [--keep name,...] --embed -o out.c file.glsl...
+//
+// Includes are searched next to the including file, then in the -I
+// directories, and each file is included once. Reachability is textual:
+// anything named outside a function body (globals, #define bodies) or in a
+// reachable function keeps that function, whatever #if it sits under, so
+// stripping never depends on the defines the host adds at load time.
+// --keep roots functions only referenced by code appended at load time.
+// Whitespace is only kept where tokens would merge; preprocessor lines stay on
+// their own lines and each top-level declaration starts a new one.
+
+#define _XOPEN_SOURCE 700   // realpath
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INCLUDE_DIRS 16
+#define MAX_INCLUDE_DEPTH 16
+#define MAX_FILES 64
+#define MAX_KEEP 32
+#define MAX_NAME 64
+
+typedef struct Text {
+    char *data;
+    size_t len, cap;
+} Text;
+
+// A top-level declaration of the comment-free source: a preprocessor line, a
+// function definition or prototype, or anything else up to its ';'
+typedef struct Item {
+    size_t start, end;
+    char name[MAX_NAME];   // function name, "" for everything else
+    bool reachable;
+} Item;
+
+static const char *includeDirs[MAX_INCLUDE_DIRS];
+static int includeDirCount;
+static const char *keepNames[MAX_KEEP];
+static int keepCount;
+static char *includedFiles[MAX_FILES];   // realpath of every file pulled in
+static int includedCount;
+
+static void Fail(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "shader_bundle: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static void TextAppend(Text *t, const char *s, size_t n) {
+    if (t->len + n + 1 > t->cap) {
+        t->cap = (t->len + n + 1) * 2;
+        t->data = (char *)realloc(t->data, t->cap);
+        if (!t->data) Fail("out of memory");
+    }
+    memcpy(t->data + t->len, s, n);
+    t->len += n;
+    t->data[t->len] = '\0';
+}
+
+static void TextPutc(Text *t, char c) {
+    TextAppend(t, &c, 1);
+}
+
+static char LastChar(const Text *t) {
+    return t->len > 0 ? t->data[t->len - 1] : '\n';
+}
+
+static char *ReadFile(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = (char *)malloc((size_t)size + 1);
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    fclose(f);
+    return data;
+}
+
+static bool IsIdentChar(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// ============================================================
+// #include
+// ============================================================
+
+static bool FileExists(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f) fclose(f);
+    return f != NULL;
+}
+
+// Resolve `name` included from `from`: its directory first, then -I
+static bool FindInclude(const char *from, const char *name, char *path, size_t size) {
+    const char *slash = strrchr(from, '/');
+    int dirLen = slash ? (int)(slash - from + 1) : 0;
+    if (snprintf(path, size, "%.*s%s", dirLen, from, name) < (int)size && FileExists(path))
+        return true;
+    for (int i = 0; i < includeDirCount; i++)
+        if (snprintf(path, size, "%s/%s", includeDirs[i], name) < (int)size && FileExists(path))
+            return true;
+    return false;
+}
+
+// False when `path` was already pulled in (include-once), otherwise records it
+static bool FirstInclusion(const char *path) {
+    char *real = realpath(path, NULL);
+    if (!real) Fail("cannot resolve %s", path);
+    for (int i = 0; i < includedCount; i++) {
+        if (strcmp(includedFiles[i], real) == 0) {
+            free(real);
+            return false;
+        }
+    }
+    if (includedCount == MAX_FILES) Fail("more than %d files included from %s", MAX_FILES, path);
+    includedFiles[includedCount++] = real;
+    return true;
+}
+
+static void AppendWithIncludes(Text *out, const char *path, int depth) {
+    if (depth > MAX_INCLUDE_DEPTH) Fail("#include nested too deep in %s", path);
+    char *src = ReadFile(path);
+    if (!src) Fail("cannot read %s", path);
+    for (char *line = src; *line; ) {
+        char *eol = strchr(line, '\n');
+        size_t len = eol ? (size_t)(eol - line) : strlen(line);
+        const char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#') {
+            const char *d = p + 1;
+            while (*d == ' ' || *d == '\t') d++;
+            if (strncmp(d, "include", 7) == 0) {
+                const char *open = strchr(d, '"');
+                const char *close = open ? strchr(open + 1, '"') : NULL;
+                if (!close || close > line + len) Fail("malformed #include in %s", path);
+                char name[PATH_MAX], found[PATH_MAX];
+                snprintf(name, sizeof(name), "%.*s", (int)(close - open - 1), open + 1);
+                if (!FindInclude(path, name, found, sizeof(found)))
+                    Fail("%s: cannot find %s", path, name);
+                if (FirstInclusion(found)) AppendWithIncludes(out, found, depth + 1);
+                line += len + (eol ? 1 : 0);
+                continue;
+            }
+        }
+        TextAppend(out, line, len);
+        TextPutc(out, '\n');
+        line += len + (eol ? 1 : 0);
+    }
+    free(src);
+}
+
+// ============================================================
+// Comments
+// ============================================================
+
+// Comments become a space (block comments keep their newlines, so every
+// preprocessor line stays on its own line); line continuations are joined
+static void StripComments(Text *out, const char *s) {
+    for (size_t i = 0; s[i]; i++) {
+        if (s[i] == '/' && s[i + 1] == '/') {
+            while (s[i + 1] && s[i + 1] != '\n') i++;
+            TextPutc(out, ' ');
+        } else if (s[i] == '/' && s[i + 1] == '*') {
+            TextPutc(out, ' ');
+            for (i += 2; s[i] && !(s[i] == '*' && s[i + 1] == '/'); i++)
+                if (s[i] == '\n') TextPutc(out, '\n');
+            if (s[i]) i++;
+        } else if (s[i] == '\\' && s[i + 1] == '\n') {
+            i++;
+        } else if (s[i] != '\r') {
+            TextPutc(out, s[i]);
+        }
+    }
+}
+
+// ============================================================
+// Top-level items and reachability
+// ============================================================
+
+static bool AtLineStart(const char *s, size_t i) {
+    while (i > 0 && (s[i - 1] == ' ' || s[i - 1] == '\t')) i--;
+    return i == 0 || s[i - 1] == '\n';
+}
+
+static size_t LineEnd(const char *s, size_t i) {
+    while (s[i] && s[i] != '\n') i++;
+    return i;
+}
+
+// Function name when s[start, close] ends in "name(...)", with close at the
+// ')'; `prototype` also rejects initializers ("vec3 x = vec3(...)")
+static bool FunctionName(const char *s, size_t start, size_t close, bool prototype, char *name) {
+    int depth = 0;
+    size_t i = close;
+    for (;; i--) {
+        if (s[i] == ')') depth++;
+        else if (s[i] == '(' && --depth == 0) break;
+        if (i == start) return false;
+    }
+    while (i > start && isspace((unsigned char)s[i - 1])) i--;
+    size_t end = i;
+    while (i > start && IsIdentChar(s[i - 1])) i--;
+    if (i == end || end - i >= MAX_NAME || isdigit((unsigned char)s[i])) return false;
+    if (prototype) {
+        for (size_t j = start; j < i; j++)
+            if (s[j] == '=') return false;
+        if (i == start) return false;   // a bare call, not a declaration
+    }
+    snprintf(name, MAX_NAME, "%.*s", (int)(end - i), s + i);
+    return true;
+}
+
+static size_t LastNonSpace(const char *s, size_t start, size_t end) {
+    while (end > start && isspace((unsigned char)s[end - 1])) end--;
+    return end;   // one past it
+}
+
+static int SplitItems(const char *s, Item **itemsOut) {
+    int count = 0, cap = 64;
+    Item *items = (Item *)malloc(sizeof(Item) * cap);
+    size_t i = 0;
+    while (s[i]) {
+        while (isspace((unsigned char)s[i])) i++;
+        if (!s[i]) break;
+        Item it = { i, 0, "", false };
+        if (s[i] == '#') {
+            it.end = LineEnd(s, i);
+        } else {
+            int depth = 0;
+            bool function = false;
+            for (; s[i]; i++) {
+                if (s[i] == '#' && AtLineStart(s, i)) { i = LineEnd(s, i); if (!s[i]) break; continue; }
+                if (s[i] == '{') {
+                    if (depth++ == 0) {
+                        size_t last = LastNonSpace(s, it.start, i);
+                        function = last > it.start && s[last - 1] == ')' &&
+                                   FunctionName(s, it.start, last - 1, false, it.name);
+                    }
+                } else if (s[i] == '}') {
+                    if (--depth == 0 && function) { i++; break; }
+                } else if (s[i] == ';' && depth == 0) {
+                    size_t last = LastNonSpace(s, it.start, i);
+                    if (last > it.start && s[last - 1] == ')')
+                        FunctionName(s, it.start, last - 1, true, it.name);
+                    i++;
+                    break;
+                }
+            }
+            it.end = i;
+        }
+        if (count == cap) items = (Item *)realloc(items, sizeof(Item) * (cap *= 2));
+        items[count++] = it;
+        i = it.end;
+    }
+    *itemsOut = items;
+    return count;
+}
+
+static void MarkReachable(const char *s, Item *items, int count, const char *name);
+
+// Mark every function named inside s[start, end)
+static void MarkNamedIn(const char *s, size_t start, size_t end, Item *items, int count) {
+    for (size_t i = start; i < end; ) {
+        if (isdigit((unsigned char)s[i])) {
+            while (i < end && (IsIdentChar(s[i]) || s[i] == '.')) i++;   // 1.0e5, 0x1Fu
+        } else if (IsIdentChar(s[i])) {
+            size_t j = i;
+            while (j < end && IsIdentChar(s[j])) j++;
+            char name[MAX_NAME];
+            if (j - i < MAX_NAME) {
+                snprintf(name, sizeof(name), "%.*s", (int)(j - i), s + i);
+                MarkReachable(s, items, count, name);
+            }
+            i = j;
+        } else {
+            i++;
+        }
+    }
+}
+
+static void MarkReachable(const char *s, Item *items, int count, const char *name) {
+    for (int k = 0; k < count; k++) {
+        if (items[k].reachable || strcmp(items[k].name, name) != 0) continue;
+        items[k].reachable = true;
+        MarkNamedIn(s, items[k].start, items[k].end, items, count);
+    }
+}
+
+// ============================================================
+// Minify
+// ============================================================
+
+static bool IsOperatorChar(char c) {
+    return c != '\0' && strchr("+-*/%<>=!&|^", c) != NULL;
+}
+
+// Whitespace survives only between two identifier/number characters or two
+// operator characters ("a - -b", "x / *p"); preprocessor lines keep single
+// spaces ("#define F (x)" is not "#define F(x)")
+static void Minify(Text *out, const char *s, size_t start, size_t end) {
+    for (size_t i = start; i < end; ) {
+        if (s[i] == '#' && AtLineStart(s, i)) {
+            if (LastChar(out) != '\n') TextPutc(out, '\n');
+            size_t e = LineEnd(s, i);
+            if (e > end) e = end;
+            bool space = false;
+            for (; i < e; i++) {
+                if (isspace((unsigned char)s[i])) { space = true; continue; }
+                if (space && LastChar(out) != '\n') TextPutc(out, ' ');
+                space = false;
+                TextPutc(out, s[i]);
+            }
+            TextPutc(out, '\n');
+            continue;
+        }
+        if (isspace((unsigned char)s[i])) {
+            while (i < end && isspace((unsigned char)s[i])) i++;
+            char prev = LastChar(out), next = i < end ? s[i] : '\0';
+            if ((IsIdentChar(prev) && IsIdentChar(next)) || (IsOperatorChar(prev) && IsOperatorChar(next)))
+                TextPutc(out, ' ');
+            continue;
+        }
+        TextPutc(out, s[i++]);
+    }
+    if (LastChar(out) != '\n') TextPutc(out, '\n');
+}
+
+// ============================================================
+// Driver
+// ============================================================
+
+static void Bundle(const char *path, Text *out) {
+    for (int i = 0; i < includedCount; i++) free(includedFiles[i]);
+    includedCount = 0;
+    Text raw = {0}, src = {0};
+    FirstInclusion(path);
+    AppendWithIncludes(&raw, path, 0);
+    StripComments(&src, raw.data ? raw.data : "");
+    if (!src.data) TextAppend(&src, "", 0);
+
+    Item *items;
+    int count = SplitItems(src.data, &items);
+    MarkReachable(src.data, items, count, "main");
+    for (int k = 0; k < keepCount; k++) MarkReachable(src.data, items, count, keepNames[k]);
+    for (int k = 0; k < count; k++)
+        if (items[k].name[0] == '\0') MarkNamedIn(src.data, items[k].start, items[k].end, items, count);
+
+    fprintf(stderr, "%s:", path);
+    for (int k = 0; k < count; k++) {
+        if (items[k].name[0] != '\0' && !items[k].reachable) {
+            fprintf(stderr, " -%s", items[k].name);
+            continue;
+        }
+        Minify(out, src.data, items[k].start, items[k].end);
+    }
+    fprintf(stderr, " %zu -> %zu bytes\n", raw.len, out->len);
+    free(items);
+    free(raw.data);
+    free(src.data);
+}
+
+static void WriteCString(FILE *f, const char *s) {
+    fputs("    \"", f);
+    for (; *s; s++) {
+        if (*s == '\n') {
+            fputs(s[1] ? "\\n\"\n    \"" : "\\n", f);
+        } else if (*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20 || (unsigned char)*s >= 0x7f) {
+            fprintf(f, "\\%03o", (unsigned char)*s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputs("\"", f);
+}
+
+int main(int argc, char **argv) {
+    const char *outPath = NULL;
+    const char *inputs[MAX_FILES];
+    int inputCount = 0;
+    bool embed = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-I") == 0 && i + 1 < argc && includeDirCount < MAX_INCLUDE_DIRS) {
+            includeDirs[includeDirCount++] = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--embed") == 0) {
+            embed = true;
+        } else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) {
+            for (char *name = strtok(argv[++i], ","); name && keepCount < MAX_KEEP; name = strtok(NULL, ","))
+                keepNames[keepCount++] = name;
+        } else if (argv[i][0] != '-' && inputCount < MAX_FILES) {
+            inputs[inputCount++] = argv[i];
+        } else {
+            inputCount = 0;
+            break;
+        }
+    }
+    if (!outPath || inputCount == 0 || (!embed && inputCount != 1)) {
+        fprintf(stderr, "Usage: %s [-I dir]... [--keep name,...] [--embed] -o out file...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(outPath, "wb");
+    if (!f) Fail("cannot write %s", outPath);
+    if (!embed) {
+        Text out = {0};
+        Bundle(inputs[0], &out);
+        fwrite(out.data, 1, out.len, f);
+        free(out.data);
+    } else {
+        fputs("// Generated by tools/shader_bundle.c (make shaders) - do not edit\n\n"
+              "#include <string.h>\n#include \"shader_embed.h\"\n", f);
+        for (int n = 0; n < inputCount; n++) {
+            Text out = {0};
+            Bundle(inputs[n], &out);
+            fprintf(f, "\n// %s\nstatic const char kShader%d[] =\n", inputs[n], n);
+            WriteCString(f, out.data);
+            fputs(";\n", f);
+            free(out.data);
+        }
+        fputs("\nstatic const struct { const char *path, *source; } kShaders[] = {\n", f);
+        for (int n = 0; n < inputCount; n++)
+            fprintf(f, "    { \"%s\", kShader%d },\n", inputs[n], n);
+        fputs("};\n\n"
+              "const char *EmbeddedShaderSource(const char *path) {\n"
+              "    for (size_t i = 0; i < sizeof(kShaders) / sizeof(kShaders[0]); i++)\n"
+              "        if (strcmp(kShaders[i].path, path) == 0) return kShaders[i].source;\n"
+              "    return NULL;\n"
+              "}\n", f);
+    }
+    fclose(f);
+    return 0;
+}